@@ -0,0 +1,64 @@
+#include "alloccount.h"
+
+#ifdef ALLOC_DEBUG
+#include <atomic>
+#include <new>
+#include <stdlib.h>
+
+namespace {
+thread_local uint64_t calls = 0;  // 平凡类型，访问时不需要初始化
+std::atomic<uint64_t> requests(0);
+std::atomic<uint64_t> requestCalls(0);
+std::atomic<uint64_t> dirtyRequests(0);
+}
+
+void AllocCount::Count() {
+    calls++;
+}
+
+uint64_t AllocCount::Calls() {
+    return calls;
+}
+
+void AllocCount::Record(uint64_t n) {
+    requests++;
+    requestCalls += n;
+    if(n > 0) { dirtyRequests++; }
+}
+// 文本格式的统计信息，每行一个指标
+std::string AllocCount::StatsStr() {
+    std::string str;
+    str += "alloc_static_requests " + std::to_string(requests.load()) + "\n";
+    str += "alloc_static_calls " + std::to_string(requestCalls.load()) + "\n";
+    str += "alloc_static_dirty_requests " + std::to_string(dirtyRequests.load()) + "\n";
+    return str;
+}
+
+void* operator new(size_t size) {
+    calls++;
+    void* p = malloc(size ? size : 1);
+    if(!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    calls++;
+    return malloc(size ? size : 1);
+}
+
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return operator new(size, std::nothrow);
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete[](void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+void operator delete[](void* p, size_t) noexcept { free(p); }
+void operator delete(void* p, const std::nothrow_t&) noexcept { free(p); }
+void operator delete[](void* p, const std::nothrow_t&) noexcept { free(p); }
+
+#endif //ALLOC_DEBUG
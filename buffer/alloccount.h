@@ -0,0 +1,25 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+#include <string>
+#include <stdint.h>
+
+// 调试用的分配计数：make ALLOC_DEBUG=1 时替换全局 operator new，按线程统计调用次数 (BlockPool 未命中的 malloc 也计入)
+// 连接记录每个静态文件请求处理过程中的次数，用于确认稳定状态下不调用全局分配器
+// 未开启时各函数为空操作，计数始终为 0
+class AllocCount {
+public:
+#ifdef ALLOC_DEBUG
+    static void Count();
+    static uint64_t Calls();  // 本线程的累计次数
+    static void Record(uint64_t calls);
+    static std::string StatsStr();
+#else
+    static void Count() {}
+    static uint64_t Calls() { return 0; }
+    static void Record(uint64_t) {}
+    static std::string StatsStr() { return ""; }
+#endif
+};
+
+#endif //ALLOC_COUNT_H
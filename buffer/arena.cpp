@@ -0,0 +1,81 @@
+#include "arena.h"
+
+void* Arena::Allocate(size_t size, size_t align) {
+    if(size > BlockPool::CAPACITY / 2) {
+        return AllocateLarge_(size);
+    }
+    if(cur_) {
+        uintptr_t base = reinterpret_cast<uintptr_t>(cur_->Data());
+        uintptr_t p = (base + cur_->writePos + align - 1) & ~static_cast<uintptr_t>(align - 1);
+        if(p + size <= base + BlockPool::CAPACITY) {
+            cur_->writePos = p + size - base;
+            return reinterpret_cast<void*>(p);
+        }
+    }
+    // 当前块剩余空间不够：接上新块
+    BufferBlock* block = BlockPool::Get();
+    if(cur_) { cur_->next = block; }
+    else { head_ = block; }
+    cur_ = block;
+    uintptr_t base = reinterpret_cast<uintptr_t>(block->Data());
+    uintptr_t p = (base + align - 1) & ~static_cast<uintptr_t>(align - 1);
+    block->writePos = p + size - base;
+    return reinterpret_cast<void*>(p);
+}
+
+StrRef Arena::Copy(const char* data, size_t len) {
+    char* p = static_cast<char*>(Allocate(len + 1, 1));
+    memcpy(p, data, len);
+    p[len] = '\0';
+    return StrRef(p, len);
+}
+
+StrRef Arena::Concat(const StrRef& a, const StrRef& b) {
+    char* p = static_cast<char*>(Allocate(a.len + b.len + 1, 1));
+    memcpy(p, a.data, a.len);
+    memcpy(p + a.len, b.data, b.len);
+    p[a.len + b.len] = '\0';
+    return StrRef(p, a.len + b.len);
+}
+// 块头之后对齐到 max_align_t
+void* Arena::AllocateLarge_(size_t size) {
+    const size_t head = (sizeof(Large) + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    Large* large = static_cast<Large*>(malloc(head + size));
+    assert(large);
+    large->next = large_;
+    large->size = head + size;
+    large_ = large;
+    MemBudget::Instance()->Add(MemBudget::BLOCK, large->size);
+    return reinterpret_cast<char*>(large) + head;
+}
+
+void Arena::FreeLarge_() {
+    while(large_) {
+        Large* next = large_->next;
+        MemBudget::Instance()->Add(MemBudget::BLOCK, -static_cast<int64_t>(large_->size));
+        free(large_);
+        large_ = next;
+    }
+}
+
+void Arena::Reset() {
+    FreeLarge_();
+    if(!head_) { return; }
+    while(head_->next) {
+        BufferBlock* next = head_->next->next;
+        BlockPool::Put(head_->next);
+        head_->next = next;
+    }
+    head_->writePos = 0;
+    cur_ = head_;
+}
+
+void Arena::Release() {
+    FreeLarge_();
+    while(head_) {
+        BufferBlock* next = head_->next;
+        BlockPool::Put(head_);
+        head_ = next;
+    }
+    cur_ = nullptr;
+}
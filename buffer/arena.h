@@ -0,0 +1,96 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <string>
+#include <cstring>
+#include <strings.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <new>
+#include <type_traits>
+#include "chainbuffer.h"
+
+// 一段字符的引用，不拥有内存 (通常指向 Arena 中以 '\0' 结尾的副本)
+// 可以由 std::string 隐式构造，此时只在该字符串存活期间有效，保存前需复制到 Arena
+struct StrRef {
+    StrRef() : data(""), len(0) {}
+    StrRef(const char* str, size_t n) : data(str), len(n) {}
+    StrRef(const char* str) : data(str), len(strlen(str)) {}
+    StrRef(const std::string& str) : data(str.c_str()), len(str.size()) {}
+
+    std::string Str() const { return std::string(data, len); }
+    bool Empty() const { return len == 0; }
+    bool operator==(const StrRef& other) const {
+        return len == other.len && memcmp(data, other.data, len) == 0;
+    }
+    bool operator!=(const StrRef& other) const { return !(*this == other); }
+    bool EqualsIgnoreCase(const StrRef& other) const {
+        return len == other.len && strncasecmp(data, other.data, len) == 0;
+    }
+
+    const char* data;
+    size_t len;
+};
+
+// 请求级的分配区：从 BlockPool 取块，按指针递增分配，内存不单独释放
+// 请求结束时 Reset 整体回收，只保留第一块 (一般请求只用到一块，为 O(1))；连接空闲时 Release 全部归还 BlockPool
+// 超过块容量一半的分配 (大的请求体等) 单独 malloc，Reset 时释放
+class Arena {
+public:
+    Arena() : head_(nullptr), cur_(nullptr), large_(nullptr) {}
+    ~Arena() { Release(); }
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* Allocate(size_t size, size_t align = alignof(max_align_t));
+    // 复制并以 '\0' 结尾，返回指向副本的引用
+    StrRef Copy(const char* data, size_t len);
+    StrRef Copy(const StrRef& str) { return Copy(str.data, str.len); }
+    StrRef Concat(const StrRef& a, const StrRef& b);
+
+    void Reset();
+    void Release();
+
+private:
+    struct Large {
+        Large* next;
+        size_t size;
+    };
+    void* AllocateLarge_(size_t size);
+    void FreeLarge_();
+
+    BufferBlock* head_;
+    BufferBlock* cur_;   // 正在分配的块，writePos 为已用的字节数
+    Large* large_;
+};
+
+// 从 Arena 分配的 STL 分配器，arena 为 nullptr 时使用全局堆
+// Arena 中的内存在 deallocate 时不做处理；Arena Reset 之前，使用它的容器须先放弃存储 (与空容器 swap)
+template<class T>
+struct ArenaAllocator {
+    typedef T value_type;
+    // 移动赋值 / 交换时分配器随存储一起转移，容器可以改用另一个 Arena
+    typedef std::true_type propagate_on_container_move_assignment;
+    typedef std::true_type propagate_on_container_swap;
+
+    ArenaAllocator(Arena* a = nullptr) : arena(a) {}
+    template<class U>
+    ArenaAllocator(const ArenaAllocator<U>& other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        if(arena) { return static_cast<T*>(arena->Allocate(n * sizeof(T), alignof(T))); }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* p, size_t) {
+        if(!arena) { ::operator delete(p); }
+    }
+
+    Arena* arena;
+};
+
+template<class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena == b.arena; }
+template<class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b) { return a.arena != b.arena; }
+
+#endif //ARENA_H
@@ -1,15 +1,24 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-26
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include "buffer.h"
 
-Buffer::Buffer(int initBuffSize) : buffer_(initBuffSize), readPos_(0), writePos_(0) {}
+namespace {
+// 每个线程缓存的空闲存储
+std::vector<std::vector<char>>& LocalPool() {
+    static thread_local std::vector<std::vector<char>> pool;
+    return pool;
+}
+}
+
+Buffer::Buffer(int initBuffSize) : readPos_(0), writePos_(0), initSize_(initBuffSize) {}
+
+Buffer::~Buffer() {
+    MemBudget::Instance()->Add(MemBudget::BUFFER, -static_cast<int64_t>(buffer_.size()));
+}
 
 // 一般情况下 Buffer 内容
 // [0                readPos_           writePos_          end]
@@ -41,9 +50,8 @@ void Buffer::RetrieveUntil(const char* end) {
     assert(Peek() <= end );
     Retrieve(end - Peek());
 }
-// 缓存区重置
+// 缓存区重置，只移动下标，不清零
 void Buffer::RetrieveAll() {
-    bzero(&buffer_[0], buffer_.size());
     readPos_ = 0;
     writePos_ = 0;
 }
@@ -96,6 +104,9 @@ void Buffer::Append(const Buffer& buff) {
 }
 // 确保缓存区中可写大小足够，如果不够利用预留空间位置，或者扩展缓存区
 void Buffer::EnsureWriteable(size_t len) {
+    if(buffer_.empty()) {
+        Allocate_(len);
+    }
     if(WritableBytes() < len) {  // 空间不足
         MakeSpace_(len);         // 利用预留空间位置，或者扩展缓存区
     }
@@ -103,7 +114,8 @@ void Buffer::EnsureWriteable(size_t len) {
 }
 
 ssize_t Buffer::ReadFd(int fd, int* saveErrno) {
-    char buff[65535]; 
+    // 溢出区由同一线程的所有连接共用，不占用栈空间；Buffer 尚未分配时数据全部先读到溢出区
+    static thread_local char buff[SPILL_SIZE];
     const size_t writable = WritableBytes();
     /* 分散读， 保证数据全部读完 */
     struct iovec iov[2]; // 将两个不连续的缓存组成 iov
@@ -111,7 +123,7 @@ ssize_t Buffer::ReadFd(int fd, int* saveErrno) {
     iov[0].iov_base = BeginPtr_() + writePos_;
     iov[0].iov_len = writable;
     iov[1].iov_base = buff;
-    iov[1].iov_len = sizeof(buff);
+    iov[1].iov_len = SPILL_SIZE;
 
     const ssize_t len = readv(fd, iov, 2);  // 分散读写
     if(len < 0) {  // 更改错误码
@@ -123,7 +135,7 @@ ssize_t Buffer::ReadFd(int fd, int* saveErrno) {
     }
     else {
         // 如果 Buffer 大小不够存， len - buffer_.size() 的内容被存在 buff 里面了
-        writePos_ = buffer_.size();
+        writePos_ += writable;
         // 此时只需要将 buff 中的内容，重新写入 Buffer 中即可 (中间会扩容)
         Append(buff, len - writable);
     }
@@ -141,19 +153,60 @@ ssize_t Buffer::WriteFd(int fd, int* saveErrno) {
     Retrieve(len);  // 统一使用 Retrieve
     return len;
 }
-// 返回指向 buffer_ (vector) 的头指针
+// 返回指向 buffer_ (vector) 的头指针，尚未分配时为 nullptr
 char* Buffer::BeginPtr_() {
-    return &*buffer_.begin();
+    return buffer_.data();
 }
 // 返回指向 buffer_ (vector) 的头指针 (const)
 const char* Buffer::BeginPtr_() const {
-    return &*buffer_.begin();
+    return buffer_.data();
+}
+// 第一次写入：优先复用本线程缓存的存储
+void Buffer::Allocate_(size_t len) {
+    std::vector<std::vector<char>>& pool = LocalPool();
+    if(!pool.empty()) {
+        buffer_.swap(pool.back());
+        pool.pop_back();
+    }
+    MemBudget::Instance()->Add(MemBudget::BUFFER, buffer_.size());
+    size_t size = std::max(len, initSize_);
+    if(buffer_.size() < size) {
+        Resize_(size);
+    }
+}
+// 改变存储大小，同时更新 MemBudget 的计数
+void Buffer::Resize_(size_t size) {
+    MemBudget::Instance()->Add(MemBudget::BUFFER, static_cast<int64_t>(size) - static_cast<int64_t>(buffer_.size()));
+    buffer_.resize(size);
+}
+
+void Buffer::Shrink() {
+    size_t readable = ReadableBytes();
+    if(readable == 0) {
+        readPos_ = writePos_ = 0;
+        if(buffer_.empty()) { return; }
+        MemBudget::Instance()->Add(MemBudget::BUFFER, -static_cast<int64_t>(buffer_.size()));
+        std::vector<std::vector<char>>& pool = LocalPool();
+        if(buffer_.size() <= POOL_MAX && pool.size() < POOL_COUNT) {
+            pool.push_back(std::move(buffer_));
+        }
+        std::vector<char>().swap(buffer_);
+        return;
+    }
+    if(buffer_.size() > SHRINK_AT && readable < buffer_.size() / 4) {
+        std::vector<char> smaller(std::max(readable, initSize_));
+        std::copy(Peek(), Peek() + readable, smaller.begin());
+        MemBudget::Instance()->Add(MemBudget::BUFFER, static_cast<int64_t>(smaller.size()) - static_cast<int64_t>(buffer_.size()));
+        buffer_.swap(smaller);
+        readPos_ = 0;
+        writePos_ = readable;
+    }
 }
 // 1. 利用预留空间位置  2. 扩展缓存区
 void Buffer::MakeSpace_(size_t len) {
     // 2. 如果 剩下的写空间 + 预留空间 都不够，就扩展缓存到合适的位置
     if(WritableBytes() + PrependableBytes() < len) {
-        buffer_.resize(writePos_ + len + 1);
+        Resize_(writePos_ + len + 1);
     } 
     // 1. 预留空间足够
     else {
@@ -1,12 +1,9 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-26
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef BUFFER_H
 #define BUFFER_H
 #include <cstring>   
@@ -14,12 +11,15 @@
 #include <unistd.h>  
 #include <sys/uio.h> 
 #include <vector> 
-#include <atomic>
 #include <assert.h>
+#include "membudget.h"
+// 存储在第一次写入时才分配，Shrink 时归还，空闲的连接不占用缓冲区内存
 class Buffer {
 public:
-    Buffer(int initBuffSize = 1024); // 缓存区初默认初始化大小 1024
-    ~Buffer() = default;
+    Buffer(int initBuffSize = 1024); // 第一次写入时至少分配 initBuffSize
+    ~Buffer();
+    Buffer(const Buffer&) = delete;  // 存储计入 MemBudget，不能复制
+    Buffer& operator=(const Buffer&) = delete;
 
     size_t WritableBytes() const;       
     size_t ReadableBytes() const ;
@@ -46,14 +46,26 @@ public:
     ssize_t ReadFd(int fd, int* Errno);
     ssize_t WriteFd(int fd, int* Errno);
 
+    // 没有未读数据时释放存储 (不太大的存储留给本线程之后的 Buffer 复用)；
+    // 存储超过 SHRINK_AT 而未读数据不到四分之一时，换成刚好容纳未读数据的存储
+    void Shrink();
+
+    static const size_t SHRINK_AT = 64 << 10;
+    static const size_t SPILL_SIZE = 64 << 10;  // ReadFd 中每个线程共用的溢出区
+    static const size_t POOL_MAX = 16 << 10;    // 超过该大小的存储直接释放
+    static const size_t POOL_COUNT = 64;        // 每个线程最多缓存的存储个数
+
 private:
     char* BeginPtr_();
     const char* BeginPtr_() const;
     void MakeSpace_(size_t len);
+    void Allocate_(size_t len);
+    void Resize_(size_t size);
 
     std::vector<char> buffer_;
-    std::atomic<std::size_t> readPos_;    // 用来标记，当前可写的位置
-    std::atomic<std::size_t> writePos_;   // 用来标记，当前可读的位置
+    std::size_t readPos_;    // 用来标记，当前可读的位置 (Buffer 只属于一个连接 / 线程，不需要原子操作)
+    std::size_t writePos_;   // 用来标记，当前可写的位置
+    size_t initSize_;        // 首次写入时分配的大小
 };
 
 #endif //BUFFER_H
\ No newline at end of file
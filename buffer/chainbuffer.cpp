@@ -0,0 +1,104 @@
+#include "chainbuffer.h"
+#include "alloccount.h"
+
+namespace {
+// 线程退出时释放缓存的空闲块
+struct FreeList {
+    FreeList() : head(nullptr), count(0) {}
+    ~FreeList() {
+        while(head) {
+            BufferBlock* next = head->next;
+            free(head);
+            head = next;
+        }
+    }
+    BufferBlock* head;
+    size_t count;
+};
+
+FreeList& LocalFree() {
+    static thread_local FreeList list;
+    return list;
+}
+}
+
+BufferBlock* BlockPool::Get() {
+    FreeList& list = LocalFree();
+    BufferBlock* block = list.head;
+    if(block) {
+        list.head = block->next;
+        list.count--;
+    } else {
+        block = static_cast<BufferBlock*>(malloc(BLOCK_SIZE));
+        assert(block);
+        AllocCount::Count();
+    }
+    block->next = nullptr;
+    block->readPos = block->writePos = 0;
+    MemBudget::Instance()->Add(MemBudget::BLOCK, BLOCK_SIZE);
+    return block;
+}
+
+void BlockPool::Put(BufferBlock* block) {
+    MemBudget::Instance()->Add(MemBudget::BLOCK, -static_cast<int64_t>(BLOCK_SIZE));
+    FreeList& list = LocalFree();
+    if(list.count >= MAX_FREE) {
+        free(block);
+        return;
+    }
+    block->next = list.head;
+    list.head = block;
+    list.count++;
+}
+// 先填满最后一块的剩余空间，不够时再接上新块
+void ChainBuffer::Append(const char* data, size_t len) {
+    while(len > 0) {
+        if(!tail_ || tail_->writePos == BlockPool::CAPACITY) {
+            BufferBlock* block = BlockPool::Get();
+            if(tail_) { tail_->next = block; }
+            else { head_ = block; }
+            tail_ = block;
+        }
+        size_t n = std::min(len, BlockPool::CAPACITY - tail_->writePos);
+        memcpy(tail_->Data() + tail_->writePos, data, n);
+        tail_->writePos += n;
+        size_ += n;
+        data += n;
+        len -= n;
+    }
+}
+
+void ChainBuffer::Retrieve(size_t len) {
+    assert(len <= size_);
+    size_ -= len;
+    while(len > 0) {
+        size_t n = std::min(len, head_->writePos - head_->readPos);
+        head_->readPos += n;
+        len -= n;
+        if(head_->readPos < head_->writePos) { break; }
+        BufferBlock* next = head_->next;
+        BlockPool::Put(head_);
+        head_ = next;
+    }
+    if(!head_) { tail_ = nullptr; }
+}
+
+void ChainBuffer::RetrieveAll() {
+    while(head_) {
+        BufferBlock* next = head_->next;
+        BlockPool::Put(head_);
+        head_ = next;
+    }
+    tail_ = nullptr;
+    size_ = 0;
+}
+
+std::string ChainBuffer::RetrieveAllToStr() {
+    std::string str;
+    str.reserve(size_);
+    for(BufferBlock* b = head_; b; b = b->next) {
+        str.append(b->Data() + b->readPos, b->writePos - b->readPos);
+    }
+    RetrieveAll();
+    return str;
+}
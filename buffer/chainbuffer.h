@@ -0,0 +1,72 @@
+#ifndef CHAIN_BUFFER_H
+#define CHAIN_BUFFER_H
+
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <assert.h>
+#include "buffer.h"
+
+// 固定大小的数据块，块头之后为数据
+struct BufferBlock {
+    BufferBlock* next;
+    size_t readPos;
+    size_t writePos;
+    char* Data() { return reinterpret_cast<char*>(this + 1); }
+};
+
+// 每个线程缓存一部分空闲块，分配与归还都不加锁；块在哪个线程归还就留在哪个线程
+// 复用的块不清零，数据只写入 [writePos, 容量)
+class BlockPool {
+public:
+    static BufferBlock* Get();
+    static void Put(BufferBlock* block);
+
+    static const size_t BLOCK_SIZE = 16 << 10;  // 含块头
+    static const size_t CAPACITY = BLOCK_SIZE - sizeof(BufferBlock);
+    static const size_t MAX_FREE = 64;          // 每个线程最多缓存的空闲块
+};
+
+// 由数据块串成的输出缓冲区：追加时不移动已有数据，各块的可读部分直接作为 writev 的 iovec
+// 与 Buffer 一样只属于一个连接，不加锁
+class ChainBuffer {
+public:
+    ChainBuffer() : head_(nullptr), tail_(nullptr), size_(0) {}
+    ~ChainBuffer() { RetrieveAll(); }
+    ChainBuffer(const ChainBuffer&) = delete;
+    ChainBuffer& operator=(const ChainBuffer&) = delete;
+
+    size_t ReadableBytes() const { return size_; }
+
+    void Append(const char* data, size_t len);
+    void Append(const std::string& str) { Append(str.data(), str.size()); }
+    void Append(const char* str) { Append(str, strlen(str)); }  // 字面量不构造临时的 std::string
+    void Append(const Buffer& buff) { Append(buff.Peek(), buff.ReadableBytes()); }
+
+    // 读取完的块立即归还，指向之后各块的 iovec 仍然有效
+    void Retrieve(size_t len);
+    void RetrieveAll();
+    std::string RetrieveAllToStr();
+
+    // 依次追加各块的可读部分，返回追加的个数 (iov 可以使用不同的分配器)
+    template<class Iovecs>
+    size_t AppendIov(Iovecs& iov) const {
+        size_t count = 0;
+        for(BufferBlock* b = head_; b; b = b->next) {
+            if(b->writePos == b->readPos) { continue; }
+            iov.push_back({ b->Data() + b->readPos, b->writePos - b->readPos });
+            count++;
+        }
+        return count;
+    }
+
+private:
+    BufferBlock* head_;
+    BufferBlock* tail_;
+    size_t size_;
+};
+
+#endif //CHAIN_BUFFER_H
@@ -0,0 +1,49 @@
+#include "membudget.h"
+
+using namespace std;
+
+MemBudget* MemBudget::Instance() {
+    static MemBudget inst;  // 静态单例
+    return &inst;
+}
+// 计数在不同线程中增减，读取时可能短暂为负
+size_t MemBudget::Used(KIND kind) const {
+    int64_t used = used_[kind].value.load(memory_order_relaxed);
+    return used > 0 ? static_cast<size_t>(used) : 0;
+}
+
+size_t MemBudget::Used() const {
+    size_t total = 0;
+    for(int i = 0; i < KIND_COUNT; i++) {
+        total += Used(static_cast<KIND>(i));
+    }
+    return total;
+}
+
+size_t MemBudget::Excess() const {
+    if(limit_ == 0) { return 0; }
+    size_t used = Used();
+    if(used <= limit_) { return 0; }
+    return used - limit_ / 100 * LOW_WATER_PERCENT;
+}
+
+void MemBudget::CountShed(size_t bytes, int conns) {
+    shedBytes_.fetch_add(bytes, memory_order_relaxed);
+    shedConns_.fetch_add(conns, memory_order_relaxed);
+}
+// 文本格式的统计信息，每行一个指标
+string MemBudget::StatsStr() {
+    string str;
+    str += "mem_buffer_bytes " + to_string(Used(BUFFER)) + "\n";
+    str += "mem_block_bytes " + to_string(Used(BLOCK)) + "\n";
+    str += "mem_filecache_bytes " + to_string(Used(FILE_CACHE)) + "\n";
+    str += "mem_microcache_bytes " + to_string(Used(MICRO_CACHE)) + "\n";
+    str += "mem_gzip_bytes " + to_string(Used(GZIP_CACHE)) + "\n";
+    str += "mem_h2body_bytes " + to_string(Used(H2_BODY)) + "\n";
+    str += "mem_used_bytes " + to_string(Used()) + "\n";
+    str += "mem_limit_bytes " + to_string(limit_) + "\n";
+    str += "mem_read_pauses " + to_string(pauses_.load()) + "\n";
+    str += "mem_shed_bytes " + to_string(shedBytes_.load()) + "\n";
+    str += "mem_shed_conns " + to_string(shedConns_.load()) + "\n";
+    return str;
+}
@@ -0,0 +1,60 @@
+#ifndef MEM_BUDGET_H
+#define MEM_BUDGET_H
+
+#include <string>
+#include <atomic>
+#include <stdint.h>
+
+// 缓冲区与各缓存占用内存的统计，以及全局的内存预算
+// 各模块在分配 / 释放时计数 (Buffer 的存储、ChainBuffer 与 Arena 的块、各缓存的内容)，线程池中缓存的空闲存储不计入
+// 超出预算时由 WebServer 淘汰缓存、关闭空闲连接；预算默认为 0，表示不限制
+class MemBudget {
+public:
+    enum KIND {
+        BUFFER,       // Buffer 的存储
+        BLOCK,        // ChainBuffer 与 Arena 正在使用的块
+        FILE_CACHE,   // FileCache 整文件映射
+        MICRO_CACHE,  // MicroCache 缓存的响应
+        GZIP_CACHE,   // Gzip 缓存的压缩结果
+        H2_BODY,      // HTTP/2 stream 正在接收的请求体
+        KIND_COUNT,
+    };
+
+    static MemBudget* Instance();
+
+    void Add(KIND kind, int64_t bytes) {
+        used_[kind].value.fetch_add(bytes, std::memory_order_relaxed);
+    }
+    size_t Used(KIND kind) const;
+    size_t Used() const;
+
+    // 在服务器启动前设置
+    void SetLimit(size_t bytes) { limit_ = bytes; }
+    size_t Limit() const { return limit_; }
+    // 超出预算时返回需要释放的字节数 (回到预算的 LOW_WATER_PERCENT)，否则返回 0
+    size_t Excess() const;
+
+    void CountPause() { pauses_.fetch_add(1, std::memory_order_relaxed); }
+    void CountShed(size_t bytes, int conns);
+
+    std::string StatsStr();
+
+    static const int LOW_WATER_PERCENT = 90;
+
+private:
+    // 各计数器独占缓存行，不同线程频繁更新时互不影响
+    struct alignas(64) Counter {
+        std::atomic<int64_t> value{0};
+    };
+
+    MemBudget() : limit_(0) {}
+
+    Counter used_[KIND_COUNT];
+    size_t limit_;
+
+    std::atomic<uint64_t> pauses_{0};     // 因积压暂停读取的次数
+    std::atomic<uint64_t> shedBytes_{0};  // 超出预算时淘汰的缓存
+    std::atomic<uint64_t> shedConns_{0};  // 超出预算时关闭的空闲连接
+};
+
+#endif //MEM_BUDGET_H
@@ -0,0 +1,284 @@
+#include "bundle.h"
+#include "httpresponse.h"
+#include "../timer/cachedclock.h"
+
+#include <dirent.h>
+#include <algorithm>
+
+using namespace std;
+
+Bundle* Bundle::Instance() {
+    static Bundle inst;  // 静态单例
+    return &inst;
+}
+// FNV-1a，seed 参与初始值，用于完美哈希的二级散列
+uint64_t Bundle::Hash(const char* key, size_t len, uint32_t seed) {
+    uint64_t h = 14695981039346656037ULL ^ (seed * 0x9E3779B97F4A7C15ULL);
+    for(size_t i = 0; i < len; i++) {
+        h ^= static_cast<unsigned char>(key[i]);
+        h *= 1099511628211ULL;
+    }
+    return h ^ (h >> 29);
+}
+
+const BundleEntry* BundleArchive::Find(const char* path, size_t len) const {
+    const BundleHeader* hdr = reinterpret_cast<const BundleHeader*>(data_);
+    if(hdr->count == 0) { return nullptr; }
+    const uint32_t* seeds = reinterpret_cast<const uint32_t*>(data_ + hdr->seedOff);
+    const uint32_t* slots = reinterpret_cast<const uint32_t*>(data_ + hdr->slotOff);
+    const BundleEntry* entries = reinterpret_cast<const BundleEntry*>(data_ + hdr->entryOff);
+
+    uint32_t bucket = Bundle::Hash(path, len, 0) % hdr->buckets;
+    uint32_t slot = Bundle::Hash(path, len, seeds[bucket]) % hdr->slotCount;
+    uint32_t idx = slots[slot];
+    if(idx >= hdr->count) { return nullptr; }
+    // 完美哈希只保证集合内的 key 不冲突，集合外的 key 需要比较路径
+    const BundleEntry* e = &entries[idx];
+    if(e->pathLen != len || memcmp(data_ + e->pathOff, path, len) != 0) {
+        return nullptr;
+    }
+    return e;
+}
+// 映射并校验归档文件
+shared_ptr<const BundleArchive> Bundle::Map_(const string& path) {
+    int fd = open(path.data(), O_RDONLY);
+    if(fd < 0) { return nullptr; }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(BundleHeader)) {
+        close(fd);
+        return nullptr;
+    }
+    void* ret = mmap(0, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    if(ret == MAP_FAILED) { 
+        close(fd);
+        return nullptr; 
+    }
+    shared_ptr<const BundleArchive> archive = make_shared<BundleArchive>(
+            static_cast<char*>(ret), st.st_size, fd, st.st_ino);
+
+    if(!Validate_(static_cast<const char*>(ret), st.st_size)) {
+        LOG_ERROR("Bundle %s is invalid!", path.data());
+        return nullptr;
+    }
+    return archive;
+}
+
+static bool InRange(uint64_t off, uint64_t len, uint64_t size) {
+    return off <= size && len <= size - off;
+}
+// 索引与各条目的偏移、长度都须落在文件内，截断或损坏的归档文件整体拒绝，Find 时不再检查
+bool Bundle::Validate_(const char* data, uint64_t size) {
+    const BundleHeader* hdr = reinterpret_cast<const BundleHeader*>(data);
+    if(memcmp(hdr->magic, "SWSBNDL1", 8) != 0 || hdr->version != VERSION ||
+       hdr->fileSize != size || hdr->buckets == 0 || hdr->slotCount == 0) {
+        return false;
+    }
+    if(hdr->seedOff % sizeof(uint32_t) || hdr->slotOff % sizeof(uint32_t) || hdr->entryOff % sizeof(uint64_t) ||
+       !InRange(hdr->seedOff, sizeof(uint32_t) * static_cast<uint64_t>(hdr->buckets), size) ||
+       !InRange(hdr->slotOff, sizeof(uint32_t) * static_cast<uint64_t>(hdr->slotCount), size) ||
+       !InRange(hdr->entryOff, sizeof(BundleEntry) * static_cast<uint64_t>(hdr->count), size)) {
+        return false;
+    }
+    const BundleEntry* entries = reinterpret_cast<const BundleEntry*>(data + hdr->entryOff);
+    for(uint32_t i = 0; i < hdr->count; i++) {
+        const BundleEntry& e = entries[i];
+        if(!InRange(e.pathOff, e.pathLen, size) || !InRange(e.typeOff, e.typeLen, size) ||
+           !InRange(e.hdrOff, e.hdrLen, size) || !InRange(e.dataOff, e.dataLen, size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool Bundle::Open(const string& path) {
+    shared_ptr<const BundleArchive> archive = Map_(path);
+    if(!archive) {
+        LOG_WARN("Bundle %s open failed, fallback to srcDir", path.data());
+        return false;
+    }
+    {
+        lock_guard<mutex> locker(mtx_);
+        path_ = path;
+        archive_ = archive;
+    }
+    isOpen_ = true;
+    LOG_INFO("Bundle %s opened, %u files", path.data(), archive->Count());
+    return true;
+}
+// 每隔 RELOAD_CHECK_MS 检查一次归档文件的 inode，部署时 rename 新文件即可切换
+// 旧的映射由正在发送的响应继续持有，发送完后自动释放
+void Bundle::CheckReload_() {
+    int64_t now = CachedClock::NowMS();
+    int64_t last = lastCheck_;
+    if(now - last < RELOAD_CHECK_MS || !lastCheck_.compare_exchange_strong(last, now)) {
+        return;
+    }
+    string path;
+    ino_t ino;
+    {
+        lock_guard<mutex> locker(mtx_);
+        path = path_;
+        ino = archive_->Ino();
+    }
+    struct stat st;
+    if(stat(path.data(), &st) < 0 || st.st_ino == ino) { return; }
+    shared_ptr<const BundleArchive> archive = Map_(path);
+    if(archive) {
+        lock_guard<mutex> locker(mtx_);
+        archive_ = archive;
+        LOG_INFO("Bundle %s reloaded, %u files", path.data(), archive->Count());
+    }
+}
+
+const BundleEntry* Bundle::Find(const char* path, size_t len, shared_ptr<const BundleArchive>* archive) {
+    if(!isOpen_) { return nullptr; }
+    CheckReload_();
+    {
+        lock_guard<mutex> locker(mtx_);
+        *archive = archive_;
+    }
+    const BundleEntry* e = (*archive)->Find(path, len);
+    if(!e) { archive->reset(); }
+    return e;
+}
+
+// 递归收集目录下的普通文件，name 为相对 root 的请求路径
+static void CollectFiles(const string& root, const string& name, vector<string>* files) {
+    DIR* dir = opendir((root + name).data());
+    if(!dir) { return; }
+    struct dirent* ent;
+    while((ent = readdir(dir)) != nullptr) {
+        string child = ent->d_name;
+        if(child == "." || child == "..") { continue; }
+        struct stat st;
+        string path = name + "/" + child;
+        if(stat((root + path).data(), &st) < 0) { continue; }
+        if(S_ISDIR(st.st_mode)) {
+            CollectFiles(root, path, files);
+        } else if(S_ISREG(st.st_mode)) {
+            files->push_back(path);
+        }
+    }
+    closedir(dir);
+}
+
+bool Bundle::Pack(const string& srcDir, const string& out) {
+    string root = srcDir;
+    while(!root.empty() && root.back() == '/') { root.pop_back(); }
+    vector<string> files;
+    CollectFiles(root, "", &files);
+    sort(files.begin(), files.end());
+    const uint32_t count = files.size();
+
+    // 1. 构造完美哈希：按 bucket 分组，从大到小为每个 bucket 寻找一个无冲突的 seed
+    BundleHeader hdr = {};
+    memcpy(hdr.magic, "SWSBNDL1", 8);
+    hdr.version = VERSION;
+    hdr.count = count;
+    hdr.buckets = max<uint32_t>(1, count / 4 + 1);
+    hdr.slotCount = max<uint32_t>(1, count + count / 4 + 1);
+    vector<vector<uint32_t>> buckets(hdr.buckets);
+    for(uint32_t i = 0; i < count; i++) {
+        buckets[Hash(files[i].data(), files[i].size(), 0) % hdr.buckets].push_back(i);
+    }
+    vector<uint32_t> order(hdr.buckets);
+    for(uint32_t i = 0; i < hdr.buckets; i++) { order[i] = i; }
+    sort(order.begin(), order.end(), [&buckets](uint32_t a, uint32_t b) {
+        return buckets[a].size() > buckets[b].size();
+    });
+    vector<uint32_t> seeds(hdr.buckets, 0);
+    vector<uint32_t> slots(hdr.slotCount, UINT32_MAX);
+    for(uint32_t b : order) {
+        if(buckets[b].empty()) { continue; }
+        for(uint32_t seed = 1; ; seed++) {
+            vector<uint32_t> used;
+            bool ok = true;
+            for(uint32_t idx : buckets[b]) {
+                uint32_t s = Hash(files[idx].data(), files[idx].size(), seed) % hdr.slotCount;
+                if(slots[s] != UINT32_MAX || find(used.begin(), used.end(), s) != used.end()) {
+                    ok = false;
+                    break;
+                }
+                used.push_back(s);
+            }
+            if(!ok) { continue; }
+            for(size_t k = 0; k < used.size(); k++) { slots[used[k]] = buckets[b][k]; }
+            seeds[b] = seed;
+            break;
+        }
+    }
+
+    // 2. 计算布局：头部、索引、条目、字符串区，最后是对齐的文件内容
+    hdr.seedOff = sizeof(BundleHeader);
+    hdr.slotOff = hdr.seedOff + sizeof(uint32_t) * hdr.buckets;
+    hdr.entryOff = (hdr.slotOff + sizeof(uint32_t) * hdr.slotCount + 7) & ~7ULL;
+    uint64_t strOff = hdr.entryOff + sizeof(BundleEntry) * count;
+
+    vector<BundleEntry> entries(count);
+    string strs;
+    for(uint32_t i = 0; i < count; i++) {
+        struct stat st;
+        if(stat((root + files[i]).data(), &st) < 0) {
+            LOG_ERROR("Bundle pack stat %s error!", files[i].data());
+            return false;
+        }
+        BundleEntry& e = entries[i];
+        string type = HttpResponse::FileType(files[i]);
+        string header = "Accept-Ranges: bytes\r\n";
+        header += "ETag: " + HttpResponse::ETag(st.st_mtime, st.st_size) + "\r\n";
+        header += "Last-Modified: " + HttpResponse::HttpDate(st.st_mtime) + "\r\n";
+        e.pathOff = strOff + strs.size();
+        e.pathLen = files[i].size();
+        strs += files[i];
+        e.typeOff = strOff + strs.size();
+        e.typeLen = type.size();
+        strs += type;
+        e.hdrOff = strOff + strs.size();
+        e.hdrLen = header.size();
+        strs += header;
+        e.dataLen = st.st_size;
+        e.mtime = st.st_mtime;
+    }
+    uint64_t off = strOff + strs.size();
+    for(uint32_t i = 0; i < count; i++) {
+        off = (off + BLOB_ALIGN - 1) & ~(uint64_t)(BLOB_ALIGN - 1);
+        entries[i].dataOff = off;
+        off += entries[i].dataLen;
+    }
+    hdr.fileSize = off;
+
+    // 3. 写入临时文件后 rename
+    string tmp = out + ".tmp";
+    FILE* fp = fopen(tmp.data(), "wb");
+    if(!fp) {
+        LOG_ERROR("Bundle pack open %s error!", tmp.data());
+        return false;
+    }
+    bool ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1;
+    ok = ok && fwrite(seeds.data(), sizeof(uint32_t), seeds.size(), fp) == seeds.size();
+    ok = ok && fwrite(slots.data(), sizeof(uint32_t), slots.size(), fp) == slots.size();
+    ok = ok && fseek(fp, hdr.entryOff, SEEK_SET) == 0;
+    ok = ok && fwrite(entries.data(), sizeof(BundleEntry), count, fp) == count;
+    ok = ok && fwrite(strs.data(), 1, strs.size(), fp) == strs.size();
+    vector<char> data;
+    for(uint32_t i = 0; ok && i < count; i++) {
+        FILE* src = fopen((root + files[i]).data(), "rb");
+        if(!src) { ok = false; break; }
+        data.resize(entries[i].dataLen);
+        ok = fread(data.data(), 1, data.size(), src) == data.size();
+        fclose(src);
+        ok = ok && fseek(fp, entries[i].dataOff, SEEK_SET) == 0;
+        ok = ok && fwrite(data.data(), 1, data.size(), fp) == data.size();
+    }
+    ok = (fflush(fp) == 0) && ok;
+    ok = (ftruncate(fileno(fp), hdr.fileSize) == 0) && ok;  // 最后一个文件为空时补齐长度
+    ok = (fsync(fileno(fp)) == 0) && ok;
+    fclose(fp);
+    if(!ok || rename(tmp.data(), out.data()) < 0) {
+        LOG_ERROR("Bundle pack write %s error!", out.data());
+        unlink(tmp.data());
+        return false;
+    }
+    LOG_INFO("Bundle packed %u files into %s (%lu bytes)", count, out.data(), (unsigned long)hdr.fileSize);
+    return true;
+}
@@ -0,0 +1,104 @@
+#ifndef BUNDLE_H
+#define BUNDLE_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../log/log.h"
+
+// 静态资源归档文件格式 (所有偏移都相对于文件起始位置)
+// [BundleHeader][seeds: uint32 * buckets][slots: uint32 * slotCount][BundleEntry * count][字符串区][对齐的文件内容]
+// 路径索引为完美哈希 (hash and displace)：
+//   bucket = Hash(path, 0) % buckets，slot = Hash(path, seeds[bucket]) % slotCount，entry = slots[slot]
+struct BundleHeader {
+    char magic[8];       // "SWSBNDL1"
+    uint32_t version;
+    uint32_t count;      // 文件数
+    uint32_t buckets;
+    uint32_t slotCount;
+    uint64_t seedOff;
+    uint64_t slotOff;
+    uint64_t entryOff;
+    uint64_t fileSize;
+};
+
+struct BundleEntry {
+    uint64_t pathOff;    // 请求路径，例如 /index.html
+    uint64_t typeOff;    // Content-type
+    uint64_t hdrOff;     // 预先生成的响应头：Accept-Ranges / ETag / Last-Modified
+    uint64_t dataOff;    // 文件内容，按 BLOB_ALIGN 对齐
+    uint64_t dataLen;
+    int64_t mtime;
+    uint32_t pathLen;
+    uint32_t typeLen;
+    uint32_t hdrLen;
+    uint32_t reserved;
+};
+
+// 一个已映射的归档文件，响应发送完之前通过 shared_ptr 保持映射有效
+class BundleArchive {
+public:
+    BundleArchive(char* data, size_t len, int fd, ino_t ino) : data_(data), len_(len), fd_(fd), ino_(ino) {}
+    ~BundleArchive() { 
+        munmap(data_, len_);
+        close(fd_);
+    }
+
+    const BundleEntry* Find(const char* path, size_t len) const;
+    const char* Data(const BundleEntry* e) const { return data_ + e->dataOff; }
+    const char* Type(const BundleEntry* e) const { return data_ + e->typeOff; }      // 长度为 typeLen
+    const char* Header(const BundleEntry* e) const { return data_ + e->hdrOff; }     // 长度为 hdrLen
+    uint32_t Count() const { return reinterpret_cast<const BundleHeader*>(data_)->count; }
+    int Fd() const { return fd_; }  // 保持打开，用于 sendfile
+    ino_t Ino() const { return ino_; }
+
+private:
+    char* data_;
+    size_t len_;
+    int fd_;
+    ino_t ino_;
+};
+
+class Bundle {
+public:
+    static Bundle* Instance();
+
+    // 映射归档文件，之后归档文件被替换 (rename) 时自动切换到新文件
+    bool Open(const std::string& path);
+    bool IsOpen() const { return isOpen_; }
+
+    // 查找 path 对应的文件，未找到时返回 nullptr；archive 返回对应的归档映射
+    const BundleEntry* Find(const char* path, size_t len, std::shared_ptr<const BundleArchive>* archive);
+
+    // 将 srcDir 目录 (递归) 打包为归档文件 out，先写临时文件再 rename，保证替换是原子的
+    static bool Pack(const std::string& srcDir, const std::string& out);
+
+    static uint64_t Hash(const char* key, size_t len, uint32_t seed);
+
+    static const uint32_t VERSION = 1;
+    static const size_t BLOB_ALIGN = 64;         // 文件内容按 cache line 对齐
+    static const int64_t RELOAD_CHECK_MS = 1000; // 检查归档文件是否被替换的间隔
+
+private:
+    Bundle() : isOpen_(false), lastCheck_(0) {}
+
+    static std::shared_ptr<const BundleArchive> Map_(const std::string& path);
+    static bool Validate_(const char* data, uint64_t size);
+    void CheckReload_();
+
+    std::string path_;
+    std::atomic<bool> isOpen_;
+    std::atomic<int64_t> lastCheck_;
+    std::mutex mtx_;
+    std::shared_ptr<const BundleArchive> archive_;
+};
+
+#endif //BUNDLE_H
@@ -0,0 +1,689 @@
+#include "fastcgi.h"
+
+using namespace std;
+
+// FastCGI 记录类型与常量 (FastCGI Specification 1.0)
+enum FCGI_TYPE {
+    FCGI_BEGIN_REQUEST = 1,
+    FCGI_ABORT_REQUEST = 2,
+    FCGI_END_REQUEST = 3,
+    FCGI_PARAMS = 4,
+    FCGI_STDIN = 5,
+    FCGI_STDOUT = 6,
+    FCGI_STDERR = 7,
+    FCGI_DATA = 8,
+    FCGI_GET_VALUES = 9,
+    FCGI_GET_VALUES_RESULT = 10,
+    FCGI_UNKNOWN_TYPE = 11,
+};
+static const int FCGI_VERSION_1 = 1;
+static const int FCGI_HEADER_LEN = 8;
+static const size_t FCGI_MAX_CONTENT = 65535;
+static const int FCGI_RESPONDER = 1;
+static const int FCGI_KEEP_CONN = 1;
+static const int FCGI_REQUEST_COMPLETE = 0;
+static const int FCGI_CANT_MPX_CONN = 1;
+
+// 名值对：长度小于 128 用 1 字节，否则用 4 字节 (最高位置 1)
+static void AppendLength(string& out, size_t len) {
+    if(len < 128) {
+        out += static_cast<char>(len);
+    } else {
+        out += static_cast<char>(((len >> 24) & 0x7f) | 0x80);
+        out += static_cast<char>((len >> 16) & 0xff);
+        out += static_cast<char>((len >> 8) & 0xff);
+        out += static_cast<char>(len & 0xff);
+    }
+}
+
+static void AppendParam(string& out, const string& name, const string& value) {
+    AppendLength(out, name.size());
+    AppendLength(out, value.size());
+    out += name;
+    out += value;
+}
+
+static bool ReadLength(const unsigned char*& p, const unsigned char* end, size_t* len) {
+    if(p >= end) { return false; }
+    if(*p < 128) {
+        *len = *p++;
+        return true;
+    }
+    if(end - p < 4) { return false; }
+    *len = ((p[0] & 0x7f) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    p += 4;
+    return true;
+}
+
+FcgiRequest::FcgiRequest(FcgiBackend* backend, const HttpRequest& request, const string& clientIp)
+    : backend_(backend), id_(0), clientIdle_(true), headDone_(false), done_(false), failed_(false),
+      aborted_(false), clientKeepAlive_(request.IsKeepAlive()), http11_(request.version() == "1.1"),
+      headRequest_(request.method() == "HEAD"), noBody_(false), chunked_(false), hasLength_(false),
+      remaining_(0), relayed_(0) {
+    const string& uri = request.path();
+    size_t query = uri.find('?');
+    string script = uri.substr(0, query);
+    body_ = request.body();
+
+    AppendParam(params_, "GATEWAY_INTERFACE", "CGI/1.1");
+    AppendParam(params_, "SERVER_SOFTWARE", "WebServer");
+    AppendParam(params_, "SERVER_PROTOCOL", "HTTP/" + request.version());
+    AppendParam(params_, "REQUEST_METHOD", request.method());
+    AppendParam(params_, "REQUEST_URI", uri);
+    AppendParam(params_, "SCRIPT_NAME", script);
+    AppendParam(params_, "SCRIPT_FILENAME", backend->Root() + script);
+    AppendParam(params_, "DOCUMENT_ROOT", backend->Root());
+    AppendParam(params_, "QUERY_STRING", query == string::npos ? "" : uri.substr(query + 1));
+    AppendParam(params_, "REMOTE_ADDR", clientIp);
+    AppendParam(params_, "CONTENT_LENGTH", body_.empty() ? "" : to_string(body_.size()));
+    AppendParam(params_, "CONTENT_TYPE", request.GetHeader("Content-Type"));
+    // 其余请求头转换为 HTTP_*，Proxy 头不转发 (httpoxy)
+    for(const auto& h : request.headers()) {
+        if(h.name.EqualsIgnoreCase("Content-Type") || h.name.EqualsIgnoreCase("Content-Length") ||
+           h.name.EqualsIgnoreCase("Proxy")) {
+            continue;
+        }
+        string name = "HTTP_" + h.name.Str();
+        for(char& c : name) {
+            c = (c == '-') ? '_' : toupper(c);
+        }
+        AppendParam(params_, name, h.value.Str());
+    }
+}
+
+bool FcgiRequest::Start(function<void()> waker) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        waker_ = waker;
+    }
+    if(backend_->Submit(shared_from_this())) {
+        return true;
+    }
+    lock_guard<mutex> locker(mtx_);
+    failed_ = true;
+    done_ = true;
+    clientIdle_ = false;
+    return false;
+}
+
+Gateway::DRAIN_STATE FcgiRequest::Drain(ChainBuffer& buff, int* resumeFd) {
+    *resumeFd = -1;  // 后端连接由 FcgiConn 自己重新注册
+    bool resume = false;
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(failed_ && relayed_ == 0) {
+            out_.RetrieveAll();
+            return DRAIN_BAD_GATEWAY;
+        }
+        if(out_.ReadableBytes() == 0) {
+            if(done_) {
+                return failed_ ? DRAIN_FAILED : DRAIN_DONE;
+            }
+            clientIdle_ = true;
+            return DRAIN_WAIT;
+        }
+        resume = out_.ReadableBytes() >= FcgiConn::HIGH_WATER;
+        relayed_ += out_.ReadableBytes();
+        buff.Append(out_);
+        out_.RetrieveAll();
+    }
+    // 连接可能因为本请求积压过多而暂停了读取
+    if(resume && conn_ && conn_->Resume()) {
+        backend_->Dispatch();
+    }
+    return DRAIN_DATA;
+}
+
+bool FcgiRequest::KeepAlive() {
+    lock_guard<mutex> locker(mtx_);
+    return clientKeepAlive_ && !failed_;
+}
+
+void FcgiRequest::Abort() {
+    shared_ptr<FcgiConn> conn;
+    uint16_t id;
+    {
+        lock_guard<mutex> locker(mtx_);
+        aborted_ = true;
+        waker_ = nullptr;
+        clientIdle_ = false;
+        out_.RetrieveAll();
+        conn = conn_;
+        id = id_;
+    }
+    // 仍在排队的请求由 FcgiBackend::Dispatch 丢弃
+    if(conn) {
+        conn->AbortRequest(id, this);
+    }
+}
+
+size_t FcgiRequest::OnStdout_(const char* data, size_t len) {
+    lock_guard<mutex> locker(mtx_);
+    if(aborted_ || done_) { return 0; }
+    if(headDone_) {
+        AppendBody_(data, len);
+    } else {
+        head_.Append(data, len);
+        ParseHead_();
+    }
+    Wake_();
+    return out_.ReadableBytes();
+}
+
+void FcgiRequest::OnEnd_(bool ok) {
+    lock_guard<mutex> locker(mtx_);
+    if(done_) { return; }
+    done_ = true;
+    if(aborted_) { return; }
+    if(!ok || !headDone_ || (hasLength_ && remaining_ > 0 && !noBody_)) {
+        LOG_WARN("FastCGI %s request %d incomplete", backend_->Name().c_str(), id_);
+        failed_ = true;
+    } else if(chunked_) {
+        out_.Append("0\r\n\r\n");
+    }
+    Wake_();
+}
+
+size_t FcgiRequest::Backlog_() {
+    lock_guard<mutex> locker(mtx_);
+    return out_.ReadableBytes();
+}
+
+bool FcgiRequest::IsAborted_() {
+    lock_guard<mutex> locker(mtx_);
+    return aborted_;
+}
+// CGI 响应头 (行尾可能只有 \n) 转换为 HTTP 响应头
+// Status 头决定状态码，只有 Location 时为 302，其余默认 200
+bool FcgiRequest::ParseHead_() {
+    const char* begin = head_.Peek();
+    const char* end = head_.BeginWriteConst();
+    const char* headEnd = nullptr;
+    const char* bodyStart = nullptr;
+    for(const char* p = begin; p < end; p++) {
+        if(*p != '\n') { continue; }
+        if(p + 1 < end && p[1] == '\n') {
+            headEnd = p + 1;
+            bodyStart = p + 2;
+            break;
+        }
+        if(p + 2 < end && p[1] == '\r' && p[2] == '\n') {
+            headEnd = p + 1;
+            bodyStart = p + 3;
+            break;
+        }
+    }
+    if(!bodyStart) {
+        if(head_.ReadableBytes() > MAX_HEAD) {
+            LOG_WARN("FastCGI %s response head too large", backend_->Name().c_str());
+            failed_ = true;
+            done_ = true;
+        }
+        return false;
+    }
+    string status, fields;
+    bool location = false;
+    const char* line = begin;
+    while(line < headEnd) {
+        const char* eol = static_cast<const char*>(memchr(line, '\n', headEnd - line));
+        string text(line, (eol > line && eol[-1] == '\r') ? eol - 1 : eol);
+        line = eol + 1;
+        size_t colon = text.find(':');
+        if(colon == string::npos) { continue; }
+        string name = text.substr(0, colon);
+        size_t vb = text.find_first_not_of(' ', colon + 1);
+        string value = (vb == string::npos) ? "" : text.substr(vb);
+        if(strcasecmp(name.c_str(), "Status") == 0) {
+            status = value;
+            continue;
+        }
+        if(strcasecmp(name.c_str(), "Connection") == 0 || strcasecmp(name.c_str(), "Keep-Alive") == 0 ||
+           strcasecmp(name.c_str(), "Transfer-Encoding") == 0) {
+            continue;
+        }
+        if(strcasecmp(name.c_str(), "Location") == 0) {
+            location = true;
+        }
+        if(strcasecmp(name.c_str(), "Content-Length") == 0) {
+            hasLength_ = true;
+            remaining_ = strtoull(value.c_str(), nullptr, 10);
+        }
+        fields += name + ": " + value + "\r\n";
+    }
+    if(status.empty()) {
+        status = location ? "302 Found" : "200 OK";
+    }
+    int code = atoi(status.c_str());
+    noBody_ = headRequest_ || code == 204 || code == 304;
+    if(!noBody_ && !hasLength_) {
+        if(http11_) {
+            chunked_ = true;
+            fields += "Transfer-Encoding: chunked\r\n";
+        } else {
+            clientKeepAlive_ = false;  // HTTP/1.0 没有长度信息，以关闭连接结束
+        }
+    }
+    out_.Append("HTTP/1.1 " + status + "\r\n" + fields);
+    out_.Append(clientKeepAlive_ ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n");
+    headDone_ = true;
+    string rest(bodyStart, end);
+    head_.RetrieveAll();
+    AppendBody_(rest.data(), rest.size());
+    return true;
+}
+
+void FcgiRequest::AppendBody_(const char* data, size_t len) {
+    if(noBody_ || len == 0) { return; }
+    if(hasLength_) {
+        len = min(len, remaining_);  // 超出 Content-Length 的部分丢弃
+        remaining_ -= len;
+        out_.Append(data, len);
+        return;
+    }
+    if(chunked_) {
+        char size[24];
+        snprintf(size, sizeof(size), "%zx\r\n", len);
+        out_.Append(size, strlen(size));
+        out_.Append(data, len);
+        out_.Append("\r\n", 2);
+        return;
+    }
+    out_.Append(data, len);
+}
+
+void FcgiRequest::Wake_() {
+    if(clientIdle_ && waker_ && (out_.ReadableBytes() > 0 || done_)) {
+        clientIdle_ = false;
+        waker_();
+    }
+}
+
+FcgiConn::FcgiConn(FcgiBackend* backend, int fd)
+    : backend_(backend), fd_(fd), connecting_(true), closed_(false), paused_(false),
+      maxReqs_(1), nextId_(1) {
+    // 询问后端是否支持在一个连接上并发多个请求
+    string values;
+    AppendParam(values, "FCGI_MPXS_CONNS", "");
+    AppendParam(values, "FCGI_MAX_REQS", "");
+    Record_(FCGI_GET_VALUES, 0, values.data(), values.size());
+}
+
+FcgiConn::~FcgiConn() {
+    if(fd_ >= 0) { close(fd_); }
+}
+
+void FcgiConn::OnEvent() {
+    bool ended = false;
+    bool closed = false;
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(closed_) { return; }
+        if(connecting_) {
+            // 非阻塞 connect 完成后 socket 可写，通过 SO_ERROR 判断是否成功
+            int err = 0;
+            socklen_t len = sizeof(err);
+            getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+            if(err != 0) {
+                Close_("connect error");
+            } else {
+                connecting_ = false;
+            }
+        }
+        if(!closed_ && !Flush_()) {
+            Close_("send error");
+        }
+        // 读到 EAGAIN 为止，某个请求积压过多时暂停
+        while(!closed_ && !paused_ && !connecting_) {
+            int err = 0;
+            ssize_t len = in_.ReadFd(fd_, &err);
+            if(len > 0) {
+                if(!Parse_(&ended)) { Close_("invalid record"); }
+                continue;
+            }
+            if(len == 0) {
+                Close_(requests_.empty() ? nullptr : "backend closed");
+            } else if(err != EAGAIN && err != EWOULDBLOCK) {
+                Close_("read error");
+            }
+            break;
+        }
+        if(!closed_) {
+            Rearm_(EPOLL_CTL_MOD);
+        }
+        closed = closed_;
+    }
+    if(closed) {
+        backend_->Remove(this);
+    }
+    if(ended || closed) {
+        backend_->Dispatch();
+    }
+}
+
+bool FcgiConn::Submit(const shared_ptr<FcgiRequest>& request) {
+    lock_guard<mutex> locker(mtx_);
+    if(closed_ || paused_ || static_cast<int>(requests_.size()) >= maxReqs_) {
+        return false;
+    }
+    uint16_t id;
+    do {
+        id = nextId_++;
+        if(nextId_ == 0) { nextId_ = 1; }
+    } while(requests_.count(id));
+    requests_[id] = request;
+    {
+        lock_guard<mutex> reqLocker(request->mtx_);
+        request->conn_ = shared_from_this();
+        request->id_ = id;
+    }
+    const char begin[8] = { 0, FCGI_RESPONDER, FCGI_KEEP_CONN, 0, 0, 0, 0, 0 };
+    Record_(FCGI_BEGIN_REQUEST, id, begin, sizeof(begin));
+    // PARAMS、STDIN 各以一个空记录结束
+    const string& params = request->params_;
+    for(size_t pos = 0; pos < params.size(); pos += FCGI_MAX_CONTENT) {
+        Record_(FCGI_PARAMS, id, params.data() + pos, min(FCGI_MAX_CONTENT, params.size() - pos));
+    }
+    Record_(FCGI_PARAMS, id, nullptr, 0);
+    const string& body = request->body_;
+    for(size_t pos = 0; pos < body.size(); pos += FCGI_MAX_CONTENT) {
+        Record_(FCGI_STDIN, id, body.data() + pos, min(FCGI_MAX_CONTENT, body.size() - pos));
+    }
+    Record_(FCGI_STDIN, id, nullptr, 0);
+    // 已建立的连接直接发送，发不完 (或出错) 时注册 EPOLLOUT 交给 OnEvent
+    if(!connecting_) {
+        Flush_();
+        if(out_.ReadableBytes() > 0) { Rearm_(EPOLL_CTL_MOD); }
+    }
+    return true;
+}
+
+void FcgiConn::Arm() {
+    lock_guard<mutex> locker(mtx_);
+    Rearm_(EPOLL_CTL_ADD);
+}
+
+bool FcgiConn::Resume() {
+    bool ended = false;
+    bool closed = false;
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(closed_ || !paused_) { return false; }
+        for(const auto& it : requests_) {
+            if(it.second->Backlog_() >= HIGH_WATER) { return false; }
+        }
+        paused_ = false;
+        // 暂停时 in_ 中可能还有未处理的记录
+        if(!Parse_(&ended)) { Close_("invalid record"); }
+        if(!closed_) {
+            Rearm_(EPOLL_CTL_MOD);
+        }
+        closed = closed_;
+    }
+    if(closed) {
+        backend_->Remove(this);
+    }
+    return ended || closed;
+}
+
+void FcgiConn::AbortRequest(uint16_t id, const FcgiRequest* request) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto it = requests_.find(id);
+        if(closed_ || it == requests_.end() || it->second.get() != request) { return; }
+        // 请求在收到 FCGI_END_REQUEST 之前仍占用 id，之后的数据直接丢弃
+        Record_(FCGI_ABORT_REQUEST, id, nullptr, 0);
+        if(!connecting_) {
+            Flush_();
+            if(out_.ReadableBytes() > 0) { Rearm_(EPOLL_CTL_MOD); }
+        }
+    }
+    if(Resume()) {
+        backend_->Dispatch();
+    }
+}
+
+bool FcgiConn::Flush_() {
+    while(out_.ReadableBytes() > 0) {
+        ssize_t len = send(fd_, out_.Peek(), out_.ReadableBytes(), MSG_NOSIGNAL);
+        if(len < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        out_.Retrieve(len);
+    }
+    return true;
+}
+// 处理 in_ 中所有完整的记录，返回 false 表示协议错误
+// *ended 为 true 时有请求结束或连接容量增加，可以发出排队的请求
+bool FcgiConn::Parse_(bool* ended) {
+    while(!paused_ && in_.ReadableBytes() >= FCGI_HEADER_LEN) {
+        const unsigned char* h = reinterpret_cast<const unsigned char*>(in_.Peek());
+        if(h[0] != FCGI_VERSION_1) { return false; }
+        int type = h[1];
+        uint16_t id = (h[2] << 8) | h[3];
+        size_t contentLen = (h[4] << 8) | h[5];
+        size_t total = FCGI_HEADER_LEN + contentLen + h[6];
+        if(in_.ReadableBytes() < total) { break; }
+        const char* content = in_.Peek() + FCGI_HEADER_LEN;
+
+        auto it = requests_.find(id);
+        if(type == FCGI_STDOUT && it != requests_.end()) {
+            if(it->second->OnStdout_(content, contentLen) >= HIGH_WATER) {
+                paused_ = true;  // 等客户端取走数据后由 Resume 恢复
+            }
+        } else if(type == FCGI_STDERR && contentLen > 0) {
+            LOG_WARN("FastCGI %s stderr: %.*s", backend_->Name().c_str(), static_cast<int>(contentLen), content);
+        } else if(type == FCGI_END_REQUEST && it != requests_.end()) {
+            int protocolStatus = contentLen >= 5 ? static_cast<unsigned char>(content[4]) : -1;
+            if(protocolStatus == FCGI_CANT_MPX_CONN) { maxReqs_ = 1; }
+            it->second->OnEnd_(protocolStatus == FCGI_REQUEST_COMPLETE);
+            requests_.erase(it);
+            *ended = true;
+        } else if(type == FCGI_GET_VALUES_RESULT) {
+            OnValues_(content, contentLen);
+            *ended = true;
+        }
+        // FCGI_UNKNOWN_TYPE：后端不认识 FCGI_GET_VALUES，按不支持多路复用处理
+        in_.Retrieve(total);
+    }
+    return true;
+}
+
+void FcgiConn::Record_(int type, uint16_t id, const char* content, size_t len) {
+    static const char PADDING[8] = { 0 };
+    size_t padding = (8 - len % 8) % 8;
+    const char header[FCGI_HEADER_LEN] = {
+        FCGI_VERSION_1, static_cast<char>(type),
+        static_cast<char>(id >> 8), static_cast<char>(id & 0xff),
+        static_cast<char>(len >> 8), static_cast<char>(len & 0xff),
+        static_cast<char>(padding), 0
+    };
+    out_.Append(header, FCGI_HEADER_LEN);
+    if(len > 0) { out_.Append(content, len); }
+    if(padding > 0) { out_.Append(PADDING, padding); }
+}
+
+void FcgiConn::OnValues_(const char* content, size_t len) {
+    const unsigned char* p = reinterpret_cast<const unsigned char*>(content);
+    const unsigned char* end = p + len;
+    bool mpxs = false;
+    int maxReqs = MAX_MPX_REQS;
+    while(p < end) {
+        size_t nameLen, valueLen;
+        if(!ReadLength(p, end, &nameLen) || !ReadLength(p, end, &valueLen) ||
+           static_cast<size_t>(end - p) < nameLen + valueLen) {
+            break;
+        }
+        string name(reinterpret_cast<const char*>(p), nameLen);
+        string value(reinterpret_cast<const char*>(p) + nameLen, valueLen);
+        p += nameLen + valueLen;
+        if(name == "FCGI_MPXS_CONNS") {
+            mpxs = (value == "1");
+        } else if(name == "FCGI_MAX_REQS" && atoi(value.c_str()) > 0) {
+            maxReqs = min(maxReqs, atoi(value.c_str()));
+        }
+    }
+    if(mpxs) {
+        maxReqs_ = maxReqs;
+        LOG_INFO("FastCGI %s fd:%d multiplexing up to %d requests", backend_->Name().c_str(), fd_, maxReqs_);
+    }
+}
+// 连接出错或被后端关闭：结束其上所有请求 (尚未转发数据的返回 502)
+void FcgiConn::Close_(const char* reason) {
+    if(closed_) { return; }
+    closed_ = true;
+    if(reason) {
+        LOG_WARN("FastCGI %s fd:%d error: %s", backend_->Name().c_str(), fd_, reason);
+    }
+    for(auto& it : requests_) {
+        it.second->OnEnd_(false);
+    }
+    requests_.clear();
+    // 先从索引中移除，fd 关闭后可能马上被新的客户端连接复用
+    FastCgi::Instance()->Unregister(fd_);
+    FastCgi::Instance()->Poll(EPOLL_CTL_DEL, fd_, 0);
+    close(fd_);
+    fd_ = -1;
+}
+
+void FcgiConn::Rearm_(int op) {
+    uint32_t events = (paused_ || connecting_ ? 0 : EPOLLIN) |
+                      (connecting_ || out_.ReadableBytes() > 0 ? EPOLLOUT : 0);
+    if(events) {
+        FastCgi::Instance()->Poll(op, fd_, events);
+    }
+}
+
+FcgiBackend::FcgiBackend(const string& prefix, const string& root)
+    : prefix_(prefix), root_(root), addrLen_(0) {
+    while(root_.size() > 1 && root_.back() == '/') { root_.pop_back(); }
+    memset(&addr_, 0, sizeof(addr_));
+}
+
+bool FcgiBackend::SetAddress(const string& address) {
+    name_ = address;
+    if(address.compare(0, 5, "unix:") == 0) {
+        struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&addr_);
+        string path = address.substr(5);
+        if(path.empty() || path.size() >= sizeof(un->sun_path)) { return false; }
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, path.c_str(), path.size() + 1);
+        addrLen_ = sizeof(struct sockaddr_un);
+        return true;
+    }
+    size_t colon = address.rfind(':');
+    if(colon == string::npos) { return false; }
+    struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&addr_);
+    int port = atoi(address.c_str() + colon + 1);
+    if(port <= 0 || port > 65535 || inet_pton(AF_INET, address.substr(0, colon).c_str(), &in->sin_addr) != 1) {
+        return false;
+    }
+    in->sin_family = AF_INET;
+    in->sin_port = htons(port);
+    addrLen_ = sizeof(struct sockaddr_in);
+    return true;
+}
+
+bool FcgiBackend::Submit(const shared_ptr<FcgiRequest>& request) {
+    lock_guard<mutex> locker(mtx_);
+    if(pending_.empty()) {
+        int ret = Assign_(request);
+        if(ret != 0) { return ret > 0; }
+    }
+    if(pending_.size() >= MAX_PENDING) {
+        LOG_WARN("FastCGI %s too many pending requests", name_.c_str());
+        return false;
+    }
+    pending_.push_back(request);
+    return true;
+}
+
+void FcgiBackend::Dispatch() {
+    lock_guard<mutex> locker(mtx_);
+    while(!pending_.empty()) {
+        shared_ptr<FcgiRequest> request = pending_.front();
+        if(!request->IsAborted_()) {
+            int ret = Assign_(request);
+            if(ret == 0) { break; }
+            if(ret < 0) { request->OnEnd_(false); }
+        }
+        pending_.pop_front();
+    }
+}
+
+void FcgiBackend::Remove(FcgiConn* conn) {
+    lock_guard<mutex> locker(mtx_);
+    for(auto it = conns_.begin(); it != conns_.end(); ++it) {
+        if(it->get() == conn) {
+            conns_.erase(it);
+            return;
+        }
+    }
+}
+// 交给一个有容量的连接，返回 1；连接数已达上限返回 0；无法连接后端返回 -1
+int FcgiBackend::Assign_(const shared_ptr<FcgiRequest>& request) {
+    for(const auto& conn : conns_) {
+        if(conn->Submit(request)) { return 1; }
+    }
+    if(conns_.size() >= MAX_CONNS) { return 0; }
+    int fd = Connect_();
+    if(fd < 0) {
+        LOG_WARN("FastCGI %s connect error: %d", name_.c_str(), errno);
+        return -1;
+    }
+    shared_ptr<FcgiConn> conn = make_shared<FcgiConn>(this, fd);
+    conn->Submit(request);
+    FastCgi::Instance()->Register(fd, conn);
+    conn->Arm();
+    conns_.push_back(conn);
+    return 1;
+}
+
+int FcgiBackend::Connect_() {
+    int fd = socket(addr_.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) { return -1; }
+    if(addr_.ss_family == AF_INET) {
+        int nodelay = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    }
+    if(connect(fd, reinterpret_cast<const struct sockaddr*>(&addr_), addrLen_) < 0 && errno != EINPROGRESS) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+FastCgi* FastCgi::Instance() {
+    static FastCgi inst;  // 静态单例
+    return &inst;
+}
+
+bool FastCgi::AddRoute(const string& prefix, const string& address, const string& root) {
+    if(prefix.empty() || prefix[0] != '/') { return false; }
+    unique_ptr<FcgiBackend> backend(new FcgiBackend(prefix, root));
+    if(!backend->SetAddress(address)) {
+        LOG_ERROR("FastCGI %s: invalid address %s", prefix.c_str(), address.c_str());
+        return false;
+    }
+    if(!Router::Instance()->AddFastCgi(prefix, backend.get())) { return false; }
+    routes_.push_back(move(backend));
+    return true;
+}
+
+void FastCgi::Register(int fd, const shared_ptr<FcgiConn>& conn) {
+    lock_guard<mutex> locker(mtx_);
+    conns_[fd] = conn;
+}
+
+void FastCgi::Unregister(int fd) {
+    lock_guard<mutex> locker(mtx_);
+    conns_.erase(fd);
+}
+
+shared_ptr<FcgiConn> FastCgi::Find(int fd) {
+    if(routes_.empty()) { return nullptr; }
+    lock_guard<mutex> locker(mtx_);
+    auto it = conns_.find(fd);
+    return it == conns_.end() ? nullptr : it->second;
+}
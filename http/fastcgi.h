@@ -0,0 +1,193 @@
+#ifndef FASTCGI_H
+#define FASTCGI_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <algorithm>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <ctype.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "httprequest.h"
+#include "gateway.h"
+#include "router.h"
+
+class FcgiConn;
+class FcgiBackend;
+
+// 一个 FastCGI 请求：CGI 响应头转换为 HTTP 响应头，stdout 边收边转发给客户端
+// 没有 Content-Length 时 HTTP/1.1 使用 chunked，HTTP/1.0 以关闭连接结束
+class FcgiRequest : public Gateway, public std::enable_shared_from_this<FcgiRequest> {
+public:
+    FcgiRequest(FcgiBackend* backend, const HttpRequest& request, const std::string& clientIp);
+
+    // 交给后端连接发送，后端有新数据而客户端在等待时调用 waker (注册 EPOLLOUT)
+    // 返回 false 表示没有可用的后端，Drain 随后返回 DRAIN_BAD_GATEWAY
+    bool Start(std::function<void()> waker);
+    DRAIN_STATE Drain(ChainBuffer& buff, int* resumeFd) override;
+    bool KeepAlive() override;
+    void Abort();  // 客户端提前关闭
+
+    static const size_t MAX_HEAD = 64 << 10;  // CGI 响应头上限
+
+private:
+    friend class FcgiConn;
+    friend class FcgiBackend;
+
+    // 以下由 FcgiConn / FcgiBackend 调用
+    size_t OnStdout_(const char* data, size_t len);  // 返回待转发的字节数
+    void OnEnd_(bool ok);
+    size_t Backlog_();
+    bool IsAborted_();
+    bool ParseHead_();
+    void AppendBody_(const char* data, size_t len);
+    void Wake_();
+
+    FcgiBackend* backend_;
+    std::shared_ptr<FcgiConn> conn_;
+    uint16_t id_;
+    std::string params_;    // 编码后的 FCGI_PARAMS 名值对
+    std::string body_;      // FCGI_STDIN
+
+    std::mutex mtx_;
+    std::function<void()> waker_;
+    bool clientIdle_;
+    bool headDone_;
+    bool done_;
+    bool failed_;
+    bool aborted_;
+    bool clientKeepAlive_;
+    bool http11_;
+    bool headRequest_;
+    bool noBody_;
+    bool chunked_;
+    bool hasLength_;
+    size_t remaining_;
+    size_t relayed_;
+    Buffer head_;           // 尚未完整的 CGI 响应头
+    Buffer out_;            // 待转发给客户端的数据
+};
+
+// 与后端的一条持久连接 (FCGI_KEEP_CONN)
+// 后端在 FCGI_GET_VALUES 中声明 FCGI_MPXS_CONNS 时，同一连接上并发多个请求
+// 连接 fd 的事件在 worker 中处理，注册 epoll 的操作都在持有 mtx_ 时进行
+class FcgiConn : public std::enable_shared_from_this<FcgiConn> {
+public:
+    FcgiConn(FcgiBackend* backend, int fd);
+    ~FcgiConn();
+
+    int Fd() const { return fd_; }
+    void OnEvent();
+
+    // 以下由 FcgiBackend 持有其锁时调用
+    bool Submit(const std::shared_ptr<FcgiRequest>& request);
+    void Arm();               // 新连接首次注册到 epoll
+
+    // 客户端取走数据后恢复读取；返回 true 表示有请求结束，需要 FcgiBackend::Dispatch
+    bool Resume();
+    void AbortRequest(uint16_t id, const FcgiRequest* request);
+
+    static const size_t HIGH_WATER = 256 << 10;  // 单个请求待转发数据的积压上限
+    static const int MAX_MPX_REQS = 64;           // 多路复用时单个连接的并发请求上限
+
+private:
+    bool Flush_();
+    bool Parse_(bool* ended);
+    void Record_(int type, uint16_t id, const char* content, size_t len);
+    void OnValues_(const char* content, size_t len);
+    void Close_(const char* reason);
+    void Rearm_(int op);
+
+    FcgiBackend* backend_;
+    int fd_;
+
+    std::mutex mtx_;
+    bool connecting_;
+    bool closed_;
+    bool paused_;           // 某个请求积压过多，暂停读后端
+    int maxReqs_;           // 收到 FCGI_GET_VALUES_RESULT 之前为 1
+    uint16_t nextId_;
+    std::map<uint16_t, std::shared_ptr<FcgiRequest>> requests_;
+    Buffer in_;
+    Buffer out_;
+};
+
+// 一个 FastCGI 后端 (unix 或 TCP 地址) 及其连接池
+// 优先使用有空闲容量的连接，连接数达到上限后请求排队，有请求结束时再发出
+class FcgiBackend {
+public:
+    FcgiBackend(const std::string& prefix, const std::string& root);
+    // "unix:/run/php-fpm.sock" 或 "127.0.0.1:9000"
+    bool SetAddress(const std::string& address);
+
+    bool Submit(const std::shared_ptr<FcgiRequest>& request);
+    void Dispatch();  // 有请求结束或连接关闭后发出排队的请求
+    void Remove(FcgiConn* conn);
+
+    const std::string& Prefix() const { return prefix_; }
+    const std::string& Root() const { return root_; }
+    const std::string& Name() const { return name_; }
+
+    static const size_t MAX_CONNS = 64;       // 每个后端的连接上限
+    static const size_t MAX_PENDING = 1024;   // 排队请求上限
+
+private:
+    int Assign_(const std::shared_ptr<FcgiRequest>& request);
+    int Connect_();
+
+    std::string prefix_;
+    std::string root_;      // SCRIPT_FILENAME = root_ + 请求路径
+    std::string name_;
+    struct sockaddr_storage addr_;
+    socklen_t addrLen_;
+
+    std::mutex mtx_;
+    std::vector<std::shared_ptr<FcgiConn>> conns_;
+    std::deque<std::shared_ptr<FcgiRequest>> pending_;
+};
+
+// FastCGI 各路由的后端与后端连接的 fd 索引，路径匹配由 Router 完成
+// 路由在 Start 之前添加，之后只读；连接 fd 的 epoll 注册通过 WebServer 提供的 poller 完成
+class FastCgi {
+public:
+    typedef std::function<void(int op, int fd, uint32_t events)> Poller;  // op 为 EPOLL_CTL_*
+
+    static FastCgi* Instance();
+
+    bool AddRoute(const std::string& prefix, const std::string& address, const std::string& root);
+    bool Empty() const { return routes_.empty(); }
+
+    void SetPoller(Poller poller) { poller_ = poller; }
+    void Poll(int op, int fd, uint32_t events) { poller_(op, fd, events); }
+
+    void Register(int fd, const std::shared_ptr<FcgiConn>& conn);
+    void Unregister(int fd);
+    std::shared_ptr<FcgiConn> Find(int fd);
+
+private:
+    FastCgi() = default;
+
+    std::vector<std::unique_ptr<FcgiBackend>> routes_;
+    Poller poller_;
+    std::mutex mtx_;
+    std::unordered_map<int, std::shared_ptr<FcgiConn>> conns_;
+};
+
+#endif //FASTCGI_H
@@ -0,0 +1,173 @@
+#include "filecache.h"
+
+using namespace std;
+
+FileCache* FileCache::Instance() {
+    static FileCache inst;  // 静态单例
+    return &inst;
+}
+
+int64_t FileCache::NowMS_() {
+    return CachedClock::NowMS();
+}
+
+shared_ptr<const FileEntry> FileCache::Get(const string& path, int* err) {
+    assert(err);
+    *err = 0;
+    unique_lock<mutex> locker(mtx_);
+    shared_ptr<FileEntry> old;
+    auto it = entries_.find(path);
+    if(it != entries_.end()) {
+        old = it->second;
+        lru_.splice(lru_.begin(), lru_, old->lru);  // 移到 LRU 头部
+        if(NowMS_() - old->checked < REVALIDATE_MS) {
+            stats_.hits++;
+            return old;
+        }
+    }
+    stats_.misses++;
+
+    // 已有线程在加载同一个文件：等待其结果
+    auto fit = flights_.find(path);
+    if(fit != flights_.end()) {
+        shared_ptr<Flight> flight = fit->second;
+        flight->waiters++;
+        stats_.coalesced++;
+        flight->cond.wait(locker, [&flight] { return flight->done; });
+        *err = flight->err;
+        return flight->entry;
+    }
+
+    // 第一个未命中的请求负责加载，加载过程中不持有锁
+    shared_ptr<Flight> flight = make_shared<Flight>();
+    flights_[path] = flight;
+    stats_.loads++;
+    locker.unlock();
+
+    int loadErr = 0;
+    shared_ptr<FileEntry> entry = Load_(path, old, &loadErr);
+
+    locker.lock();
+    if(entry == old && old) {
+        old->checked = NowMS_();  // 文件未变化，只刷新校验时间
+    } else if(entry) {
+        if(entries_.count(path)) { Erase_(path); }
+        Insert_(entry);
+    } else if(entries_.count(path)) {
+        Erase_(path);  // 文件已被删除或不可访问
+    }
+    flight->done = true;
+    flight->err = loadErr;
+    flight->entry = entry;
+    flights_.erase(path);
+    if(flight->waiters > 0) {
+        LOG_DEBUG("FileCache %s coalesced %d waiters", path.data(), flight->waiters);
+    }
+    locker.unlock();
+    flight->cond.notify_all();
+    *err = loadErr;
+    return entry;
+}
+
+shared_ptr<const FileEntry> FileCache::Get(const char* path, size_t len, int* err) {
+    static thread_local string key;
+    key.assign(path, len);
+    return Get(key, err);
+}
+// stat 校验，文件未变化时沿用旧的缓存项，否则重新 open + mmap
+shared_ptr<FileEntry> FileCache::Load_(const string& path, const shared_ptr<FileEntry>& old, int* err) {
+    struct stat st;
+    if(stat(path.data(), &st) < 0) {
+        *err = errno;
+        return nullptr;
+    }
+    if(S_ISDIR(st.st_mode)) {
+        *err = EISDIR;
+        return nullptr;
+    }
+    if(!(st.st_mode & S_IROTH)) {
+        *err = EACCES;
+        return nullptr;
+    }
+    if(old && old->st.st_ino == st.st_ino && old->st.st_dev == st.st_dev &&
+       old->st.st_size == st.st_size && old->st.st_mtime == st.st_mtime) {
+        return old;
+    }
+
+    shared_ptr<FileEntry> entry = make_shared<FileEntry>();
+    entry->path = path;
+    entry->fd = open(path.data(), O_RDONLY);
+    if(entry->fd < 0) {
+        *err = errno;
+        return nullptr;
+    }
+    // 以打开的 fd 为准，避免 stat 与 open 之间文件被替换
+    fstat(entry->fd, &entry->st);
+    if(entry->st.st_size > 0 && entry->st.st_size <= MAX_MAP_SIZE) {
+        void* ret = mmap(0, entry->st.st_size, PROT_READ, MAP_PRIVATE, entry->fd, 0);
+        if(ret == MAP_FAILED) {
+            *err = errno;
+            return nullptr;
+        }
+        entry->data = static_cast<char*>(ret);
+    }
+    entry->checked = NowMS_();
+    return entry;
+}
+
+void FileCache::Insert_(const shared_ptr<FileEntry>& entry) {
+    lru_.push_front(entry->path);
+    entry->lru = lru_.begin();
+    entries_[entry->path] = entry;
+    if(entry->data) {
+        bytes_ += entry->st.st_size;
+        MemBudget::Instance()->Add(MemBudget::FILE_CACHE, entry->st.st_size);
+    }
+    // 超过上限时从 LRU 尾部淘汰
+    while((entries_.size() > MAX_ENTRIES || bytes_ > MAX_BYTES) && lru_.size() > 1) {
+        Erase_(lru_.back());
+        stats_.evictions++;
+    }
+}
+
+void FileCache::Erase_(const string& path) {
+    auto it = entries_.find(path);
+    assert(it != entries_.end());
+    if(it->second->data) {
+        bytes_ -= it->second->st.st_size;
+        MemBudget::Instance()->Add(MemBudget::FILE_CACHE, -static_cast<int64_t>(it->second->st.st_size));
+    }
+    lru_.erase(it->second->lru);
+    entries_.erase(it);
+}
+
+size_t FileCache::Trim(size_t bytes) {
+    lock_guard<mutex> locker(mtx_);
+    size_t before = bytes_;
+    while(before - bytes_ < bytes && !lru_.empty()) {
+        Erase_(lru_.back());
+        stats_.evictions++;
+    }
+    return before - bytes_;
+}
+
+FileCache::Stats FileCache::GetStats() {
+    lock_guard<mutex> locker(mtx_);
+    Stats stats = stats_;
+    stats.entries = entries_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+// 文本格式的统计信息，每行一个指标
+string FileCache::StatsStr() {
+    Stats s = GetStats();
+    string str;
+    str += "filecache_hits " + to_string(s.hits) + "\n";
+    str += "filecache_misses " + to_string(s.misses) + "\n";
+    str += "filecache_loads " + to_string(s.loads) + "\n";
+    str += "filecache_coalesced " + to_string(s.coalesced) + "\n";
+    str += "filecache_evictions " + to_string(s.evictions) + "\n";
+    str += "filecache_entries " + to_string(s.entries) + "\n";
+    str += "filecache_bytes " + to_string(s.bytes) + "\n";
+    return str;
+}
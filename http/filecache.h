@@ -0,0 +1,94 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <unordered_map>
+#include <list>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "../timer/cachedclock.h"
+#include "../log/log.h"
+#include "../buffer/membudget.h"
+
+// 文件缓存项：保存 stat 结果和打开的 fd，小文件整体映射到内存
+// 通过 shared_ptr 共享，被淘汰后仍在使用的响应可以继续持有
+struct FileEntry {
+    FileEntry() : fd(-1), data(nullptr), checked(0) { st = { 0 }; }
+    ~FileEntry() {
+        if(data) { munmap(data, st.st_size); }
+        if(fd >= 0) { close(fd); }
+    }
+    std::string path;
+    struct stat st;
+    int fd;           // 保持打开，大文件按区间映射
+    char* data;       // 整文件映射，文件过大或为空时为 nullptr
+    int64_t checked;  // 上次 stat 校验的时间 (毫秒)
+    std::list<std::string>::iterator lru;
+};
+
+class FileCache {
+public:
+    struct Stats {
+        uint64_t hits;       // 命中且无需校验
+        uint64_t misses;     // 未命中或需要重新校验
+        uint64_t loads;      // 实际执行 stat/open/mmap 的次数
+        uint64_t coalesced;  // 等待其他线程加载结果的请求数 (被合并的请求)
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    static FileCache* Instance();
+
+    // 返回 path 对应的缓存项，失败时返回 nullptr，并通过 err 返回 errno
+    // 同一个 key 并发未命中时只有第一个请求加载，其余请求等待其结果 (single-flight)
+    std::shared_ptr<const FileEntry> Get(const std::string& path, int* err);
+    // 同上，key 使用线程内复用的 std::string，命中时不分配内存
+    std::shared_ptr<const FileEntry> Get(const char* path, size_t len, int* err);
+
+    // 内存超出预算时调用：按 LRU 淘汰，直到释放 bytes 字节或缓存为空，返回释放的字节数
+    size_t Trim(size_t bytes);
+
+    Stats GetStats();
+    std::string StatsStr();
+
+    static const int64_t REVALIDATE_MS = 1000;      // 缓存项超过该时间后需重新 stat 校验
+    static const size_t MAX_ENTRIES = 1024;         // 最多缓存的文件数 (每项占用一个 fd)
+    static const size_t MAX_BYTES = 256 << 20;      // 整文件映射的总大小上限
+    static const off_t MAX_MAP_SIZE = 16 << 20;     // 超过该大小的文件不整体映射
+
+private:
+    // 一次正在进行的加载，后到的请求在 cond 上等待
+    struct Flight {
+        Flight() : done(false), err(0), waiters(0) {}
+        bool done;
+        int err;
+        int waiters;
+        std::shared_ptr<FileEntry> entry;
+        std::condition_variable cond;
+    };
+
+    FileCache() : bytes_(0) { stats_ = { 0 }; }
+
+    std::shared_ptr<FileEntry> Load_(const std::string& path, 
+                                     const std::shared_ptr<FileEntry>& old, int* err);
+    void Insert_(const std::shared_ptr<FileEntry>& entry);
+    void Erase_(const std::string& path);
+    static int64_t NowMS_();
+
+    std::mutex mtx_;
+    std::unordered_map<std::string, std::shared_ptr<FileEntry>> entries_;
+    std::unordered_map<std::string, std::shared_ptr<Flight>> flights_;
+    std::list<std::string> lru_;  // 头部为最近使用
+    size_t bytes_;
+    Stats stats_;
+};
+
+#endif //FILE_CACHE_H
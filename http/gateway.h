@@ -0,0 +1,28 @@
+#ifndef GATEWAY_H
+#define GATEWAY_H
+
+#include "../buffer/chainbuffer.h"
+
+// 由后端生成响应的请求 (反向代理、FastCGI) 的公共接口
+// 后端的数据由 worker 收下后暂存，HttpConn 发送完已有数据后再通过 Drain 取出下一部分
+class Gateway {
+public:
+    enum DRAIN_STATE {
+        DRAIN_DATA = 0,    // 已取出数据
+        DRAIN_WAIT,        // 暂时没有数据，后端收到数据后会唤醒客户端
+        DRAIN_DONE,        // 响应已全部转发
+        DRAIN_FAILED,      // 后端出错且已向客户端转发了部分数据，只能关闭连接
+        DRAIN_BAD_GATEWAY, // 后端出错且尚未转发任何数据，可以返回 502
+        DRAIN_GATEWAY_TIMEOUT, // 后端超时且尚未转发任何数据，可以返回 504
+    };
+
+    virtual ~Gateway() = default;
+
+    // 把收到的响应数据移入 buff
+    // 之前因积压暂停了后端读时，*resumeFd 为需要重新注册 EPOLLIN 的后端 fd，否则为 -1
+    virtual DRAIN_STATE Drain(ChainBuffer& buff, int* resumeFd) = 0;
+    // 转发结束后客户端连接能否继续使用
+    virtual bool KeepAlive() = 0;
+};
+
+#endif //GATEWAY_H
@@ -0,0 +1,169 @@
+#include "gzip.h"
+
+#ifdef WITH_GZIP
+
+#include "httprequest.h"
+
+using namespace std;
+
+GzipEncoder::GzipEncoder(int level) {
+    zs_ = {};
+    // windowBits 15 + 16 表示输出 gzip 格式
+    ok_ = deflateInit2(&zs_, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+}
+
+GzipEncoder::~GzipEncoder() {
+    if(ok_) { deflateEnd(&zs_); }
+}
+
+bool GzipEncoder::Compress(const char* data, size_t len, bool finish, string& out) {
+    if(!ok_) { return false; }
+    zs_.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    zs_.avail_in = static_cast<uInt>(len);
+    int flush = finish ? Z_FINISH : Z_SYNC_FLUSH;
+    char chunk[16384];
+    int ret;
+    do {
+        zs_.next_out = reinterpret_cast<Bytef*>(chunk);
+        zs_.avail_out = sizeof(chunk);
+        ret = deflate(&zs_, flush);
+        if(ret == Z_STREAM_ERROR) {
+            ok_ = false;
+            return false;
+        }
+        out.append(chunk, sizeof(chunk) - zs_.avail_out);
+    } while(zs_.avail_out == 0);
+    return finish ? ret == Z_STREAM_END : true;
+}
+
+Gzip* Gzip::Instance() {
+    static Gzip inst;  // 静态单例
+    return &inst;
+}
+
+bool Gzip::Enable(int level) {
+    if(level < 1 || level > 9) {
+        LOG_ERROR("gzip level %d out of range [1, 9]", level);
+        return false;
+    }
+    level_ = level;
+    LOG_INFO("gzip level: %d", level);
+    return true;
+}
+// 例如 "gzip, deflate, br" 或 "br;q=1.0, gzip;q=0.5, *;q=0"，明确列出的 gzip 优先于 "*"
+bool Gzip::Accepted(const HttpRequest& request) const {
+    if(level_ == 0) { return false; }
+    string value = request.GetHeader("Accept-Encoding");
+    double gzipQ = -1, anyQ = -1;
+    size_t pos = 0;
+    while(pos < value.size()) {
+        size_t end = min(value.find(',', pos), value.size());
+        string item = value.substr(pos, end - pos);
+        pos = end + 1;
+        size_t semi = min(item.find(';'), item.size());
+        size_t b = item.find_first_not_of(" \t");
+        if(b == string::npos || b >= semi) { continue; }
+        size_t e = item.find_last_not_of(" \t", semi - 1);
+        string coding = item.substr(b, e - b + 1);
+        size_t q = item.find("q=", semi);
+        double qvalue = (q == string::npos) ? 1 : atof(item.c_str() + q + 2);
+        if(strcasecmp(coding.c_str(), "gzip") == 0) {
+            gzipQ = qvalue;
+        } else if(coding == "*") {
+            anyQ = qvalue;
+        }
+    }
+    return gzipQ >= 0 ? gzipQ > 0 : anyQ > 0;
+}
+
+shared_ptr<const string> Gzip::Compress(const string& body) {
+    GzipEncoder encoder(level_);
+    shared_ptr<string> gz = make_shared<string>();
+    gz->reserve(body.size() / 3 + 64);
+    if(!encoder.Compress(body.data(), body.size(), true, *gz)) {
+        LOG_WARN("gzip compress failed");
+        return nullptr;
+    }
+    Count(body.size(), gz->size());
+    return gz;
+}
+
+shared_ptr<const string> Gzip::Find(const shared_ptr<const string>& body) {
+    lock_guard<mutex> locker(mtx_);
+    auto it = cache_.find(body.get());
+    if(it == cache_.end()) { return nullptr; }
+    // 地址被新的响应体复用：旧结果作废
+    if(it->second.body.lock() != body) {
+        Erase_(body.get());
+        return nullptr;
+    }
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    stats_.cacheHits++;
+    stats_.responses++;
+    stats_.bytesIn += body->size();
+    stats_.bytesOut += it->second.gz->size();
+    return it->second.gz;
+}
+
+void Gzip::Insert(const shared_ptr<const string>& body, const shared_ptr<const string>& gz) {
+    lock_guard<mutex> locker(mtx_);
+    if(cache_.count(body.get())) { Erase_(body.get()); }
+    lru_.push_front(body.get());
+    Entry& entry = cache_[body.get()];
+    entry.body = body;
+    entry.gz = gz;
+    entry.lru = lru_.begin();
+    bytes_ += gz->size();
+    MemBudget::Instance()->Add(MemBudget::GZIP_CACHE, gz->size());
+    // 超过上限时从 LRU 尾部淘汰
+    while(bytes_ > MAX_CACHE_BYTES && lru_.size() > 1) {
+        Erase_(lru_.back());
+    }
+}
+
+void Gzip::Erase_(const string* key) {
+    auto it = cache_.find(key);
+    assert(it != cache_.end());
+    bytes_ -= it->second.gz->size();
+    MemBudget::Instance()->Add(MemBudget::GZIP_CACHE, -static_cast<int64_t>(it->second.gz->size()));
+    lru_.erase(it->second.lru);
+    cache_.erase(it);
+}
+
+size_t Gzip::Trim(size_t bytes) {
+    lock_guard<mutex> locker(mtx_);
+    size_t before = bytes_;
+    while(before - bytes_ < bytes && !lru_.empty()) {
+        Erase_(lru_.back());
+    }
+    return before - bytes_;
+}
+
+void Gzip::Count(size_t in, size_t out) {
+    lock_guard<mutex> locker(mtx_);
+    stats_.responses++;
+    stats_.bytesIn += in;
+    stats_.bytesOut += out;
+}
+
+Gzip::Stats Gzip::GetStats() {
+    lock_guard<mutex> locker(mtx_);
+    Stats stats = stats_;
+    stats.entries = cache_.size();
+    stats.bytes = bytes_;
+    return stats;
+}
+// 文本格式的统计信息，每行一个指标
+string Gzip::StatsStr() {
+    Stats s = GetStats();
+    string str;
+    str += "gzip_responses " + to_string(s.responses) + "\n";
+    str += "gzip_bytes_in " + to_string(s.bytesIn) + "\n";
+    str += "gzip_bytes_out " + to_string(s.bytesOut) + "\n";
+    str += "gzip_cache_hits " + to_string(s.cacheHits) + "\n";
+    str += "gzip_cache_entries " + to_string(s.entries) + "\n";
+    str += "gzip_cache_bytes " + to_string(s.bytes) + "\n";
+    return str;
+}
+
+#endif //WITH_GZIP
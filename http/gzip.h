@@ -0,0 +1,94 @@
+#ifndef GZIP_H
+#define GZIP_H
+
+// 动态响应的 gzip 压缩，需使用 make GZIP=1 编译 (依赖 zlib)
+// 静态文件不在此压缩，由归档文件或预压缩的文件提供
+#ifdef WITH_GZIP
+
+#include <string>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include <zlib.h>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "../buffer/membudget.h"
+
+class HttpRequest;
+
+// gzip 格式的增量压缩，每次调用都 Z_SYNC_FLUSH，流式响应的数据不会滞留在压缩器中
+class GzipEncoder {
+public:
+    explicit GzipEncoder(int level);
+    ~GzipEncoder();
+
+    // 压缩 data 并把输出追加到 out，finish 时写入 gzip 尾部；zlib 出错时返回 false
+    bool Compress(const char* data, size_t len, bool finish, std::string& out);
+
+private:
+    z_stream zs_;
+    bool ok_;
+};
+
+// 压缩参数与共享响应体 (微缓存中的内容) 的压缩结果缓存
+// 缓存以原响应体为 key，原响应体被释放后对应的压缩结果不再命中，随后被 LRU 淘汰
+class Gzip {
+public:
+    struct Stats {
+        uint64_t responses;   // 压缩的响应数
+        uint64_t bytesIn;
+        uint64_t bytesOut;
+        uint64_t cacheHits;
+        size_t entries;
+        size_t bytes;
+    };
+
+    static Gzip* Instance();
+
+    bool Enable(int level);
+    bool IsOpen() const { return level_ > 0; }
+    int Level() const { return level_; }
+
+    // 已开启且请求的 Accept-Encoding 接受 gzip (q 不为 0)
+    bool Accepted(const HttpRequest& request) const;
+
+    // 整体压缩，失败时返回 nullptr
+    std::shared_ptr<const std::string> Compress(const std::string& body);
+    std::shared_ptr<const std::string> Find(const std::shared_ptr<const std::string>& body);
+    void Insert(const std::shared_ptr<const std::string>& body, const std::shared_ptr<const std::string>& gz);
+    void Count(size_t in, size_t out);
+
+    // 内存超出预算时调用：按 LRU 淘汰，直到释放 bytes 字节或缓存为空，返回释放的字节数
+    size_t Trim(size_t bytes);
+
+    Stats GetStats();
+    std::string StatsStr();
+
+    static const size_t MIN_SIZE = 1024;          // 小于该大小的响应不压缩
+    static const size_t INLINE_MAX = 64 << 10;    // 超过该大小的响应转为流式，逐段压缩
+    static const size_t SLICE = 64 << 10;         // 流式压缩时每次 Drain 最多压缩的输入
+    static const size_t MAX_CACHE_BYTES = 32 << 20;
+
+private:
+    struct Entry {
+        std::weak_ptr<const std::string> body;
+        std::shared_ptr<const std::string> gz;
+        std::list<const std::string*>::iterator lru;
+    };
+
+    Gzip() : level_(0), bytes_(0) { stats_ = { 0 }; }
+    void Erase_(const std::string* key);
+
+    std::atomic<int> level_;
+    std::mutex mtx_;
+    std::unordered_map<const std::string*, Entry> cache_;
+    std::list<const std::string*> lru_;  // 头部为最近使用
+    size_t bytes_;
+    Stats stats_;
+};
+
+#endif //WITH_GZIP
+#endif //GZIP_H
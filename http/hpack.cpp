@@ -0,0 +1,333 @@
+#include "hpack.h"
+
+using namespace std;
+
+// 静态表 (RFC 7541 Appendix A)，下标从 1 开始
+static const pair<const char*, const char*> STATIC_TABLE[] = {
+    { ":authority", "" },
+    { ":method", "GET" },
+    { ":method", "POST" },
+    { ":path", "/" },
+    { ":path", "/index.html" },
+    { ":scheme", "http" },
+    { ":scheme", "https" },
+    { ":status", "200" },
+    { ":status", "204" },
+    { ":status", "206" },
+    { ":status", "304" },
+    { ":status", "400" },
+    { ":status", "404" },
+    { ":status", "500" },
+    { "accept-charset", "" },
+    { "accept-encoding", "gzip, deflate" },
+    { "accept-language", "" },
+    { "accept-ranges", "" },
+    { "accept", "" },
+    { "access-control-allow-origin", "" },
+    { "age", "" },
+    { "allow", "" },
+    { "authorization", "" },
+    { "cache-control", "" },
+    { "content-disposition", "" },
+    { "content-encoding", "" },
+    { "content-language", "" },
+    { "content-length", "" },
+    { "content-location", "" },
+    { "content-range", "" },
+    { "content-type", "" },
+    { "cookie", "" },
+    { "date", "" },
+    { "etag", "" },
+    { "expect", "" },
+    { "expires", "" },
+    { "from", "" },
+    { "host", "" },
+    { "if-match", "" },
+    { "if-modified-since", "" },
+    { "if-none-match", "" },
+    { "if-range", "" },
+    { "if-unmodified-since", "" },
+    { "last-modified", "" },
+    { "link", "" },
+    { "location", "" },
+    { "max-forwards", "" },
+    { "proxy-authenticate", "" },
+    { "proxy-authorization", "" },
+    { "range", "" },
+    { "referer", "" },
+    { "refresh", "" },
+    { "retry-after", "" },
+    { "server", "" },
+    { "set-cookie", "" },
+    { "strict-transport-security", "" },
+    { "transfer-encoding", "" },
+    { "user-agent", "" },
+    { "vary", "" },
+    { "via", "" },
+    { "www-authenticate", "" },
+};
+static const size_t STATIC_COUNT = sizeof(STATIC_TABLE) / sizeof(STATIC_TABLE[0]);
+
+// Huffman 编码表 (RFC 7541 Appendix B)，第 256 个为 EOS
+static const uint32_t HUFFMAN_CODES[257] = {
+    0x1ff8, 0x7fffd8, 0xfffffe2, 0xfffffe3, 0xfffffe4, 0xfffffe5, 0xfffffe6, 0xfffffe7,
+    0xfffffe8, 0xffffea, 0x3ffffffc, 0xfffffe9, 0xfffffea, 0x3ffffffd, 0xfffffeb, 0xfffffec,
+    0xfffffed, 0xfffffee, 0xfffffef, 0xffffff0, 0xffffff1, 0xffffff2, 0x3ffffffe, 0xffffff3,
+    0xffffff4, 0xffffff5, 0xffffff6, 0xffffff7, 0xffffff8, 0xffffff9, 0xffffffa, 0xffffffb,
+    0x14, 0x3f8, 0x3f9, 0xffa, 0x1ff9, 0x15, 0xf8, 0x7fa,
+    0x3fa, 0x3fb, 0xf9, 0x7fb, 0xfa, 0x16, 0x17, 0x18,
+    0x0, 0x1, 0x2, 0x19, 0x1a, 0x1b, 0x1c, 0x1d,
+    0x1e, 0x1f, 0x5c, 0xfb, 0x7ffc, 0x20, 0xffb, 0x3fc,
+    0x1ffa, 0x21, 0x5d, 0x5e, 0x5f, 0x60, 0x61, 0x62,
+    0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69, 0x6a,
+    0x6b, 0x6c, 0x6d, 0x6e, 0x6f, 0x70, 0x71, 0x72,
+    0xfc, 0x73, 0xfd, 0x1ffb, 0x7fff0, 0x1ffc, 0x3ffc, 0x22,
+    0x7ffd, 0x3, 0x23, 0x4, 0x24, 0x5, 0x25, 0x26,
+    0x27, 0x6, 0x74, 0x75, 0x28, 0x29, 0x2a, 0x7,
+    0x2b, 0x76, 0x2c, 0x8, 0x9, 0x2d, 0x77, 0x78,
+    0x79, 0x7a, 0x7b, 0x7ffe, 0x7fc, 0x3ffd, 0x1ffd, 0xffffffc,
+    0xfffe6, 0x3fffd2, 0xfffe7, 0xfffe8, 0x3fffd3, 0x3fffd4, 0x3fffd5, 0x7fffd9,
+    0x3fffd6, 0x7fffda, 0x7fffdb, 0x7fffdc, 0x7fffdd, 0x7fffde, 0xffffeb, 0x7fffdf,
+    0xffffec, 0xffffed, 0x3fffd7, 0x7fffe0, 0xffffee, 0x7fffe1, 0x7fffe2, 0x7fffe3,
+    0x7fffe4, 0x1fffdc, 0x3fffd8, 0x7fffe5, 0x3fffd9, 0x7fffe6, 0x7fffe7, 0xffffef,
+    0x3fffda, 0x1fffdd, 0xfffe9, 0x3fffdb, 0x3fffdc, 0x7fffe8, 0x7fffe9, 0x1fffde,
+    0x7fffea, 0x3fffdd, 0x3fffde, 0xfffff0, 0x1fffdf, 0x3fffdf, 0x7fffeb, 0x7fffec,
+    0x1fffe0, 0x1fffe1, 0x3fffe0, 0x1fffe2, 0x7fffed, 0x3fffe1, 0x7fffee, 0x7fffef,
+    0xfffea, 0x3fffe2, 0x3fffe3, 0x3fffe4, 0x7ffff0, 0x3fffe5, 0x3fffe6, 0x7ffff1,
+    0x3ffffe0, 0x3ffffe1, 0xfffeb, 0x7fff1, 0x3fffe7, 0x7ffff2, 0x3fffe8, 0x1ffffec,
+    0x3ffffe2, 0x3ffffe3, 0x3ffffe4, 0x7ffffde, 0x7ffffdf, 0x3ffffe5, 0xfffff1, 0x1ffffed,
+    0x7fff2, 0x1fffe3, 0x3ffffe6, 0x7ffffe0, 0x7ffffe1, 0x3ffffe7, 0x7ffffe2, 0xfffff2,
+    0x1fffe4, 0x1fffe5, 0x3ffffe8, 0x3ffffe9, 0xffffffd, 0x7ffffe3, 0x7ffffe4, 0x7ffffe5,
+    0xfffec, 0xfffff3, 0xfffed, 0x1fffe6, 0x3fffe9, 0x1fffe7, 0x1fffe8, 0x7ffff3,
+    0x3fffea, 0x3fffeb, 0x1ffffee, 0x1ffffef, 0xfffff4, 0xfffff5, 0x3ffffea, 0x7ffff4,
+    0x3ffffeb, 0x7ffffe6, 0x3ffffec, 0x3ffffed, 0x7ffffe7, 0x7ffffe8, 0x7ffffe9, 0x7ffffea,
+    0x7ffffeb, 0xffffffe, 0x7ffffec, 0x7ffffed, 0x7ffffee, 0x7ffffef, 0x7fffff0, 0x3ffffee,
+    0x3fffffff,
+};
+
+static const uint8_t HUFFMAN_LENS[257] = {
+    13, 23, 28, 28, 28, 28, 28, 28, 28, 24, 30, 28, 28, 30, 28, 28,
+    28, 28, 28, 28, 28, 28, 30, 28, 28, 28, 28, 28, 28, 28, 28, 28,
+    6, 10, 10, 12, 13, 6, 8, 11, 10, 10, 8, 11, 8, 6, 6, 6,
+    5, 5, 5, 6, 6, 6, 6, 6, 6, 6, 7, 8, 15, 6, 12, 10,
+    13, 6, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7, 7,
+    7, 7, 7, 7, 7, 7, 7, 7, 8, 7, 8, 13, 19, 13, 14, 6,
+    15, 5, 6, 5, 6, 5, 6, 6, 6, 5, 7, 7, 6, 6, 6, 5,
+    6, 7, 6, 5, 5, 6, 7, 7, 7, 7, 7, 15, 11, 14, 13, 28,
+    20, 22, 20, 20, 22, 22, 22, 23, 22, 23, 23, 23, 23, 23, 24, 23,
+    24, 24, 22, 23, 24, 23, 23, 23, 23, 21, 22, 23, 22, 23, 23, 24,
+    22, 21, 20, 22, 22, 23, 23, 21, 23, 22, 22, 24, 21, 22, 23, 23,
+    21, 21, 22, 21, 23, 22, 23, 23, 20, 22, 22, 22, 23, 22, 22, 23,
+    26, 26, 20, 19, 22, 23, 22, 25, 26, 26, 26, 27, 27, 26, 24, 25,
+    19, 21, 26, 27, 27, 26, 27, 24, 21, 21, 26, 26, 28, 27, 27, 27,
+    20, 24, 20, 21, 22, 21, 21, 23, 22, 22, 25, 25, 24, 24, 26, 23,
+    26, 27, 26, 26, 27, 27, 27, 27, 27, 28, 27, 27, 27, 27, 27, 26,
+    30,
+};
+
+// Huffman 解码树，首次使用时由编码表构造
+// 每个节点两个孩子，叶子节点保存符号 (sym >= 0)
+struct HuffmanNode {
+    int child[2];
+    int sym;
+};
+
+static const vector<HuffmanNode>& HuffmanTree() {
+    static const vector<HuffmanNode> tree = [] {
+        vector<HuffmanNode> nodes(1, HuffmanNode{ { 0, 0 }, -1 });
+        for(int sym = 0; sym < 257; sym++) {
+            int cur = 0;
+            for(int i = HUFFMAN_LENS[sym] - 1; i >= 0; i--) {
+                int bit = (HUFFMAN_CODES[sym] >> i) & 1;
+                if(nodes[cur].child[bit] == 0) {
+                    nodes[cur].child[bit] = nodes.size();
+                    nodes.push_back(HuffmanNode{ { 0, 0 }, -1 });
+                }
+                cur = nodes[cur].child[bit];
+            }
+            nodes[cur].sym = sym;
+        }
+        return nodes;
+    }();
+    return tree;
+}
+
+bool HuffmanDecode(const uint8_t* data, size_t len, string* out) {
+    const vector<HuffmanNode>& tree = HuffmanTree();
+    int cur = 0;
+    int depth = 0;       // 当前未完成符号已读取的位数
+    bool allOnes = true; // 未完成符号的位是否全为 1 (只有 EOS 前缀可以作为填充)
+    for(size_t i = 0; i < len; i++) {
+        for(int b = 7; b >= 0; b--) {
+            int bit = (data[i] >> b) & 1;
+            cur = tree[cur].child[bit];
+            if(cur == 0) { return false; }
+            depth++;
+            allOnes = allOnes && bit;
+            if(tree[cur].sym >= 0) {
+                if(tree[cur].sym == 256) { return false; }  // 不允许出现 EOS
+                out->push_back(static_cast<char>(tree[cur].sym));
+                cur = 0;
+                depth = 0;
+                allOnes = true;
+            }
+        }
+    }
+    // 填充必须是不超过 7 位的 EOS 前缀
+    return depth <= 7 && allOnes;
+}
+
+HpackDecoder::HpackDecoder(size_t maxTableSize) 
+    : tableSize_(0), maxTableSize_(maxTableSize), settingsMax_(maxTableSize) {}
+
+bool HpackDecoder::DecodeInt_(const uint8_t** p, const uint8_t* end, int prefix, uint64_t* value) {
+    if(*p >= end) { return false; }
+    uint64_t mask = (1 << prefix) - 1;
+    *value = **p & mask;
+    (*p)++;
+    if(*value < mask) { return true; }
+    int shift = 0;
+    while(*p < end) {
+        uint8_t b = **p;
+        (*p)++;
+        if(shift > 56) { return false; }  // 溢出
+        *value += static_cast<uint64_t>(b & 0x7f) << shift;
+        shift += 7;
+        if(!(b & 0x80)) { return true; }
+    }
+    return false;
+}
+
+bool HpackDecoder::DecodeStr_(const uint8_t** p, const uint8_t* end, string* str) {
+    if(*p >= end) { return false; }
+    bool huffman = **p & 0x80;
+    uint64_t len;
+    if(!DecodeInt_(p, end, 7, &len) || len > static_cast<uint64_t>(end - *p)) { return false; }
+    str->clear();
+    if(huffman) {
+        if(!HuffmanDecode(*p, len, str)) { return false; }
+    } else {
+        str->assign(reinterpret_cast<const char*>(*p), len);
+    }
+    *p += len;
+    return true;
+}
+
+bool HpackDecoder::Lookup_(uint64_t index, string* name, string* value) const {
+    if(index == 0) { return false; }
+    if(index <= STATIC_COUNT) {
+        *name = STATIC_TABLE[index - 1].first;
+        *value = STATIC_TABLE[index - 1].second;
+        return true;
+    }
+    index -= STATIC_COUNT + 1;
+    if(index >= table_.size()) { return false; }
+    *name = table_[index].first;
+    *value = table_[index].second;
+    return true;
+}
+
+void HpackDecoder::Insert_(const string& name, const string& value) {
+    size_t size = name.size() + value.size() + 32;
+    if(size > maxTableSize_) {  // 条目比整个表还大：清空动态表
+        table_.clear();
+        tableSize_ = 0;
+        return;
+    }
+    table_.emplace_front(name, value);
+    tableSize_ += size;
+    Evict_();
+}
+
+void HpackDecoder::Evict_() {
+    while(tableSize_ > maxTableSize_ && !table_.empty()) {
+        tableSize_ -= table_.back().first.size() + table_.back().second.size() + 32;
+        table_.pop_back();
+    }
+}
+
+bool HpackDecoder::Decode(const uint8_t* data, size_t len, HeaderList* headers) {
+    const uint8_t* p = data;
+    const uint8_t* end = data + len;
+    bool headerSeen = false;  // dynamic table size update 只能出现在 header block 开头
+    while(p < end) {
+        uint8_t b = *p;
+        uint64_t index;
+        string name, value;
+        if(b & 0x80) {
+            // 1xxxxxxx 索引头部字段
+            if(!DecodeInt_(&p, end, 7, &index) || !Lookup_(index, &name, &value)) { return false; }
+        } else if((b & 0xe0) == 0x20) {
+            // 001xxxxx 动态表大小更新
+            if(headerSeen || !DecodeInt_(&p, end, 5, &index) || index > settingsMax_) { return false; }
+            maxTableSize_ = index;
+            Evict_();
+            continue;
+        } else {
+            // 01xxxxxx 带索引的字面量；0000xxxx 不索引；0001xxxx 永不索引
+            bool incremental = (b & 0xc0) == 0x40;
+            int prefix = incremental ? 6 : 4;
+            if(!DecodeInt_(&p, end, prefix, &index)) { return false; }
+            if(index > 0) {
+                string ignore;
+                if(!Lookup_(index, &name, &ignore)) { return false; }
+            } else if(!DecodeStr_(&p, end, &name)) {
+                return false;
+            }
+            if(!DecodeStr_(&p, end, &value)) { return false; }
+            if(incremental) { Insert_(name, value); }
+        }
+        headerSeen = true;
+        headers->emplace_back(move(name), move(value));
+    }
+    return true;
+}
+
+void HpackEncoder::EncodeInt_(uint64_t value, int prefix, uint8_t flags, string* out) {
+    uint64_t mask = (1 << prefix) - 1;
+    if(value < mask) {
+        out->push_back(static_cast<char>(flags | value));
+        return;
+    }
+    out->push_back(static_cast<char>(flags | mask));
+    value -= mask;
+    while(value >= 128) {
+        out->push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    out->push_back(static_cast<char>(value));
+}
+
+void HpackEncoder::EncodeStr_(const string& str, string* out) {
+    EncodeInt_(str.size(), 7, 0, out);  // H = 0，不使用 Huffman
+    out->append(str);
+}
+// :status 常用值直接使用静态表索引
+void HpackEncoder::EncodeStatus(int code, string* out) {
+    switch(code) {
+    case 200: EncodeInt_(8, 7, 0x80, out); return;
+    case 204: EncodeInt_(9, 7, 0x80, out); return;
+    case 206: EncodeInt_(10, 7, 0x80, out); return;
+    case 304: EncodeInt_(11, 7, 0x80, out); return;
+    case 400: EncodeInt_(12, 7, 0x80, out); return;
+    case 404: EncodeInt_(13, 7, 0x80, out); return;
+    case 500: EncodeInt_(14, 7, 0x80, out); return;
+    default:
+        Encode(":status", to_string(code), out);
+    }
+}
+// 不索引的字面量 (0000xxxx)，name 在静态表中时只编码索引
+void HpackEncoder::Encode(const string& name, const string& value, string* out) {
+    size_t index = 0;
+    for(size_t i = 0; i < STATIC_COUNT; i++) {
+        if(name == STATIC_TABLE[i].first) {
+            index = i + 1;
+            break;
+        }
+    }
+    EncodeInt_(index, 4, 0x00, out);
+    if(index == 0) {
+        EncodeStr_(name, out);
+    }
+    EncodeStr_(value, out);
+}
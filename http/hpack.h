@@ -0,0 +1,46 @@
+#ifndef HPACK_H
+#define HPACK_H
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <utility>
+#include <stdint.h>
+
+// HPACK (RFC 7541) 头部压缩
+typedef std::vector<std::pair<std::string, std::string>> HeaderList;
+
+class HpackDecoder {
+public:
+    explicit HpackDecoder(size_t maxTableSize = 4096);
+
+    // 解码一个完整的 header block，失败表示 COMPRESSION_ERROR，连接必须关闭
+    bool Decode(const uint8_t* data, size_t len, HeaderList* headers);
+
+private:
+    bool DecodeInt_(const uint8_t** p, const uint8_t* end, int prefix, uint64_t* value);
+    bool DecodeStr_(const uint8_t** p, const uint8_t* end, std::string* str);
+    bool Lookup_(uint64_t index, std::string* name, std::string* value) const;
+    void Insert_(const std::string& name, const std::string& value);
+    void Evict_();
+
+    std::deque<std::pair<std::string, std::string>> table_;  // 动态表，头部为最新插入的条目
+    size_t tableSize_;     // 动态表当前大小 (每个条目 name + value + 32)
+    size_t maxTableSize_;  // 对端通过 dynamic table size update 设置的大小
+    size_t settingsMax_;   // 本端 SETTINGS_HEADER_TABLE_SIZE，对端设置的大小不能超过它
+};
+
+// 编码器不使用动态表和 Huffman，只引用静态表中的 name，实现简单且无状态
+class HpackEncoder {
+public:
+    static void EncodeStatus(int code, std::string* out);
+    static void Encode(const std::string& name, const std::string& value, std::string* out);
+
+private:
+    static void EncodeInt_(uint64_t value, int prefix, uint8_t flags, std::string* out);
+    static void EncodeStr_(const std::string& str, std::string* out);
+};
+
+bool HuffmanDecode(const uint8_t* data, size_t len, std::string* out);
+
+#endif //HPACK_H
@@ -0,0 +1,625 @@
+#include "http2session.h"
+
+using namespace std;
+
+static const char PREFACE[] = "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+static const size_t PREFACE_LEN = sizeof(PREFACE) - 1;
+
+// 帧标志位
+static const uint8_t FLAG_END_STREAM = 0x1;
+static const uint8_t FLAG_ACK = 0x1;
+static const uint8_t FLAG_END_HEADERS = 0x4;
+static const uint8_t FLAG_PADDED = 0x8;
+static const uint8_t FLAG_PRIORITY = 0x20;
+
+static const int64_t MAX_WINDOW = 0x7fffffff;
+
+static uint32_t ReadU32(const char* p) {
+    const uint8_t* b = reinterpret_cast<const uint8_t*>(p);
+    return (uint32_t(b[0]) << 24) | (uint32_t(b[1]) << 16) | (uint32_t(b[2]) << 8) | b[3];
+}
+
+static void PutU32(char* p, uint32_t v) {
+    p[0] = v >> 24;
+    p[1] = v >> 16;
+    p[2] = v >> 8;
+    p[3] = v;
+}
+
+Http2Session::Http2Session(const Handler& handler, size_t maxBodySize)
+    : handler_(handler), maxBodySize_(maxBodySize), out_(nullptr), lastStreamId_(0), continuationId_(0), continuationFlags_(0),
+      headerParent_(0), headerWeight_(16), prefaceReceived_(false), settingsSent_(false), 
+      goaway_(false), fatal_(false), connWindow_(INITIAL_WINDOW), recvWindow_(INITIAL_WINDOW),
+      peerInitialWindow_(INITIAL_WINDOW), peerMaxFrame_(16384), vtime_(0) {
+    // stream 窗口正好容纳一个最大的请求体 (多出的 1 字节用于发现超限并回复 413)
+    // 连接级窗口限制整个连接缓存的请求体，至少容纳一个 stream
+    streamRecvWindow_ = max<int64_t>(min<size_t>(maxBodySize_, MAX_WINDOW - 1) + 1, INITIAL_WINDOW);
+    connRecvWindow_ = max<int64_t>(LOCAL_WINDOW, streamRecvWindow_);
+}
+
+Http2Session::~Http2Session() {
+    for(auto& kv : streams_) {
+        MemBudget::Instance()->Add(MemBudget::H2_BODY, -static_cast<int64_t>(kv.second->requestBody.size()));
+    }
+}
+
+int Http2Session::MatchPreface(const char* data, size_t len) {
+    size_t n = min(len, PREFACE_LEN);
+    if(memcmp(data, PREFACE, n) != 0) { return -1; }
+    return len >= PREFACE_LEN ? 1 : 0;
+}
+
+bool Http2Session::IsClosing() const {
+    return fatal_ || (goaway_ && streams_.empty());
+}
+
+void Http2Session::Upgrade(HttpRequest& request) {
+    // HTTP2-Settings 中的参数视为对端已发送的 SETTINGS (不需要 ACK)
+    string settings = Base64UrlDecode_(request.GetHeader("HTTP2-Settings"));
+    OnSettings_(0, settings.data(), settings.size() - settings.size() % 6, false);
+
+    unique_ptr<Stream> stream(new Stream());
+    stream->id = 1;
+    stream->window = peerInitialWindow_;
+    stream->recvWindow = 0;
+    stream->parent = 0;
+    stream->weight = 16;
+    stream->vtime = 0;
+    stream->endRemote = true;
+    stream->responded = false;  // 在 SETTINGS 之后响应
+    stream->bodyIdx = stream->remaining = 0;
+    stream->request = request;
+    streams_[1] = move(stream);
+    lastStreamId_ = 1;          // 101 之后客户端仍会发送 preface
+}
+
+bool Http2Session::Process(Buffer& readBuff, ChainBuffer& writeBuff) {
+    out_ = &writeBuff;
+    if(!settingsSent_) {
+        WriteSettings_();
+        settingsSent_ = true;
+        for(auto& kv : streams_) {  // Upgrade 的 stream 1
+            if(!kv.second->responded) { Respond_(kv.second.get()); }
+        }
+    }
+    if(!prefaceReceived_) {
+        if(readBuff.ReadableBytes() < PREFACE_LEN) { 
+            SendData_(writeBuff);
+            return !fatal_; 
+        }
+        if(MatchPreface(readBuff.Peek(), readBuff.ReadableBytes()) != 1) {
+            return GoAway_(PROTOCOL_ERROR, "invalid preface");
+        }
+        readBuff.Retrieve(PREFACE_LEN);
+        prefaceReceived_ = true;
+    }
+    // 逐个处理完整的帧：9 字节帧头 + payload
+    while(!fatal_ && readBuff.ReadableBytes() >= 9) {
+        const uint8_t* h = reinterpret_cast<const uint8_t*>(readBuff.Peek());
+        size_t len = (size_t(h[0]) << 16) | (size_t(h[1]) << 8) | h[2];
+        if(len > MAX_FRAME_SIZE) {
+            return GoAway_(FRAME_SIZE_ERROR, "frame too large");
+        }
+        if(readBuff.ReadableBytes() < 9 + len) { break; }
+        uint8_t type = h[3];
+        uint8_t flags = h[4];
+        uint32_t id = ReadU32(readBuff.Peek() + 5) & 0x7fffffff;
+        bool ok = OnFrame_(type, flags, id, readBuff.Peek() + 9, len);
+        readBuff.Retrieve(9 + len);
+        if(!ok) { return false; }
+    }
+    if(fatal_) { return false; }
+    SendData_(writeBuff);
+    return true;
+}
+
+bool Http2Session::OnFrame_(uint8_t type, uint8_t flags, uint32_t id, const char* payload, size_t len) {
+    // header block 必须连续，中间不能插入其他帧
+    if(continuationId_ && (type != CONTINUATION || id != continuationId_)) {
+        return GoAway_(PROTOCOL_ERROR, "expect CONTINUATION");
+    }
+    switch(type) {
+    case DATA:
+        return OnData_(flags, id, payload, len);
+    case HEADERS:
+        return OnHeaders_(flags, id, payload, len);
+    case CONTINUATION:
+        if(!continuationId_) { return GoAway_(PROTOCOL_ERROR, "unexpected CONTINUATION"); }
+        if(headerBlock_.size() + len > MAX_HEADER_BLOCK) {
+            return GoAway_(PROTOCOL_ERROR, "header block too large");
+        }
+        headerBlock_.append(payload, len);
+        if(flags & FLAG_END_HEADERS) {
+            continuationId_ = 0;
+            return OnHeaderBlock_(id);
+        }
+        return true;
+    case PRIORITY:
+        if(id == 0) { return GoAway_(PROTOCOL_ERROR, "PRIORITY on stream 0"); }
+        if(len != 5) {
+            ResetStream_(id, FRAME_SIZE_ERROR);
+            return true;
+        }
+        OnPriority_(id, ReadU32(payload) & 0x7fffffff, static_cast<uint8_t>(payload[4]) + 1);
+        return true;
+    case RST_STREAM:
+        if(id == 0 || id > lastStreamId_) { return GoAway_(PROTOCOL_ERROR, "RST_STREAM on idle stream"); }
+        if(len != 4) { return GoAway_(FRAME_SIZE_ERROR, "RST_STREAM size"); }
+        CloseStream_(id);
+        return true;
+    case SETTINGS:
+        if(id != 0) { return GoAway_(PROTOCOL_ERROR, "SETTINGS on stream"); }
+        return OnSettings_(flags, payload, len);
+    case PUSH_PROMISE:
+        return GoAway_(PROTOCOL_ERROR, "PUSH_PROMISE from client");
+    case PING:
+        if(id != 0) { return GoAway_(PROTOCOL_ERROR, "PING on stream"); }
+        if(len != 8) { return GoAway_(FRAME_SIZE_ERROR, "PING size"); }
+        if(!(flags & FLAG_ACK)) { WriteFrame_(PING, FLAG_ACK, 0, payload, 8); }
+        return true;
+    case GOAWAY:
+        if(id != 0) { return GoAway_(PROTOCOL_ERROR, "GOAWAY on stream"); }
+        goaway_ = true;  // 不再接受新的 stream，已有的 stream 发送完后关闭连接
+        return true;
+    case WINDOW_UPDATE:
+        return OnWindowUpdate_(id, payload, len);
+    default:
+        return true;  // 未知类型的帧直接忽略
+    }
+}
+
+bool Http2Session::OnHeaders_(uint8_t flags, uint32_t id, const char* payload, size_t len) {
+    if(id == 0 || !(id & 1)) { return GoAway_(PROTOCOL_ERROR, "invalid stream id"); }
+    size_t pad = 0;
+    if(flags & FLAG_PADDED) {
+        if(len < 1) { return GoAway_(FRAME_SIZE_ERROR, "HEADERS size"); }
+        pad = static_cast<uint8_t>(payload[0]);
+        payload++;
+        len--;
+    }
+    headerParent_ = 0;
+    headerWeight_ = 16;
+    if(flags & FLAG_PRIORITY) {
+        if(len < 5) { return GoAway_(FRAME_SIZE_ERROR, "HEADERS size"); }
+        headerParent_ = ReadU32(payload) & 0x7fffffff;
+        headerWeight_ = static_cast<uint8_t>(payload[4]) + 1;
+        payload += 5;
+        len -= 5;
+    }
+    if(pad > len) { return GoAway_(PROTOCOL_ERROR, "invalid padding"); }
+    len -= pad;
+    // 新的 stream id 必须递增，已有 stream 上的 HEADERS 为 trailer
+    if(id <= lastStreamId_ && streams_.count(id) == 0) {
+        return GoAway_(STREAM_CLOSED, "HEADERS on closed stream");
+    }
+    if(len > MAX_HEADER_BLOCK) { return GoAway_(PROTOCOL_ERROR, "header block too large"); }
+    headerBlock_.assign(payload, len);
+    continuationFlags_ = flags;
+    if(!(flags & FLAG_END_HEADERS)) {
+        continuationId_ = id;
+        return true;
+    }
+    return OnHeaderBlock_(id);
+}
+
+// 请求体收在 stream 中 (不超过 maxBodySize_)，END_STREAM 之后再生成响应
+// 流控按整个帧 (含填充) 计算：缓存的请求体交给处理函数或丢弃之后才归还连接级窗口，其余部分立即归还
+// stream 窗口不再扩大 (填充除外)，超出窗口的对端按 FLOW_CONTROL_ERROR 处理
+bool Http2Session::OnData_(uint8_t flags, uint32_t id, const char* payload, size_t len) {
+    if(id == 0) { return GoAway_(PROTOCOL_ERROR, "DATA on stream 0"); }
+    if(id > lastStreamId_) { return GoAway_(PROTOCOL_ERROR, "DATA on idle stream"); }
+    if(static_cast<int64_t>(len) > recvWindow_) { return GoAway_(FLOW_CONTROL_ERROR, "connection window exceeded"); }
+    recvWindow_ -= len;
+    auto it = streams_.find(id);
+    if(it == streams_.end() || it->second->endRemote) {
+        ReturnWindow_(len);
+        return true;
+    }
+    Stream* stream = it->second.get();
+    size_t pad = 0;
+    if(flags & FLAG_PADDED) {
+        if(len < 1) { return GoAway_(FRAME_SIZE_ERROR, "DATA size"); }
+        pad = static_cast<uint8_t>(payload[0]);
+        if(pad >= len) { return GoAway_(PROTOCOL_ERROR, "invalid padding"); }
+    }
+    if(static_cast<int64_t>(len) > stream->recvWindow) {
+        ReturnWindow_(len);
+        ResetStream_(id, FLOW_CONTROL_ERROR);
+        CloseStream_(id);
+        return true;
+    }
+    stream->recvWindow -= len;
+    size_t dataLen = (flags & FLAG_PADDED) ? len - 1 - pad : len;
+    if(len > dataLen) {  // 填充不缓存，两级窗口都立即归还
+        ReturnWindow_(len - dataLen);
+        if(!(flags & FLAG_END_STREAM)) {
+            stream->recvWindow += len - dataLen;
+            WindowUpdate_(id, len - dataLen);
+        }
+    }
+    if(stream->requestBody.size() + dataLen > maxBodySize_) {
+        stream->endRemote = true;  // 之后的 DATA 立即归还连接级窗口
+        ReleaseBody_(stream);
+        ReturnWindow_(dataLen);
+        Respond_(stream, 413);
+        return true;
+    }
+    stream->requestBody.append(payload + ((flags & FLAG_PADDED) ? 1 : 0), dataLen);
+    MemBudget::Instance()->Add(MemBudget::H2_BODY, dataLen);
+    if(flags & FLAG_END_STREAM) {
+        stream->endRemote = true;
+        Respond_(stream);
+    } else if(recvWindow_ < static_cast<int64_t>(MAX_FRAME_SIZE)) {
+        RefuseStalled_();
+    }
+    return true;
+}
+// 连接级窗口将要耗尽而缓存的请求体都没有收齐时，对端可能无法再发送任何 stream 的剩余部分
+// 从最新的 stream 开始，以 REFUSED_STREAM 重置收到部分请求体的 stream 并归还窗口，直到窗口恢复一半
+// 最早的一个总是保留 (连接级窗口至少容纳一个请求体，它最终能收齐)；被重置的请求尚未处理，对端可以重试
+void Http2Session::RefuseStalled_() {
+    vector<uint32_t> partial;
+    for(auto& kv : streams_) {
+        if(!kv.second->endRemote && !kv.second->requestBody.empty()) { partial.push_back(kv.first); }
+    }
+    while(partial.size() > 1 && recvWindow_ < connRecvWindow_ / 2) {
+        uint32_t id = partial.back();
+        partial.pop_back();
+        LOG_DEBUG("HTTP/2 stream %u refused, connection window exhausted", id);
+        ResetStream_(id, REFUSED_STREAM);
+        CloseStream_(id);
+    }
+}
+
+bool Http2Session::OnHeaderBlock_(uint32_t id) {
+    // 即使 stream 最终被拒绝也必须解码，保证 HPACK 动态表与对端一致
+    HeaderList headers;
+    if(!decoder_.Decode(reinterpret_cast<const uint8_t*>(headerBlock_.data()), headerBlock_.size(), &headers)) {
+        return GoAway_(COMPRESSION_ERROR, "hpack decode error");
+    }
+    headerBlock_.clear();
+    bool endStream = continuationFlags_ & FLAG_END_STREAM;
+    auto it = streams_.find(id);
+    if(it != streams_.end()) {  // trailer
+        if(endStream && !it->second->endRemote) {
+            it->second->endRemote = true;
+            Respond_(it->second.get());
+        }
+        return true;
+    }
+    lastStreamId_ = id;
+    if(goaway_) { return true; }
+    if(streams_.size() >= MAX_CONCURRENT_STREAMS) {
+        ResetStream_(id, REFUSED_STREAM);
+        return true;
+    }
+    // 伪头部必须在普通头部之前，普通头部名必须是小写
+    // 普通头部转为 HTTP/1.1 的常见写法 (accept-encoding -> Accept-Encoding)，与 HttpRequest 保持一致
+    string method, path;
+    vector<pair<string, string>> fields;
+    bool regular = false;
+    for(auto& h : headers) {
+        const string& name = h.first;
+        if(!name.empty() && name[0] == ':') {
+            if(regular) { ResetStream_(id, PROTOCOL_ERROR); return true; }
+            if(name == ":method") { method = h.second; }
+            else if(name == ":path") { path = h.second; }
+            else if(name == ":authority") { fields.emplace_back("Host", h.second); }
+            else if(name != ":scheme") { ResetStream_(id, PROTOCOL_ERROR); return true; }
+            continue;
+        }
+        regular = true;
+        string canon = name;
+        bool upper = true;
+        for(char& c : canon) {
+            if(c >= 'A' && c <= 'Z') { ResetStream_(id, PROTOCOL_ERROR); return true; }
+            if(upper && c >= 'a' && c <= 'z') { c = c - 'a' + 'A'; }
+            upper = (c == '-');
+        }
+        fields.emplace_back(canon, h.second);
+    }
+    if(method.empty() || path.empty()) {
+        ResetStream_(id, PROTOCOL_ERROR);
+        return true;
+    }
+
+    unique_ptr<Stream> stream(new Stream());
+    stream->id = id;
+    stream->window = peerInitialWindow_;
+    stream->recvWindow = streamRecvWindow_;
+    stream->parent = headerParent_ == id ? 0 : headerParent_;
+    stream->weight = headerWeight_;
+    stream->vtime = vtime_;
+    stream->endRemote = endStream;
+    stream->responded = false;
+    stream->bodyIdx = stream->remaining = 0;
+    stream->request.SetRequest(method, path, fields);
+    Stream* s = stream.get();
+    streams_[id] = move(stream);
+    // 带请求体的请求等 END_STREAM 之后再处理，Content-Length 过大时直接回复 413
+    StrRef length = s->request.HeaderRef("Content-Length");
+    if(!length.Empty() && strtoull(length.Str().c_str(), nullptr, 10) > maxBodySize_) {
+        s->endRemote = true;
+        Respond_(s, 413);
+    } else if(endStream) {
+        Respond_(s);
+    }
+    return true;
+}
+
+bool Http2Session::OnSettings_(uint8_t flags, const char* payload, size_t len, bool ack) {
+    if(flags & FLAG_ACK) {
+        if(len != 0) { return GoAway_(FRAME_SIZE_ERROR, "SETTINGS ACK size"); }
+        return true;
+    }
+    if(len % 6 != 0) { return GoAway_(FRAME_SIZE_ERROR, "SETTINGS size"); }
+    for(size_t i = 0; i < len; i += 6) {
+        uint16_t key = (uint16_t(uint8_t(payload[i])) << 8) | uint8_t(payload[i + 1]);
+        uint32_t value = ReadU32(payload + i + 2);
+        switch(key) {
+        case 2:  // ENABLE_PUSH
+            if(value > 1) { return GoAway_(PROTOCOL_ERROR, "ENABLE_PUSH"); }
+            break;
+        case 4:  // INITIAL_WINDOW_SIZE，调整所有 stream 的发送窗口
+            if(value > MAX_WINDOW) { return GoAway_(FLOW_CONTROL_ERROR, "INITIAL_WINDOW_SIZE"); }
+            for(auto& kv : streams_) {
+                kv.second->window += int64_t(value) - peerInitialWindow_;
+            }
+            peerInitialWindow_ = value;
+            break;
+        case 5:  // MAX_FRAME_SIZE
+            if(value < 16384 || value > 16777215) { return GoAway_(PROTOCOL_ERROR, "MAX_FRAME_SIZE"); }
+            peerMaxFrame_ = value;
+            break;
+        default:  // HEADER_TABLE_SIZE 等：编码器不使用动态表，可以忽略
+            break;
+        }
+    }
+    if(ack) { WriteFrame_(SETTINGS, FLAG_ACK, 0, nullptr, 0); }
+    return true;
+}
+
+bool Http2Session::OnWindowUpdate_(uint32_t id, const char* payload, size_t len) {
+    if(len != 4) { return GoAway_(FRAME_SIZE_ERROR, "WINDOW_UPDATE size"); }
+    uint32_t inc = ReadU32(payload) & 0x7fffffff;
+    if(id == 0) {
+        if(inc == 0) { return GoAway_(PROTOCOL_ERROR, "WINDOW_UPDATE 0"); }
+        connWindow_ += inc;
+        if(connWindow_ > MAX_WINDOW) { return GoAway_(FLOW_CONTROL_ERROR, "connection window overflow"); }
+        return true;
+    }
+    auto it = streams_.find(id);
+    if(it == streams_.end()) { return true; }
+    if(inc == 0) {
+        ResetStream_(id, PROTOCOL_ERROR);
+        CloseStream_(id);
+        return true;
+    }
+    it->second->window += inc;
+    if(it->second->window > MAX_WINDOW) {
+        ResetStream_(id, FLOW_CONTROL_ERROR);
+        CloseStream_(id);
+    }
+    return true;
+}
+// 只使用依赖关系和权重，不实现 exclusive 标志对依赖树的重排
+void Http2Session::OnPriority_(uint32_t id, uint32_t parent, uint16_t weight) {
+    if(parent == id) {
+        ResetStream_(id, PROTOCOL_ERROR);
+        CloseStream_(id);
+        return;
+    }
+    auto it = streams_.find(id);
+    if(it != streams_.end()) {
+        it->second->parent = parent;
+        it->second->weight = weight;
+    }
+}
+// 使用 HttpResponse 生成响应，再将 HTTP/1.1 格式的状态行和响应头转换为 HTTP/2 头部
+void Http2Session::Respond_(Stream* stream, int code) {
+    if(!stream->requestBody.empty()) {
+        stream->request.SetBody(stream->requestBody);
+        ReleaseBody_(stream);
+    }
+    handler_(stream->request, stream->response, code);
+    ChainBuffer buff;
+    stream->response.MakeResponse(buff);
+    string text = buff.RetrieveAllToStr();
+    size_t headEnd = text.find("\r\n\r\n");
+    if(headEnd == string::npos || text.size() < 12) {
+        ResetStream_(stream->id, INTERNAL_ERROR);
+        CloseStream_(stream->id);
+        return;
+    }
+    string block;
+    HpackEncoder::EncodeStatus(atoi(text.c_str() + 9), &block);  // HTTP/1.1 200 OK
+    size_t pos = text.find("\r\n") + 2;
+    while(pos < headEnd) {
+        size_t lineEnd = text.find("\r\n", pos);
+        size_t colon = text.find(':', pos);
+        if(colon != string::npos && colon < lineEnd) {
+            string name = text.substr(pos, colon - pos);
+            for(char& c : name) { c = tolower(c); }
+            size_t vb = text.find_first_not_of(" \t", colon + 1);
+            size_t ve = text.find_last_not_of(" \t", lineEnd - 1);
+            string value = (vb == string::npos || vb >= lineEnd) ? "" : text.substr(vb, ve - vb + 1);
+            // 连接相关的头部在 HTTP/2 中是禁止的
+            if(name != "connection" && name != "keep-alive") {
+                HpackEncoder::Encode(name, value, &block);
+            }
+        }
+        pos = lineEnd + 2;
+    }
+    stream->inlineBody = text.substr(headEnd + 4);
+    if(!stream->inlineBody.empty()) {
+        stream->body.push_back({ &stream->inlineBody[0], stream->inlineBody.size() });
+    }
+    for(const auto& seg : stream->response.Body()) {
+        stream->body.push_back(seg);
+    }
+    for(const auto& seg : stream->body) {
+        stream->remaining += seg.iov_len;
+    }
+    stream->responded = true;
+    SendHeaders_(stream, block, stream->remaining == 0);
+    if(stream->remaining == 0) {
+        CloseStream_(stream->id);
+    }
+}
+// header block 超过对端最大帧长度时拆分为 HEADERS + CONTINUATION
+void Http2Session::SendHeaders_(Stream* stream, const string& block, bool endStream) {
+    size_t pos = 0;
+    bool first = true;
+    do {
+        size_t n = min(block.size() - pos, peerMaxFrame_);
+        uint8_t flags = (pos + n == block.size()) ? FLAG_END_HEADERS : 0;
+        if(first && endStream) { flags |= FLAG_END_STREAM; }
+        WriteFrame_(first ? HEADERS : CONTINUATION, flags, stream->id, block.data() + pos, n);
+        pos += n;
+        first = false;
+    } while(pos < block.size());
+}
+// 按优先级与流控窗口生成 DATA 帧，writeBuff 积压超过 WRITE_HIGH_WATER 时暂停，等发送完再继续
+void Http2Session::SendData_(ChainBuffer& writeBuff) {
+    while(writeBuff.ReadableBytes() < WRITE_HIGH_WATER && connWindow_ > 0) {
+        Stream* s = PickStream_();
+        if(!s) { break; }
+        size_t n = min<size_t>(min<int64_t>(s->window, connWindow_), min(s->remaining, peerMaxFrame_));
+        bool end = (n == s->remaining);
+        WriteFrameHeader_(n, DATA, end ? FLAG_END_STREAM : 0, s->id);
+        size_t left = n;
+        while(left > 0) {
+            struct iovec& seg = s->body[s->bodyIdx];
+            size_t k = min(left, seg.iov_len);
+            writeBuff.Append(static_cast<const char*>(seg.iov_base), k);
+            seg.iov_base = static_cast<char*>(seg.iov_base) + k;
+            seg.iov_len -= k;
+            left -= k;
+            if(seg.iov_len == 0) { s->bodyIdx++; }
+        }
+        s->window -= n;
+        connWindow_ -= n;
+        s->remaining -= n;
+        // 加权公平：发送的字节数按权重折算为虚拟时间，权重越大增长越慢
+        vtime_ = s->vtime;
+        s->vtime += n * 256 / s->weight;
+        if(end) { CloseStream_(s->id); }
+    }
+}
+// 选择下一个发送 DATA 的 stream：
+// 依赖的父 stream 还有可发送的数据时先发送父 stream，其余按虚拟时间最小优先
+Http2Session::Stream* Http2Session::PickStream_() {
+    Stream* best = nullptr;
+    for(auto& kv : streams_) {
+        Stream* s = kv.second.get();
+        if(!s->responded || s->remaining == 0 || s->window <= 0) { continue; }
+        bool blocked = false;
+        uint32_t parent = s->parent;
+        for(int depth = 0; parent != 0 && depth < 32; depth++) {
+            auto it = streams_.find(parent);
+            if(it == streams_.end()) { break; }
+            Stream* p = it->second.get();
+            if(p->responded && p->remaining > 0 && p->window > 0) {
+                blocked = true;
+                break;
+            }
+            parent = p->parent;
+        }
+        if(blocked) { continue; }
+        if(!best || s->vtime < best->vtime) { best = s; }
+    }
+    return best;
+}
+
+void Http2Session::CloseStream_(uint32_t id) {
+    auto it = streams_.find(id);
+    if(it == streams_.end()) { return; }
+    ReleaseBody_(it->second.get());
+    streams_.erase(it);
+}
+
+// 缓存的请求体已交给 request 或不再需要：释放并归还它占用的连接级窗口
+void Http2Session::ReleaseBody_(Stream* stream) {
+    size_t len = stream->requestBody.size();
+    if(len == 0) { return; }
+    string().swap(stream->requestBody);
+    MemBudget::Instance()->Add(MemBudget::H2_BODY, -static_cast<int64_t>(len));
+    ReturnWindow_(len);
+}
+
+void Http2Session::ReturnWindow_(size_t len) {
+    if(len == 0) { return; }
+    recvWindow_ += len;
+    WindowUpdate_(0, len);
+}
+
+void Http2Session::WriteFrameHeader_(size_t len, uint8_t type, uint8_t flags, uint32_t id) {
+    char h[9];
+    h[0] = len >> 16;
+    h[1] = len >> 8;
+    h[2] = len;
+    h[3] = type;
+    h[4] = flags;
+    PutU32(h + 5, id & 0x7fffffff);
+    out_->Append(h, 9);
+}
+
+void Http2Session::WriteFrame_(uint8_t type, uint8_t flags, uint32_t id, const char* payload, size_t len) {
+    WriteFrameHeader_(len, type, flags, id);
+    if(len > 0) { out_->Append(payload, len); }
+}
+
+void Http2Session::WindowUpdate_(uint32_t id, uint32_t increment) {
+    char p[4];
+    PutU32(p, increment);
+    WriteFrame_(WINDOW_UPDATE, 0, id, p, 4);
+}
+// 本端 SETTINGS：最大并发 stream 数与 stream 接收窗口，随后扩大连接级接收窗口
+void Http2Session::WriteSettings_() {
+    char p[12];
+    p[0] = 0; p[1] = 3;  // MAX_CONCURRENT_STREAMS
+    PutU32(p + 2, MAX_CONCURRENT_STREAMS);
+    p[6] = 0; p[7] = 4;  // INITIAL_WINDOW_SIZE
+    PutU32(p + 8, streamRecvWindow_);
+    WriteFrame_(SETTINGS, 0, 0, p, sizeof(p));
+    WindowUpdate_(0, connRecvWindow_ - INITIAL_WINDOW);
+    recvWindow_ += connRecvWindow_ - INITIAL_WINDOW;
+}
+
+void Http2Session::ResetStream_(uint32_t id, uint32_t code) {
+    char p[4];
+    PutU32(p, code);
+    WriteFrame_(RST_STREAM, 0, id, p, 4);
+}
+
+bool Http2Session::GoAway_(uint32_t code, const char* reason) {
+    LOG_WARN("HTTP/2 GOAWAY %u: %s", code, reason);
+    char p[8];
+    PutU32(p, lastStreamId_);
+    PutU32(p + 4, code);
+    WriteFrame_(GOAWAY, 0, 0, p, 8);
+    goaway_ = fatal_ = true;
+    return false;
+}
+
+string Http2Session::Base64UrlDecode_(const string& str) {
+    string out;
+    uint32_t acc = 0;
+    int bits = 0;
+    for(char c : str) {
+        int v;
+        if(c >= 'A' && c <= 'Z') { v = c - 'A'; }
+        else if(c >= 'a' && c <= 'z') { v = c - 'a' + 26; }
+        else if(c >= '0' && c <= '9') { v = c - '0' + 52; }
+        else if(c == '-' || c == '+') { v = 62; }
+        else if(c == '_' || c == '/') { v = 63; }
+        else { continue; }  // 忽略填充 '='
+        acc = (acc << 6) | v;
+        bits += 6;
+        if(bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((acc >> bits) & 0xff));
+        }
+    }
+    return out;
+}
@@ -0,0 +1,130 @@
+#ifndef HTTP2_SESSION_H
+#define HTTP2_SESSION_H
+
+#include <map>
+#include <memory>
+#include <string>
+#include <functional>
+#include <sys/uio.h>
+
+#include "../buffer/chainbuffer.h"
+#include "../buffer/membudget.h"
+#include "../log/log.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "hpack.h"
+
+// HTTP/2 (RFC 7540) 服务端会话，一个连接上多路复用多个 stream
+// 帧的输入输出都通过连接的 readBuff_ / writeBuff_，资源查找仍由 HttpResponse 完成
+// 支持 prior-knowledge h2c、HTTP/1.1 Upgrade: h2c，以及 TLS 下的 ALPN h2
+class Http2Session {
+public:
+    // 根据请求初始化响应 (Init / SetRange 等)，与 HTTP/1.1 共用；code 非 0 时只需回复该错误码 (413)
+    typedef std::function<void(HttpRequest&, HttpResponse&, int code)> Handler;
+
+    // 请求体超过 maxBodySize 时回复 413
+    Http2Session(const Handler& handler, size_t maxBodySize);
+    ~Http2Session();
+
+    // HTTP/1.1 Upgrade: h2c 之后调用，原请求作为 stream 1 处理 (对端已半关闭)
+    void Upgrade(HttpRequest& request);
+
+    // 解析 readBuff 中完整的帧并处理，再按优先级和流控窗口生成 DATA 帧写入 writeBuff
+    // 返回 false 表示连接级错误，GOAWAY 已写入 writeBuff，发送完后应关闭连接
+    bool Process(Buffer& readBuff, ChainBuffer& writeBuff);
+
+    // 对端 GOAWAY 且没有未完成的 stream，或本端出错时为 true
+    bool IsClosing() const;
+
+    // 1: data 以完整的 preface 开头；0: data 是 preface 的前缀，需要更多数据；-1: 不是 HTTP/2
+    static int MatchPreface(const char* data, size_t len);
+
+    static const uint32_t MAX_CONCURRENT_STREAMS = 128;
+    static const int32_t INITIAL_WINDOW = 65535;        // 协议规定的初始窗口
+    static const int32_t LOCAL_WINDOW = 1 << 20;        // 本端连接级接收窗口的下限
+    static const size_t MAX_FRAME_SIZE = 16384;         // 本端接收的最大帧
+    static const size_t MAX_HEADER_BLOCK = 64 << 10;    // header block (含 CONTINUATION) 上限
+    static const size_t WRITE_HIGH_WATER = 256 << 10;   // 每次处理最多积压到 writeBuff 的字节数
+
+private:
+    enum FRAME_TYPE {
+        DATA = 0, HEADERS, PRIORITY, RST_STREAM, SETTINGS,
+        PUSH_PROMISE, PING, GOAWAY, WINDOW_UPDATE, CONTINUATION,
+    };
+    enum ERROR_CODE {
+        NO_ERROR = 0, PROTOCOL_ERROR, INTERNAL_ERROR, FLOW_CONTROL_ERROR, SETTINGS_TIMEOUT,
+        STREAM_CLOSED, FRAME_SIZE_ERROR, REFUSED_STREAM, CANCEL, COMPRESSION_ERROR,
+    };
+
+    struct Stream {
+        uint32_t id;
+        int64_t window;       // 发送窗口
+        int64_t recvWindow;   // 接收窗口的剩余部分
+        uint32_t parent;      // 依赖的 stream，0 表示根
+        uint16_t weight;      // 1 ~ 256
+        uint64_t vtime;       // 加权公平调度的虚拟时间，越小越优先
+        bool endRemote;       // 对端已发送 END_STREAM
+        bool responded;       // 已发送 HEADERS
+        HttpRequest request;
+        std::string requestBody;       // 正在接收的请求体，END_STREAM 之后交给 request
+        HttpResponse response;
+        std::string inlineBody;        // 生成在头部缓冲区中的响应体 (错误页)
+        std::vector<struct iovec> body;
+        size_t bodyIdx;
+        size_t remaining;     // 剩余待发送的响应体字节数
+    };
+
+    bool OnFrame_(uint8_t type, uint8_t flags, uint32_t id, const char* payload, size_t len);
+    bool OnHeaders_(uint8_t flags, uint32_t id, const char* payload, size_t len);
+    bool OnHeaderBlock_(uint32_t id);
+    bool OnSettings_(uint8_t flags, const char* payload, size_t len, bool ack = true);
+    bool OnWindowUpdate_(uint32_t id, const char* payload, size_t len);
+    void OnPriority_(uint32_t id, uint32_t parent, uint16_t weight);
+
+    bool OnData_(uint8_t flags, uint32_t id, const char* payload, size_t len);
+    void Respond_(Stream* stream, int code = 0);
+    void SendHeaders_(Stream* stream, const std::string& block, bool endStream);
+    void SendData_(ChainBuffer& writeBuff);
+    Stream* PickStream_();
+    void CloseStream_(uint32_t id);
+    void ReleaseBody_(Stream* stream);
+    void ReturnWindow_(size_t len);
+    void RefuseStalled_();
+
+    void WriteFrameHeader_(size_t len, uint8_t type, uint8_t flags, uint32_t id);
+    void WriteFrame_(uint8_t type, uint8_t flags, uint32_t id, const char* payload, size_t len);
+    void WindowUpdate_(uint32_t id, uint32_t increment);
+    void WriteSettings_();
+    void ResetStream_(uint32_t id, uint32_t code);
+    bool GoAway_(uint32_t code, const char* reason);
+
+    static std::string Base64UrlDecode_(const std::string& str);
+
+    Handler handler_;
+    size_t maxBodySize_;
+    int64_t streamRecvWindow_;    // 通告的 stream 接收窗口，容纳一个最大的请求体
+    int64_t connRecvWindow_;      // 通告的连接级接收窗口
+    HpackDecoder decoder_;
+    ChainBuffer* out_;            // 本次 Process 的输出缓冲区
+
+    std::map<uint32_t, std::unique_ptr<Stream>> streams_;
+    uint32_t lastStreamId_;       // 对端发起的最大 stream id
+    uint32_t continuationId_;     // 正在接收 CONTINUATION 的 stream，0 表示没有
+    uint8_t continuationFlags_;
+    uint32_t headerParent_;       // HEADERS 中携带的优先级信息
+    uint16_t headerWeight_;
+    std::string headerBlock_;
+
+    bool prefaceReceived_;
+    bool settingsSent_;
+    bool goaway_;                 // 已发送或收到 GOAWAY
+    bool fatal_;                  // 本端连接级错误
+
+    int64_t connWindow_;          // 连接级发送窗口
+    int64_t recvWindow_;          // 连接级接收窗口的剩余部分，缓存的请求体交出或丢弃后才归还
+    int32_t peerInitialWindow_;   // 对端 SETTINGS_INITIAL_WINDOW_SIZE
+    size_t peerMaxFrame_;         // 对端 SETTINGS_MAX_FRAME_SIZE
+    uint64_t vtime_;              // 当前的调度虚拟时间
+};
+
+#endif //HTTP2_SESSION_H
@@ -1,5 +1,3 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-15
@@ -8,138 +6,632 @@
 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include "httpconn.h"
 using namespace std;
 // 这三个数据都是类内静态数据，属于类，而不属于对象
 const char* HttpConn::srcDir;
 std::atomic<int> HttpConn::userCount;
 bool HttpConn::isET;  // 是否 ET 模式
-// 构造函数
+int HttpConn::maxRequests = 100;
+int HttpConn::keepAliveTimeout = 15;
+int HttpConn::headerTimeoutMS = 10000;
+int HttpConn::minRate = 1024;
+size_t HttpConn::maxRequestLine = 8 << 10;
+size_t HttpConn::maxHeaderSize = 32 << 10;
+size_t HttpConn::maxBodySize = 1 << 20;
+size_t HttpConn::maxReadBuffer = 64 << 10;
+size_t HttpConn::maxWriteBuffer = 512 << 10;
+HttpConn::Cold::Cold()
+    :
+#ifdef WITH_TLS
+      fileSegs(ArenaAllocator<HttpResponse::FileSeg>(&arena)),
+#endif
+      request(&arena), response(&arena) {
+    addr = { 0 };
+}
+// 构造函数：连接表按页构造，这里不分配冷数据
 HttpConn::HttpConn() {  
     fd_ = -1;
-    addr_ = { 0 };
     isClose_ = true;
+    iovIdx_ = 0;
+    headIovs_ = 0;
+    wantWrite_ = false;
+    headerDone_ = false;
+    requests_ = 0;
+    gen_ = 0;
+    deadline_ = 0;
+    stallStart_ = 0;
+    stallSent_ = 0;
+    stallQueued_ = 0;
+#ifdef WITH_TLS
+    ssl_ = nullptr;
+    handshaked_ = ktlsSend_ = false;
+#endif
 };
 
 HttpConn::~HttpConn() { Close(); }; // 析构函数
 
 // httpConn 初始化
-void HttpConn::init(int fd, const sockaddr_in& addr) {
+bool HttpConn::init(int fd, const sockaddr_in& addr) {
     assert(fd > 0);
+#ifdef WITH_TLS
+    // HTTPS 端口上不能退回明文
+    if(TlsContext::Instance()->IsOpen()) {
+        ssl_ = TlsContext::Instance()->NewSsl(fd);
+        if(!ssl_) {
+            LOG_ERROR("Client[%d] SSL_new error!", fd);
+            ERR_clear_error();
+            return false;
+        }
+        handshaked_ = ktlsSend_ = false;
+    }
+#endif
     userCount++;  // 原子操作
-    addr_ = addr;
+    if(!cold_) {
+        cold_.reset(new Cold);
+        iov_ = HttpResponse::Iovecs(ArenaAllocator<struct iovec>(&cold_->arena));  // 分配器随之转移
+    }
+    cold_->addr = addr;
     fd_ = fd;
+    gen_.fetch_add(1, std::memory_order_release);
     writeBuff_.RetrieveAll();  // 重置读缓存
     readBuff_.RetrieveAll();   // 重置写缓存
     isClose_ = false;
+    requests_ = 0;
+    deadline_ = NowMS_() + headerTimeoutMS;  // 从建立连接开始计算第一个请求的截止时间
+    headerDone_ = false;
+    stallStart_ = 0;
+    stallSent_ = 0;
+    stallQueued_ = 0;
+    wantWrite_ = false;
+    h2_.reset();
+    cold_->proxy.reset();
+    cold_->fcgi.reset();
+    cold_->stream.reset();
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
+    return true;
 }
 // 连接关闭
 void HttpConn::Close() {
-    response_.UnmapFile();  // response 清空共享内存
-<<<<<<< HEAD
-    if(isClose_ == false){  // 如果由于异常原因提前关闭，此时 isClose == true, 不会因为定时器超时再次调用一次
-=======
+    if(!cold_) { return; }  // 槽位从未使用过
+    gen_.fetch_add(1, std::memory_order_release);
+    readBuff_.RetrieveAll();
+    writeBuff_.RetrieveAll();
+    Release_();             // response 清空共享内存，连接槽位不再占用缓冲区
+    h2_.reset();            // 释放 HTTP/2 各 stream 的响应
+    cold_->proxy.reset();
+    cold_->fcgi.reset();
+    cold_->stream.reset();
     if(isClose_ == false){  // 如果由于非主动原因关闭，isClose == false
->>>>>>> def492361972feedee60578307251dcb6ce473b1
         isClose_ = true; 
         userCount--;  // 原子操作
+        RateLimit::Instance()->Disconnect(cold_->addr.sin_addr.s_addr);
+#ifdef WITH_TLS
+        if(ssl_) {
+            SSL_shutdown(ssl_);  // 尽力发送 close_notify，不等待对端
+            SSL_free(ssl_);
+            ssl_ = nullptr;
+        }
+#endif
+        if(stallStart_) {
+            // 对端迟迟不接收：直接复位连接，丢弃发送队列，不让内核继续慢慢发送
+            struct linger optLinger = { 1, 0 };
+            setsockopt(fd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger));
+        }
         close(fd_);
         LOG_INFO("Client[%d](%s:%d) quit, UserCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
     }
 }
 
+// 没有未处理的数据时释放读缓冲区、请求与响应占用的内存，空闲的 keep-alive 连接只保留 HttpConn 本身
+void HttpConn::Release_() {
+    readBuff_.Shrink();
+    ResetArena_();
+    cold_->arena.Release();
+}
+// 上一个请求的数据全部放弃，arena 整体回收 (保留第一块)
+// 使用 arena 的容器须先放弃存储，之后的请求重新从 arena 分配
+void HttpConn::ResetArena_() {
+    cold_->request.Release();
+    cold_->response.Release();
+    HttpResponse::Iovecs(iov_.get_allocator()).swap(iov_);
+    iovIdx_ = headIovs_ = 0;
+#ifdef WITH_TLS
+    HttpResponse::FileSegs(cold_->fileSegs.get_allocator()).swap(cold_->fileSegs);
+#endif
+    cold_->arena.Reset();
+}
+
 // 获取 Fd
 int HttpConn::GetFd() const {
     return fd_;
 };
 // 获取 addr
 struct sockaddr_in HttpConn::GetAddr() const {
-    return addr_;
+    return cold_->addr;
 }
 // 获取 IP
 const char* HttpConn::GetIP() const {
-    return inet_ntoa(addr_.sin_addr);
+    return inet_ntoa(cold_->addr.sin_addr);
 }
 // 获取 port
 int HttpConn::GetPort() const {
-    return addr_.sin_port;
+    return cold_->addr.sin_port;
 }
 
 ssize_t HttpConn::read(int* saveErrno) {
+#ifdef WITH_TLS
+    if(ssl_) { return ReadTls_(saveErrno); }
+#endif
     ssize_t len = -1;
     do {
         len = readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
+        // 对端发送过快：处理完已收到的数据后重新注册 EPOLLIN，剩余的数据仍在 socket 中，会再次触发
+        if(readBuff_.ReadableBytes() >= maxReadBuffer) {
+            MemBudget::Instance()->CountPause();
+            break;
+        }
     } while (isET);  // ET 模式需要用户处理全部读完数据
     return len;
 }
 
 ssize_t HttpConn::write(int* saveErrno) {
+    if(iovIdx_ >= iov_.size()) { return 0; }  // 没有待发送的 iov
+#ifdef WITH_TLS
+    if(ssl_) { return WriteTls_(saveErrno); }
+#endif
     ssize_t len = -1;
     do {
-        // 分散发送
-        len = writev(fd_, iov_, iovCnt_);
+        // 分散发送，从第一个未发送完的 iov 开始
+        len = writev(fd_, &iov_[iovIdx_], static_cast<int>(iov_.size() - iovIdx_));
         if(len <= 0) {
             *saveErrno = errno;
             break;
         }
+        Advance_(len);
         // 发送缓存中已经没有数据，表示数据已经传输完成
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } 
-        // 发送数据长度如果大于 Buffer 缓存(iov_[0])，则需要借助 iov_[1] 缓存
-        // 所以此时需要更新 iov_[1] 缓存目前所在的位置，以及长度信息
-        // 注意 iov_[1] 使用的内容并不会重置，而是会随着使用越来越少
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            // Buffer 缓存 (iov_[0]) 则重置
-            if(iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
+        if(ToWriteBytes() == 0) { break; }
+    } while(isET || ToWriteBytes() > 10240); // ET 模式，或待发送数据 > 10240
+    return len;
+}
+// 按已发送长度依次推进各个 iov，发送完的 iov 跳过
+// 注意前 headIovs_ 个 iov 对应 writeBuff_，需要同步 Retrieve (发送完的块随即归还)；其他分段只移动指针
+void HttpConn::Advance_(size_t len) {
+    if(stallStart_) { stallSent_ += len; }
+    while(iovIdx_ < iov_.size()) {
+        struct iovec& cur = iov_[iovIdx_];
+        size_t n = std::min(len, cur.iov_len);
+        cur.iov_base = (uint8_t*)cur.iov_base + n;
+        cur.iov_len -= n;
+        len -= n;
+#ifdef WITH_TLS
+        if(!cold_->fileSegs.empty()) { cold_->fileSegs[iovIdx_].offset += n; }
+#endif
+        if(iovIdx_ < headIovs_) {
+            writeBuff_.Retrieve(n);
+        }
+        if(cur.iov_len > 0) { break; }
+        iovIdx_++;
+    }
+    if(iovIdx_ == iov_.size()) { stallStart_ = 0; }  // 已全部发送，不再阻塞
+}
+
+bool HttpConn::CanRead() const {
+    if(writeBuff_.ReadableBytes() < maxWriteBuffer) { return true; }
+    MemBudget::Instance()->CountPause();
+    return false;
+}
+
+int64_t HttpConn::NowMS_() {
+    return CachedClock::NowMS();
+}
+
+int HttpConn::RequestTimeLeft() const {
+    if(h2_ || deadline_ == 0) { return -1; }
+    int64_t left = deadline_ - NowMS_();
+    return left > 0 ? static_cast<int>(left) : 1;
+}
+
+void HttpConn::ReplyTimeout() {
+    if(isClose_ || h2_ || deadline_ == 0 || writeBuff_.ReadableBytes() > 0 || HasGateway()) { return; }
+    static const string response = [] {
+        string body = HttpResponse::ErrorBody(408, "Request timed out!");
+        return "HTTP/1.1 408 Request Timeout\r\nConnection: close\r\nContent-type: text/html\r\n"
+               "Content-length: " + to_string(body.size()) + "\r\n\r\n" + body;
+    }();
+    LOG_INFO("Client[%d](%s) request timeout", fd_, GetIP());
+#ifdef WITH_TLS
+    if(ssl_) {
+        if(handshaked_) {
+            SSL_write(ssl_, response.data(), static_cast<int>(response.size()));
+            ERR_clear_error();
+        }
+        return;
+    }
+#endif
+    send(fd_, response.data(), response.size(), MSG_NOSIGNAL | MSG_DONTWAIT);
+}
+
+int HttpConn::SendTimeLeft() {
+    if(minRate <= 0) { return -1; }
+    int queued = 0;
+    ioctl(fd_, SIOCOUTQ, &queued);
+    int64_t now = NowMS_();
+    if(stallStart_ == 0) {
+        stallStart_ = now;
+        stallSent_ = 0;
+        stallQueued_ = queued;
+    }
+    // 按目前送达的数据量，平均速率降到 minRate 的时间
+    int64_t delivered = static_cast<int64_t>(stallSent_) + stallQueued_ - queued;
+    int64_t allowed = delivered * 1000 / minRate;
+    int64_t left = stallStart_ + (allowed > RATE_GRACE_MS ? allowed : RATE_GRACE_MS) - now;
+    return left > 0 ? static_cast<int>(left) : 0;
+}
+// 检查 readBuff_ 中的请求是否已经收齐：返回 0 表示收齐，-1 表示继续等待，
+// 其他为应回复的错误码 (400 / 408 / 411 / 413 / 414 / 431)。请求体的截止时间按 minRate 延长
+// 不解码 chunked 请求体：带 Transfer-Encoding 的请求回复 411，同时带 Content-Length 时回复 400 (请求走私)
+int HttpConn::CheckRequest_() {
+    const char* begin = readBuff_.Peek();
+    const char* end = readBuff_.BeginWriteConst();
+    int64_t now = NowMS_();
+    if(deadline_ == 0) { deadline_ = now + headerTimeoutMS; }
+    const char CRLF[] = "\r\n";
+    const char* lineEnd = search(begin, end, CRLF, CRLF + 2);
+    if(static_cast<size_t>(lineEnd - begin) > maxRequestLine) { return 414; }
+    const char BLANK[] = "\r\n\r\n";
+    const char* headerEnd = search(begin, end, BLANK, BLANK + 4);
+    if(static_cast<size_t>(headerEnd - begin) > maxHeaderSize) { return 431; }
+    if(headerEnd != end) {
+        size_t bodyLen = 0;
+        bool hasLength = false, hasEncoding = false;
+        // 只找 Content-Length 与 Transfer-Encoding，其余头部由 HttpRequest 解析
+        for(const char* p = lineEnd + 2; p < headerEnd; ) {
+            const char* next = search(p, headerEnd + 2, CRLF, CRLF + 2);
+            if(next - p > 15 && strncasecmp(p, "Content-Length:", 15) == 0) {
+                bodyLen = strtoull(p + 15, nullptr, 10);
+                hasLength = true;
+            } else if(next - p > 18 && strncasecmp(p, "Transfer-Encoding:", 18) == 0) {
+                hasEncoding = true;
             }
+            p = next + 2;
+        }
+        if(hasEncoding) { return hasLength ? 400 : 411; }
+        if(bodyLen > maxBodySize) { return 413; }
+        if(!headerDone_) {
+            headerDone_ = true;
+            if(minRate > 0) { deadline_ += bodyLen * 1000 / minRate; }
         }
-        // 如果发送长度 Buffer 缓存足够，使用它即可
-        else {
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
+        if(static_cast<size_t>(end - headerEnd - 4) >= bodyLen) { return 0; }
+    }
+    return now >= deadline_ ? 408 : -1;
+}
+
+#ifdef WITH_TLS
+// TLS 读：先完成握手，之后一直读到 WANT_READ
+// 无论 ET 还是 LT 都要读完，因为 OpenSSL 内部缓存的数据不会再触发 epoll 事件
+ssize_t HttpConn::ReadTls_(int* saveErrno) {
+    wantWrite_ = false;
+    if(!handshaked_) {
+        int ret = SSL_do_handshake(ssl_);
+        if(ret != 1) {
+            int err = SSL_get_error(ssl_, ret);
+            if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+                wantWrite_ = (err == SSL_ERROR_WANT_WRITE);
+                *saveErrno = EAGAIN;
+            } else {
+                LOG_WARN("Client[%d] TLS handshake error: %d", fd_, err);
+                *saveErrno = EPROTO;
+            }
+            ERR_clear_error();
+            return -1;
         }
-    } while(isET || ToWriteBytes() > 10240); // ET 模式，也两个缓冲区大小 > 10240
+        handshaked_ = true;
+        ktlsSend_ = BIO_get_ktls_send(SSL_get_wbio(ssl_));
+        LOG_DEBUG("Client[%d] TLS %s, resumed: %d, ktls: %d", fd_, SSL_get_version(ssl_), 
+                  SSL_session_reused(ssl_), ktlsSend_);
+        if(TlsContext::IsHttp2(ssl_)) { StartHttp2_(); }  // ALPN 协商为 h2
+    }
+    ssize_t total = 0;
+    while(true) {
+        readBuff_.EnsureWriteable(4096);
+        int len = SSL_read(ssl_, readBuff_.BeginWrite(), static_cast<int>(readBuff_.WritableBytes()));
+        if(len > 0) {
+            readBuff_.HasWritten(len);
+            total += len;
+            // OpenSSL 内部没有缓存的记录时才能停止，剩余数据仍在 socket 中
+            if(readBuff_.ReadableBytes() >= maxReadBuffer && !SSL_has_pending(ssl_)) {
+                MemBudget::Instance()->CountPause();
+                *saveErrno = EAGAIN;
+                return total;
+            }
+            continue;
+        }
+        int err = SSL_get_error(ssl_, len);
+        ERR_clear_error();
+        if(err == SSL_ERROR_WANT_READ || err == SSL_ERROR_WANT_WRITE) {
+            *saveErrno = EAGAIN;
+            return total > 0 ? total : -1;
+        }
+        *saveErrno = (err == SSL_ERROR_ZERO_RETURN) ? 0 : EPROTO;  // 对端关闭或出错
+        return total > 0 ? total : (err == SSL_ERROR_ZERO_RETURN ? 0 : -1);
+    }
+}
+// TLS 写：每个 iov 分别加密发送
+// 开启 kTLS 时，文件分段使用 SSL_sendfile (内核加密 + sendfile)，内存分段仍用 SSL_write
+ssize_t HttpConn::WriteTls_(int* saveErrno) {
+    ssize_t len = -1;
+    do {
+        const struct iovec& cur = iov_[iovIdx_];
+        const HttpResponse::FileSeg& seg = cold_->fileSegs[iovIdx_];
+        if(ktlsSend_ && seg.fd >= 0) {
+            len = SSL_sendfile(ssl_, seg.fd, seg.offset, cur.iov_len, 0);
+        } else {
+            len = SSL_write(ssl_, cur.iov_base, static_cast<int>(cur.iov_len));
+        }
+        if(len <= 0) {
+            int err = SSL_get_error(ssl_, static_cast<int>(len));
+            ERR_clear_error();
+            *saveErrno = (err == SSL_ERROR_WANT_WRITE || err == SSL_ERROR_WANT_READ) ? EAGAIN : EPIPE;
+            len = -1;
+            break;
+        }
+        Advance_(len);
+        if(ToWriteBytes() == 0) { break; }
+    } while(isET || ToWriteBytes() > 10240);
+    return len;
+}
+#endif
+
+size_t HttpConn::ToWriteBytes() const {
+    size_t len = 0;
+    for(size_t i = iovIdx_; i < iov_.size(); i++) {
+        len += iov_[i].iov_len;
+    }
     return len;
 }
+// 按照 request 解析结果初始化 response，HTTP/1.1 与 HTTP/2 共用
+// 按路由匹配结果初始化响应：静态文件 (可能改写路径)、注册的处理函数，或 405
+// 代理 / FastCGI 只转发 HTTP/1.1 的请求，在 process 中交给后端；有这类路由时 ALPN 不提供 h2，也不接受 Upgrade: h2c，
+// 只有 prior-knowledge h2c 的请求会到这里，回复 421，客户端可以改用 HTTP/1.1 的连接重试
+void HttpConn::InitResponse_(HttpRequest& request, HttpResponse& response, const RouteMatch& match) {
+    const Route* route = match.route;
+    // 达到请求数上限的 HTTP/1 连接在本次响应后关闭
+    bool keepAlive = request.IsKeepAlive() && (h2_ || requests_ < maxRequests);
+    if(route && (route->type == Route::PROXY || route->type == Route::FASTCGI)) {
+        response.Init(srcDir, request.PathRef(), keepAlive, 421);
+        response.SetContent(HttpResponse::ErrorBody(421, "Use HTTP/1.1 for this path!"), "text/html");
+        return;
+    }
+    if(route && route->localOnly && cold_->addr.sin_addr.s_addr != htonl(INADDR_LOOPBACK)) {
+        route = nullptr;
+    }
+    if(!route && match.badMethod) {
+        response.Init(srcDir, request.PathRef(), keepAlive, 405);
+        response.SetContent(HttpResponse::ErrorBody(405, "Method Not Allowed!"), "text/html");
+        return;
+    }
+    StrRef path = (route && !route->file.empty()) ? StrRef(route->file) : StrRef(match.path, match.pathLen);
+    response.Init(srcDir, path, keepAlive, 200);
+    response.SetRange(request.HeaderRef("Range"), request.HeaderRef("If-Range"));
+    if(route && route->type == Route::HANDLER) {
+        if(route->cacheTtl == 0 || !MicroCache::Instance()->Serve(*route, request, response, srcDir)) {
+            route->handler(request, response, match);
+        }
+#ifdef WITH_GZIP
+        Compress_(request, response);
+#endif
+    }
+}
+#ifdef WITH_GZIP
+// 处理函数生成的内存响应：小响应整体压缩 (共享的响应体缓存压缩结果)，大响应转为流式逐段压缩
+// HTTP/2 不支持流式响应，大响应不压缩
+void HttpConn::Compress_(HttpRequest& request, HttpResponse& response) {
+    if(!response.HasContent() || response.GetStream() || response.Code() != 200) { return; }
+    const string type = response.ContentType();
+    size_t size = response.Content().size();
+    if(size < Gzip::MIN_SIZE || !HttpResponse::Compressible(type) || !Gzip::Instance()->Accepted(request)) {
+        return;
+    }
+    shared_ptr<const string> body = response.SharedContent();
+    shared_ptr<const string> gz = body ? Gzip::Instance()->Find(body) : nullptr;
+    if(!gz && size <= Gzip::INLINE_MAX) {
+        gz = Gzip::Instance()->Compress(response.Content());
+        if(gz && body) { Gzip::Instance()->Insert(body, gz); }
+    }
+    if(gz) {
+        response.SetContent(gz, type);
+        response.SetEncoding("gzip");
+        return;
+    }
+    if(h2_ || size <= Gzip::INLINE_MAX) { return; }
+    bool shared = body != nullptr;
+    if(!shared) { body = make_shared<const string>(response.Content()); }
+    shared_ptr<ResponseStream> stream = ResponseStream::Start(request, response, type);
+    if(shared) {
+        stream->CacheAs(body);  // 来自微缓存，压缩结果可以复用
+    }
+    stream->Write(*body);
+    stream->End();
+}
+#endif
+
+void HttpConn::StartHttp2_() {
+    // 多路复用的小帧 (WINDOW_UPDATE / HEADERS) 不能被 Nagle 延迟
+    int nodelay = 1;
+    setsockopt(fd_, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    h2_.reset(new Http2Session([this](HttpRequest& request, HttpResponse& response, int code) {
+        if(code) {
+            LOG_WARN("Client[%d](%s) HTTP/2 request rejected: %d", fd_, GetIP(), code);
+            response.Init(srcDir, request.PathRef(), false, code);
+            response.SetContent(HttpResponse::ErrorBody(code, "Request rejected!"), "text/html");
+            return;
+        }
+        if(!RateLimit::Instance()->Acquire(cold_->addr.sin_addr.s_addr)) {
+            response.Init(srcDir, request.PathRef(), false, 429);
+            response.SetContent(HttpResponse::ErrorBody(429, "Too many requests!"), "text/html");
+            return;
+        }
+        RouteMatch match;
+        Router::Instance()->Match(request.MethodRef(), request.PathRef(), &match);
+        InitResponse_(request, response, match);
+        // HTTP/2 的响应由会话整体生成，不支持流式响应
+        if(response.GetStream()) {
+            response.GetStream()->Abort();
+            response.Init(srcDir, request.PathRef(), false, 501);
+            response.SetContent(HttpResponse::ErrorBody(501, "Streaming is not supported over HTTP/2!"), "text/html");
+        }
+    }, maxBodySize));
+    LOG_DEBUG("Client[%d] switch to HTTP/2", fd_);
+}
+// HTTP/2 的帧全部写入 writeBuff_，iov_ 只包含 writeBuff_ 的各块
+// 没有待发送的数据时返回 false，继续等待读事件
+bool HttpConn::ProcessHttp2_() {
+    h2_->Process(readBuff_, writeBuff_);
+    SetWriteIov_();
+    return writeBuff_.ReadableBytes() > 0;
+}
+// 只发送 writeBuff_ 中的数据 (HTTP/2 帧、代理转发的响应)
+void HttpConn::SetWriteIov_() {
+    iov_.clear();
+    iovIdx_ = 0;
+    headIovs_ = writeBuff_.AppendIov(iov_);
+#ifdef WITH_TLS
+    if(ssl_) {
+        cold_->fileSegs.assign(headIovs_, { -1, 0 });
+    }
+#endif
+}
+
+int HttpConn::PullGateway(int* resumeFd) {
+    assert(HasGateway());
+    Gateway* gateway = cold_->proxy ? static_cast<Gateway*>(cold_->proxy.get()) :
+                       cold_->fcgi ? static_cast<Gateway*>(cold_->fcgi.get()) : cold_->stream.get();
+    int state = gateway->Drain(writeBuff_, resumeFd);
+    if(state == Gateway::DRAIN_BAD_GATEWAY || state == Gateway::DRAIN_GATEWAY_TIMEOUT) {
+        EndGateway();
+        bool timeout = state == Gateway::DRAIN_GATEWAY_TIMEOUT;
+        int code = timeout ? 504 : 502;
+        cold_->response.Init(srcDir, cold_->request.PathRef(), cold_->request.IsKeepAlive(), code);
+        cold_->response.SetContent(HttpResponse::ErrorBody(code, timeout ? "Upstream timed out!" : "Upstream unavailable!"), "text/html");
+        cold_->response.MakeResponse(writeBuff_);
+        SetWriteIov_();
+        for(const auto& seg : cold_->response.Body()) {
+            iov_.push_back(seg);
+        }
+#ifdef WITH_TLS
+        if(ssl_) {
+            for(const auto& seg : cold_->response.BodyFiles()) {
+                cold_->fileSegs.push_back(seg);
+            }
+        }
+#endif
+        return state;
+    }
+    SetWriteIov_();
+    return state;
+}
 // HttpConn 处理流程
 bool HttpConn::process() {
-    request_.Init();  // request 操作初始化
-    // 看是否读入 request
+    ResetArena_();  // 上一个请求已经发送完
+    if(h2_) {
+        return ProcessHttp2_();
+    }
+    // 看是否读入 request，没有时连接空闲
     if(readBuff_.ReadableBytes() <= 0) {
+        Release_();
+        return false;
+    }
+    uint64_t allocs = AllocCount::Calls();
+    // 以 HTTP/2 connection preface 开头：prior-knowledge h2c
+    int preface = Http2Session::MatchPreface(readBuff_.Peek(), readBuff_.ReadableBytes());
+    if(preface == 0) {
+        return false;
+    } else if(preface == 1) {
+        StartHttp2_();
+        return ProcessHttp2_();
+    }
+    // 请求收齐后才解析；超过大小限制或截止时间时回复错误，之后关闭连接
+    int code = CheckRequest_();
+    if(code < 0) {
         return false;
     }
+    deadline_ = 0;
+    headerDone_ = false;
+    if(code == 0 && !RateLimit::Instance()->Acquire(cold_->addr.sin_addr.s_addr)) {
+        // 请求过多：直接发送预先生成的 429，之后关闭连接
+        readBuff_.RetrieveAll();
+        cold_->response.UnmapFile();
+        writeBuff_.Append(RateLimit::RESPONSE_429, strlen(RateLimit::RESPONSE_429));
+        SetWriteIov_();
+        return true;
+    }
     // 解析 request 请求，并且解析成功
-    else if(request_.parse(readBuff_)) {
-        LOG_DEBUG("%s", request_.path().c_str());
+    requests_++;
+    if(code > 0) {
+        LOG_WARN("Client[%d](%s) request rejected: %d", fd_, GetIP(), code);
+        readBuff_.RetrieveAll();
+        cold_->response.Init(srcDir, cold_->request.PathRef(), false, code);
+        cold_->response.SetContent(HttpResponse::ErrorBody(code, "Request rejected!"), "text/html");
+    } else if(cold_->request.parse(readBuff_)) {
+        LOG_DEBUG("%s", cold_->request.PathRef().data);
+        // 一次路由匹配决定由谁处理：代理 / FastCGI 路由交给后端，由 WebServer 发起
+        RouteMatch match;
+        Router::Instance()->Match(cold_->request.MethodRef(), cold_->request.PathRef(), &match);
+        if(match.route && match.route->type == Route::PROXY) {
+            cold_->proxy = std::make_shared<ProxyConn>(match.route->upstream, cold_->request, GetIP());
+            SetWriteIov_();
+            return true;
+        }
+        if(match.route && match.route->type == Route::FASTCGI) {
+            cold_->fcgi = std::make_shared<FcgiRequest>(match.route->fcgi, cold_->request, GetIP());
+            SetWriteIov_();
+            return true;
+        }
+        // Upgrade: h2c，回复 101 后该请求作为 HTTP/2 的 stream 1 响应
+        // 有代理 / FastCGI 路由时不升级，否则该连接上之后的这类请求无法转发
+        bool upgrade = !Router::Instance()->HasGateway();
+#ifdef WITH_TLS
+        upgrade = upgrade && (ssl_ == nullptr);
+#endif
+        if(upgrade && cold_->request.HeaderRef("Upgrade") == "h2c" && !cold_->request.HeaderRef("HTTP2-Settings").Empty()) {
+            writeBuff_.Append("HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n");
+            StartHttp2_();
+            h2_->Upgrade(cold_->request);
+            return ProcessHttp2_();
+        }
         // 按照 request 解析结果，初始化 response 消息
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        InitResponse_(cold_->request, cold_->response, match);
     } else {
         // 初始化 response 消息（bad request 消息）
-        response_.Init(srcDir, request_.path(), false, 400);
+        cold_->response.Init(srcDir, cold_->request.PathRef(), false, 400);
     }
+    readBuff_.Shrink();  // 大请求之后缩小读缓冲区
+    cold_->response.SetKeepAlive(keepAliveTimeout, maxRequests - requests_);
     // 根据 request 结果，拼接相应的 response 结果，放入 writeBuff_ 中
-    response_.MakeResponse(writeBuff_);
-    // response 头部信息：stateLine、Header 存入 iov_[0] 中
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
-
-    // content 中文件内容存入 iov_[1]
-    // content 文件内容起初存在一个共享内存中
-    if(response_.FileLen() > 0  && response_.File()) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
-    }
-    LOG_DEBUG("filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
+    cold_->response.MakeResponse(writeBuff_);
+    cold_->stream = cold_->response.GetStream();  // 流式响应：先发送响应头，之后由 WebServer 取出响应体
+    // response 头部信息：stateLine、Header 所在的各块存入 iov_ 开头
+    SetWriteIov_();
+
+    // content 文件内容 (共享内存中的一个或多个分段) 依次存入其后
+    for(const auto& seg : cold_->response.Body()) {
+        iov_.push_back(seg);
+    }
+#ifdef WITH_TLS
+    if(ssl_) {
+        for(const auto& seg : cold_->response.BodyFiles()) {
+            cold_->fileSegs.push_back(seg);
+        }
+    }
+#endif
+    LOG_DEBUG("filesize:%d, %d  to %d", cold_->response.BodyLen() , iov_.size(), ToWriteBytes());
+    // 静态文件响应从解析到生成 iov 期间的全局分配次数 (ALLOC_DEBUG)
+    if(!cold_->response.HasContent() && cold_->response.Code() == 200) {
+        AllocCount::Record(AllocCount::Calls() - allocs);
+    }
     return true;
-}
+}
\ No newline at end of file
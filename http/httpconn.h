@@ -1,33 +1,49 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-15
  * @copyleft Apache 2.0
  */ 
 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef HTTP_CONN_H
 #define HTTP_CONN_H
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
 #include <arpa/inet.h>   // sockaddr_in
+#include <netinet/tcp.h> // TCP_NODELAY
+#include <sys/ioctl.h>
+#include <linux/sockios.h> // SIOCOUTQ
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <vector>
+#include <memory>
+#include <atomic>
 
+#include "../timer/cachedclock.h"
 #include "../log/log.h"
 #include "../buffer/buffer.h"
+#include "../buffer/chainbuffer.h"
+#include "../buffer/arena.h"
+#include "../buffer/alloccount.h"
 #include "httprequest.h"
 #include "httpresponse.h"
-
-class HttpConn {
+#include "http2session.h"
+#include "proxyconn.h"
+#include "fastcgi.h"
+#include "microcache.h"
+#include "ratelimit.h"
+#include "tls.h"
+#include "../timer/timewheel.h"
+
+// 连接表中按 fd 连续存放 (见 WebServer)，对象本身只保存热数据，请求与响应等冷数据单独分配
+class alignas(64) HttpConn {
 public:
     HttpConn();
 
     ~HttpConn();
 
-    void init(int sockFd, const sockaddr_in& addr);
+    // 创建 TLS 会话失败时返回 false，连接不可用，fd 由调用者关闭
+    bool init(int sockFd, const sockaddr_in& addr);
 
     ssize_t read(int* saveErrno);
 
@@ -45,33 +61,157 @@ public:
     
     bool process();
 
-    int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+    size_t ToWriteBytes() const;
+
+    bool WantWrite() const {  // TLS 握手需要等待 socket 可写
+        return wantWrite_;
+    }
+
+    bool IsClosed() const {
+        return isClose_;
     }
 
+    bool IsResident() const {
+        return cold_->response.IsResident();
+    }
+
+    std::function<void()> PrefetchTask() const {
+        return cold_->response.PrefetchTask();
+    }
+
+    // 每次 init / Close 递增，异步任务据此判断完成时槽位是否仍是同一个连接
+    uint32_t Generation() const {
+        return gen_.load(std::memory_order_acquire);
+    }
+
+    // HTTP/1 连接处理完 maxRequests 个请求后关闭
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        if(h2_) { return !h2_->IsClosing(); }
+        if(requests_ >= maxRequests) { return false; }
+        if(cold_->proxy) { return cold_->proxy->KeepAlive(); }
+        if(cold_->fcgi) { return cold_->fcgi->KeepAlive(); }
+        if(cold_->stream) { return cold_->stream->KeepAlive(); }
+        return cold_->request.IsKeepAlive();
+    }
+
+    int Requests() const {  // 已处理的请求数
+        return requests_;
+    }
+
+    TimerNode* Timer() {  // 连接的超时定时器，由 WebServer 的时间轮管理
+        return &timer_;
+    }
+
+    // 正在接收请求 (包括新连接的第一个请求) 时距截止时间的毫秒数，否则返回 -1
+    int RequestTimeLeft() const;
+    // 超时关闭之前调用：正在接收请求时尽力发送 408 (只尝试一次非阻塞写)
+    void ReplyTimeout();
+    // 发送被对端阻塞时调用，返回距发送截止时间的毫秒数，0 表示对端接收过慢，-1 表示不限制
+    // 阻塞超过 RATE_GRACE_MS 后，对端实际收到的数据 (不含 socket 发送队列) 平均速率不得低于 minRate
+    int SendTimeLeft();
+
+    bool IsHttp2() const {  // HTTP/2 连接需要同时关注读写事件
+        return h2_ != nullptr;
+    }
+    // 写缓冲区积压超过 maxWriteBuffer 时暂停读取 (HTTP/2 发送期间不再注册 EPOLLIN)，对端取走数据后恢复
+    bool CanRead() const;
+
+    // 反向代理 / FastCGI：process() 匹配到对应路由时创建，响应由后端生成
+    // 流式响应：处理函数调用 ResponseStream::Start 后，响应体由处理函数逐步产生
+    std::shared_ptr<ProxyConn> GetProxy() const {
+        return cold_->proxy;
+    }
+    std::shared_ptr<FcgiRequest> GetFcgi() const {
+        return cold_->fcgi;
+    }
+    std::shared_ptr<ResponseStream> GetStream() const {
+        return cold_->stream;
+    }
+    bool HasGateway() const {
+        return cold_->proxy || cold_->fcgi || cold_->stream;
+    }
+    // 取出后端已收到的数据放入 writeBuff_，返回 Gateway::DRAIN_STATE
+    // 后端尚未返回任何数据就出错时改为发送 502
+    int PullGateway(int* resumeFd);
+    void EndGateway() {
+        cold_->proxy.reset();
+        cold_->fcgi.reset();
+        cold_->stream.reset();
     }
 
     static bool isET;
     static const char* srcDir;
+    static int maxRequests;       // 每个 HTTP/1 连接最多处理的请求数
+    static int keepAliveTimeout;  // 响应头中提示的空闲超时 (秒)
+    static int headerTimeoutMS;   // 请求行与头部须在该时间内收齐
+    static int minRate;           // 请求体与响应的最低平均速率 (字节/秒)，0 表示不限制
+    static size_t maxRequestLine; // 超过时回复 414
+    static size_t maxHeaderSize;  // 请求行与头部的总大小，超过时回复 431
+    static size_t maxBodySize;    // Content-Length 超过时回复 413
+    static size_t maxReadBuffer;  // 读缓冲区中未处理的数据超过该大小后，本次不再继续读取
+    static size_t maxWriteBuffer; // 写缓冲区积压的上限
+    static const int RATE_GRACE_MS = 5000;
     static std::atomic<int> userCount;  // 静态变量，其++,--操作为原子操作
     
 private:
-   
+    void Advance_(size_t len);
+    void Release_();
+    void ResetArena_();
+    int CheckRequest_();
+    static int64_t NowMS_();
+    void InitResponse_(HttpRequest& request, HttpResponse& response, const RouteMatch& match);
+#ifdef WITH_GZIP
+    void Compress_(HttpRequest& request, HttpResponse& response);
+#endif
+    void StartHttp2_();
+    bool ProcessHttp2_();
+    void SetWriteIov_();
+#ifdef WITH_TLS
+    ssize_t ReadTls_(int* saveErrno);
+    ssize_t WriteTls_(int* saveErrno);
+#endif
+
+    // 冷数据：只在处理请求时用到，连接槽位第一次使用时单独分配，之后随槽位复用
+    struct Cold {
+        Cold();
+        struct sockaddr_in addr;
+        Arena arena;  // 请求级的分配区：请求、响应与 iov_ 使用，处理下一个请求前 Reset
+#ifdef WITH_TLS
+        HttpResponse::FileSegs fileSegs;  // 与 iov_ 一一对应的文件位置
+#endif
+        HttpRequest request;
+        HttpResponse response;
+        std::shared_ptr<ProxyConn> proxy;  // 非空表示当前请求由上游处理
+        std::shared_ptr<FcgiRequest> fcgi; // 非空表示当前请求由 FastCGI 后端处理
+        std::shared_ptr<ResponseStream> stream;  // 非空表示响应体由处理函数逐步产生
+    };
+
+    // 热数据：主线程分发事件与 worker 收发数据时访问，按 cache line 对齐，排在前面的最常用
     int fd_;
-    struct  sockaddr_in addr_;
-
     bool isClose_;
-    
-    int iovCnt_;
-    struct iovec iov_[2];
+    bool wantWrite_;
+    bool headerDone_;    // 截止时间已按请求体长度延长
+#ifdef WITH_TLS
+    bool handshaked_;
+    bool ktlsSend_;   // 内核负责加密 (kTLS)，文件内容可以直接 sendfile
+    SSL* ssl_;
+#endif
+    int requests_;
+    std::atomic<uint32_t> gen_;
+    int64_t deadline_;   // 当前请求的截止时间，0 表示没有正在接收的请求
+    TimerNode timer_;
+    std::unique_ptr<Http2Session> h2_;  // 非空表示连接已切换为 HTTP/2
+    std::unique_ptr<Cold> cold_;
+    int64_t stallStart_; // 发送被对端阻塞的开始时间，0 表示未阻塞
+    uint64_t stallSent_; // 阻塞以来写入 socket 的字节数
+    int stallQueued_;    // 阻塞开始时 socket 发送队列中的字节数
+
+    size_t iovIdx_;                 // 当前待发送的第一个 iov 下标
+    size_t headIovs_;
+    HttpResponse::Iovecs iov_;      // 前 headIovs_ 个为 writeBuff_ 的各块 (响应头等)，其后为响应体各分段
     
     Buffer readBuff_; // 读缓冲区
-    Buffer writeBuff_; // 写缓冲区
-
-    HttpRequest request_;
-    HttpResponse response_;
+    ChainBuffer writeBuff_; // 写缓冲区
 };
 
 
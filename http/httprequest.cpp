@@ -1,5 +1,3 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-26
@@ -8,24 +6,57 @@
 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include "httprequest.h"
 using namespace std;
 
-const unordered_set<string> HttpRequest::DEFAULT_HTML{"/index"}; // 目前只复现了一个
+HttpRequest::HttpRequest(Arena* arena)
+    : own_(arena ? nullptr : new Arena), arena_(arena ? arena : own_.get()),
+      header_(ArenaAllocator<Header>(arena_)) {
+    Init();
+}
+
+HttpRequest::HttpRequest(const HttpRequest& other)
+    : own_(new Arena), arena_(own_.get()), header_(ArenaAllocator<Header>(arena_)) {
+    Init();
+    CopyFrom_(other);
+}
+
+HttpRequest& HttpRequest::operator=(const HttpRequest& other) {
+    if(this != &other) {
+        Init();
+        CopyFrom_(other);
+    }
+    return *this;
+}
+// 各字段复制到本对象的 arena
+void HttpRequest::CopyFrom_(const HttpRequest& other) {
+    state_ = other.state_;
+    method_ = arena_->Copy(other.method_);
+    path_ = arena_->Copy(other.path_);
+    version_ = arena_->Copy(other.version_);
+    body_ = arena_->Copy(other.body_);
+    header_.reserve(other.header_.size());
+    for(const auto& h : other.header_) {
+        header_.push_back({ arena_->Copy(h.name), arena_->Copy(h.value) });
+    }
+}
 
+// 共用的 arena 由所有者 Reset，这里只放弃 header_ 的存储；自己的 Arena 直接 Reset
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    method_ = path_ = version_ = body_ = StrRef();
     state_ = REQUEST_LINE;  // Line 有限状态机 从 REQUEST_LINE 状态开始
-    header_.clear();
+    Headers(ArenaAllocator<Header>(arena_)).swap(header_);
+    if(own_) { own_->Reset(); }
     // post_.clear();
 }
+void HttpRequest::Release() {
+    Init();
+    if(own_) { own_->Release(); }
+}
 // 判断是否保持连接
 bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) { // keep-alive 保持连接选项, 且需要 HTTP 1.1 版本支持
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
-    }
-    return false;
+    // keep-alive 保持连接选项, 且需要 HTTP 1.1 版本支持
+    return HeaderRef("Connection") == "keep-alive" && version_ == "1.1";
 }
 
 bool HttpRequest::parse(Buffer& buff) {
@@ -37,30 +68,21 @@ bool HttpRequest::parse(Buffer& buff) {
     while(buff.ReadableBytes() && state_ != FINISH) {
         // [readPos_ write_Pos)中查找第一次出现 CRLF 的位置，每次按照行读取。
         const char* lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2);
-        // 取出该行。
-        std::string line(buff.Peek(), lineEnd);
+        // 取出该行复制到 arena，之后在副本上原地切分
+        size_t len = lineEnd - buff.Peek();
+        char* line = const_cast<char*>(arena_->Copy(buff.Peek(), len).data);
         switch(state_)  // 状态转移
         {
         // 初始状态从 REQUEST_LINE 开始
+        // 成功后，会有状态转移： REQUEST_LINE --> HEADERS
         case REQUEST_LINE:
-            // 通过正则表达式解析 request 并将其对应的元素分组
-            // 成功后，会有状态转移： REQUEST_LINE --> HEADERS
-            if(!ParseRequestLine_(line)) {
+            if(!ParseRequestLine_(line, len)) {
                 return false;
             }
-            // 解析请求资源 name
-            ParsePath_();
             break;
         // 请求行解析完成后，进一步解析 header    
         case HEADERS:
-            ParseHeader_(line);
-            // 如果可读空间不足，说明没有解析内容了
-            if(buff.ReadableBytes() <= 2) {
-                state_ = FINISH;
-            }
-            break;
-        case BODY:
-            ParseBody_(line);
+            ParseHeader_(line, len);
             break;
         default:
             break;
@@ -70,53 +92,48 @@ bool HttpRequest::parse(Buffer& buff) {
         // Buffer 清除解析后的行并连同清除 CRLF
         // 该过程中 readPos 会移动到 CRLF 后第一个位置
         buff.RetrieveUntil(lineEnd + 2);
+        // 空行之后按 Content-Length 取出请求体，其后的数据属于下一个请求
+        if(state_ == BODY) {
+            size_t bodyLen = min(static_cast<size_t>(strtoull(HeaderRef("Content-Length").data, nullptr, 10)),
+                                 buff.ReadableBytes());
+            ParseBody_(buff.Peek(), bodyLen);
+            buff.Retrieve(bodyLen);
+        }
     }
-    LOG_DEBUG("[%s], [%s], [%s]", method_.c_str(), path_.c_str(), version_.c_str());
+    LOG_DEBUG("[%s], [%s], [%s]", method_.data, path_.data, version_.data);
     return true;
 }
 
-void HttpRequest::ParsePath_() {
-    // 只复现了首页, 另外可以测试一下状态码页面
-    if(path_ == "/") {
-        path_ = "/welcome.html"; 
-    }
-    else if (path_ == "/400") {
-        path_ += ".html"; 
-    }
-    else if (path_ == "/403") {
-        path_ += ".html"; 
-    }
-    else if (path_ == "/404") {
-        path_ += ".html"; 
-    }
-}
-
-bool HttpRequest::ParseRequestLine_(const string& line) {
-    // 匹配字符串： |任意非空 http(s):任意非空 HTTP/任意非空|   --> 三个group ()  ()  ()
-    // 例子：       GET / HTTP/1.1
-    // 例子：       GET /404 HTTP/1.1
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); // 正则表达式解析请求行
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   
-        method_ = subMatch[1];    // 请求方法 
-        path_ = subMatch[2];      // URL
-        version_ = subMatch[3];   // HTTP 版本号
-        state_ = HEADERS;         // 状态转移
+// 请求行：|任意非空格 任意非空格 HTTP/任意非空格|
+// 例子：    GET / HTTP/1.1
+// 例子：    GET /404 HTTP/1.1
+// 分隔的空格改为 '\0'，各字段都以 '\0' 结尾
+bool HttpRequest::ParseRequestLine_(char* line, size_t len) {
+    char* end = line + len;
+    char* sp1 = static_cast<char*>(memchr(line, ' ', len));
+    char* sp2 = sp1 ? static_cast<char*>(memchr(sp1 + 1, ' ', end - sp1 - 1)) : nullptr;
+    if(sp2 && end - sp2 > 5 && memcmp(sp2 + 1, "HTTP/", 5) == 0 && !memchr(sp2 + 6, ' ', end - sp2 - 6)) {
+        *sp1 = *sp2 = '\0';
+        method_ = StrRef(line, sp1 - line);        // 请求方法 
+        path_ = StrRef(sp1 + 1, sp2 - sp1 - 1);    // URL
+        version_ = StrRef(sp2 + 6, end - sp2 - 6); // HTTP 版本号
+        state_ = HEADERS;                          // 状态转移
         return true;
     }
     LOG_ERROR("RequestLine Error");
     return false;
 }
 
-void HttpRequest::ParseHeader_(const string& line) {
-    // 匹配字符串： |(任意非:):0个或1个空白字符(任意字符)|  --> 两个group () ()
-    // 例子：       connection: keep-alive
-    // 例子：       Host: 8.8.8.8
-    regex patten("^([^:]*): ?(.*)$"); // 正则表达式解析请求头
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        // 使用 hashmap 按照 KV 存储了对应关系
-        header_[subMatch[1]] = subMatch[2];
+// 请求头：|(任意非:):0个或1个空格(任意字符)|
+// 例子：    connection: keep-alive
+// 例子：    Host: 8.8.8.8
+void HttpRequest::ParseHeader_(char* line, size_t len) {
+    char* colon = static_cast<char*>(memchr(line, ':', len));
+    if(colon) {
+        *colon = '\0';
+        char* value = colon + 1;
+        if(*value == ' ') { value++; }
+        SetHeader_(StrRef(line, colon - line), StrRef(value, line + len - value));
     }
     // header 已经解析完了，状态转移：HEADERS --> BODY
     else {
@@ -124,27 +141,70 @@ void HttpRequest::ParseHeader_(const string& line) {
     }
 }
 
-void HttpRequest::ParseBody_(const string& line) {
-    body_ = line;
+void HttpRequest::ParseBody_(const char* data, size_t len) {
+    body_ = arena_->Copy(data, len);
     // ParsePost_();   // 没有复现 Post
     state_ = FINISH;   // 状态结束
-    LOG_DEBUG("Body:%s, len:%d", line.c_str(), line.size());
+    LOG_DEBUG("Body:%s, len:%d", body_.data, len);
+}
+// 重复的头部以后者为准
+void HttpRequest::SetHeader_(const StrRef& name, const StrRef& value) {
+    for(auto& h : header_) {
+        if(h.name.EqualsIgnoreCase(name)) {
+            h.value = value;
+            return;
+        }
+    }
+    if(header_.empty()) { header_.reserve(16); }  // 一般的请求不再扩容
+    header_.push_back({ name, value });
 }
 
 // 没有复现 post
 // void HttpRequest::ParsePost_() {}
 
 std::string HttpRequest::path() const{
-    return path_;
+    return path_.Str();
 }
 
-std::string& HttpRequest::path(){
-    return path_;
-}
 std::string HttpRequest::method() const {
-    return method_;
+    return method_.Str();
 }
 
 std::string HttpRequest::version() const {
-    return version_;
-}
\ No newline at end of file
+    return version_.Str();
+}
+
+std::string HttpRequest::body() const {
+    return body_.Str();
+}
+
+const HttpRequest::Headers& HttpRequest::headers() const {
+    return header_;
+}
+
+// 头部名不区分大小写 (部分客户端发送全小写)
+StrRef HttpRequest::HeaderRef(const StrRef& key) const {
+    for(const auto& h : header_) {
+        if(h.name.EqualsIgnoreCase(key)) { return h.value; }
+    }
+    return StrRef();
+}
+
+std::string HttpRequest::GetHeader(const std::string& key) const {
+    return HeaderRef(key).Str();
+}
+void HttpRequest::SetRequest(const string& method, const string& path,
+                             const vector<pair<string, string>>& headers) {
+    Init();
+    method_ = arena_->Copy(method);
+    path_ = arena_->Copy(path);
+    version_ = "2";
+    for(const auto& h : headers) {
+        SetHeader_(arena_->Copy(h.first), arena_->Copy(h.second));
+    }
+    state_ = FINISH;
+}
+
+void HttpRequest::SetBody(const string& body) {
+    body_ = arena_->Copy(body);
+}
@@ -1,20 +1,18 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-25
  * @copyleft Apache 2.0
  */ 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef HTTP_REQUEST_H
 #define HTTP_REQUEST_H
 
-#include <unordered_map>
-#include <unordered_set>
 #include <string>
-#include <regex>
+#include <vector>
+#include <memory>
 #include <errno.h>     
+#include <strings.h>   // strcasecmp
 #include "../buffer/buffer.h"
+#include "../buffer/arena.h"
 #include "../log/log.h"
 
 class HttpRequest {
@@ -37,34 +35,60 @@ public:
         CLOSED_CONNECTION,
     };
     
-    HttpRequest() { Init(); }
+    // 请求头，name 与 value 指向 Arena 中以 '\0' 结尾的副本
+    struct Header {
+        StrRef name;
+        StrRef value;
+    };
+    typedef std::vector<Header, ArenaAllocator<Header>> Headers;
+
+    // 各字段分配在 arena 中，由其所有者 (连接) 在请求结束时整体 Reset；为 nullptr 时使用自己的 Arena
+    explicit HttpRequest(Arena* arena = nullptr);
+    // 副本 (后台刷新、HTTP/2 升级) 总是使用自己的 Arena
+    HttpRequest(const HttpRequest& other);
+    HttpRequest& operator=(const HttpRequest& other);
     ~HttpRequest() = default;
 
     void Init();
+    void Release();  // 同 Init，并释放各字段占用的内存 (空闲连接)
     bool parse(Buffer& buff);
 
     std::string path() const;
-    std::string& path();
     std::string method() const;
     std::string version() const;
+    std::string body() const;
+    const Headers& headers() const;
+    std::string GetHeader(const std::string& key) const;  // 不存在时返回空串
+
+    // 不复制的访问，在请求 Init / Release 之前有效
+    const StrRef& PathRef() const { return path_; }
+    const StrRef& MethodRef() const { return method_; }
+    StrRef HeaderRef(const StrRef& key) const;  // 名称不区分大小写
+
+    // HTTP/2 请求：由伪头部和解码后的头部直接构造，解析状态为 FINISH
+    void SetRequest(const std::string& method, const std::string& path,
+                    const std::vector<std::pair<std::string, std::string>>& headers);
+    // HTTP/2 请求体：由 DATA 帧收齐后设置
+    void SetBody(const std::string& body);
 
     bool IsKeepAlive() const;
 
 private:
-    bool ParseRequestLine_(const std::string& line);
-    void ParseHeader_(const std::string& line);
-    void ParseBody_(const std::string& line);
+    bool ParseRequestLine_(char* line, size_t len);
+    void ParseHeader_(char* line, size_t len);
+    void ParseBody_(const char* data, size_t len);
+    void SetHeader_(const StrRef& name, const StrRef& value);
+    void CopyFrom_(const HttpRequest& other);
 
-    void ParsePath_();
     // void ParsePost_();
 
+    std::unique_ptr<Arena> own_;  // 没有传入 arena 时使用
+    Arena* arena_;
     PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
+    StrRef method_, path_, version_, body_;
+    Headers header_;
     // std::unordered_map<std::string, std::string> post_;
 
-    static const std::unordered_set<std::string> DEFAULT_HTML;
-
 };
 
 
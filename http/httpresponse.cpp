@@ -1,5 +1,3 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-27
@@ -8,7 +6,6 @@
 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include "httpresponse.h"
 
 using namespace std;
@@ -34,26 +31,53 @@ const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
     { ".tar",   "application/x-tar" },
     { ".css",   "text/css "},
     { ".js",    "text/javascript "},
+    { ".json",  "application/json" },
 };
+// 可以压缩的类型：SUFFIX_TYPE 中的文本类型，图片、音视频与已压缩的格式除外
+const unordered_set<string> HttpResponse::COMPRESS_TYPE = [] {
+    unordered_set<string> types;
+    for(const auto& it : SUFFIX_TYPE) {
+        string type = it.second.substr(0, it.second.find_last_not_of(' ') + 1);
+        if(type.compare(0, 5, "text/") == 0 || type.find("xml") != string::npos ||
+           type.find("json") != string::npos || type.find("javascript") != string::npos ||
+           type == "application/rtf") {
+            types.insert(type);
+        }
+    }
+    return types;
+}();
 // 状态码
 const unordered_map<int, string> HttpResponse::CODE_STATUS = {
     { 200, "OK" },
+    { 206, "Partial Content" },
     { 400, "Bad Request" },
     { 403, "Forbidden" },
     { 404, "Not Found" },
-};
-// 状态码对应的 html 路径
-const unordered_map<int, string> HttpResponse::CODE_PATH = {
-    { 400, "/400.html" },
-    { 403, "/403.html" },
-    { 404, "/404.html" },
+    { 405, "Method Not Allowed" },
+    { 408, "Request Timeout" },
+    { 411, "Length Required" },
+    { 413, "Payload Too Large" },
+    { 414, "URI Too Long" },
+    { 416, "Range Not Satisfiable" },
+    { 421, "Misdirected Request" },
+    { 429, "Too Many Requests" },
+    { 431, "Request Header Fields Too Large" },
+    { 501, "Not Implemented" },
+    { 502, "Bad Gateway" },
+    { 504, "Gateway Timeout" },
 };
 // HttpResponse 构造函数
-HttpResponse::HttpResponse() {
+HttpResponse::HttpResponse(Arena* arena)
+    : own_(arena ? nullptr : new Arena), arena_(arena ? arena : own_.get()),
+      ranges_(ArenaAllocator<ByteRange>(arena_)),
+      body_(ArenaAllocator<struct iovec>(arena_)), bodyFiles_(ArenaAllocator<FileSeg>(arena_)),
+      maps_(ArenaAllocator<pair<char*, size_t>>(arena_)) {
     code_ = -1;
-    path_ = srcDir_ = "";
+    srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr; 
+    keepAliveTimeout_ = keepAliveMax_ = 0;
+    hasContent_ = false;
+    bundleEntry_ = nullptr;
     mmFileStat_ = { 0 };
 };
 // HttpResponse 析构函数
@@ -61,135 +85,548 @@ HttpResponse::~HttpResponse() {
     UnmapFile();  // 释放共享内存
 }
 // 初始化
-void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
-    assert(srcDir != "");
-    if(mmFile_) { UnmapFile(); }
+void HttpResponse::Init(const char* srcDir, const StrRef& path, bool isKeepAlive, int code){
+    assert(srcDir && *srcDir);
+    UnmapFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
-    path_ = path;
+    keepAliveTimeout_ = keepAliveMax_ = 0;
+    path_ = arena_->Copy(path);
     srcDir_ = srcDir;
-    mmFile_ = nullptr; 
     mmFileStat_ = { 0 };
+    range_ = ifRange_ = StrRef();
+    ranges_.clear();
+    boundary_ = parts_ = "";
+    hasContent_ = false;
+    content_ = contentType_ = encoding_ = "";
+    shared_.reset();
+    stream_.reset();
+}
+// 设置请求中的 Range / If-Range 头，需在 Init 之后、MakeResponse 之前调用
+void HttpResponse::SetRange(const StrRef& range, const StrRef& ifRange) {
+    range_ = range.Empty() ? StrRef() : arena_->Copy(range);
+    ifRange_ = ifRange.Empty() ? StrRef() : arena_->Copy(ifRange);
+}
+void HttpResponse::SetKeepAlive(int timeout, int max) {
+    keepAliveTimeout_ = timeout;
+    keepAliveMax_ = max;
+}
+// 使用内存中的内容作为响应体 (不对应文件)，需在 Init 之后、MakeResponse 之前调用
+void HttpResponse::SetContent(const string& content, const string& type) {
+    hasContent_ = true;
+    content_ = content;
+    contentType_ = type;
+    encoding_.clear();
+    shared_.reset();
+    stream_.reset();
+}
+// 只发送响应头，响应体之后由 stream 产生；非 chunked (HTTP/1.0) 时以关闭连接结束
+void HttpResponse::SetStream(const shared_ptr<ResponseStream>& stream, const string& type) {
+    assert(stream);
+    hasContent_ = true;
+    content_.clear();
+    contentType_ = type;
+    encoding_.clear();
+    shared_.reset();
+    stream_ = stream;
+    if(!stream->Chunked()) { isKeepAlive_ = false; }
+}
+// 与其他响应共享的响应体 (微缓存中的内容)，发送完之前保持引用
+void HttpResponse::SetContent(const shared_ptr<const string>& content, const string& type) {
+    assert(content);
+    hasContent_ = true;
+    content_.clear();
+    contentType_ = type;
+    encoding_.clear();
+    shared_ = content;
+    stream_.reset();
 }
 
-void HttpResponse::MakeResponse(Buffer& buff) {
-    // 判断请求的资源文件 是否存在，是否有权限获取
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) {
-        code_ = 404;  // 文件不存在，或者请求的是目录，不是文件
+void HttpResponse::MakeResponse(ChainBuffer& buff) {
+    if(hasContent_) {
+        if(code_ == -1) { code_ = 200; }
+        AddStateLine_(buff);
+        AddHeader_(buff);
+        if(stream_) {
+            buff.Append(stream_->Chunked() ? "Transfer-Encoding: chunked\r\n\r\n" : "\r\n");
+            return;
+        }
+        const string& content = Content();
+        char line[64];
+        buff.Append(line, snprintf(line, sizeof(line), "Content-length: %zu\r\n\r\n", content.size()));
+        if(!content.empty()) {
+            AddBody_(const_cast<char*>(content.data()), content.size());
+        }
+        return;
     }
-    else if(!(mmFileStat_.st_mode & S_IROTH)) {
+    // 判断请求的资源文件 是否存在，是否有权限获取
+    int err = 0;
+    if(!OpenFile_(&err) && err == EACCES) {
         code_ = 403;  // 无权访问该资源文件
     }
+    else if(err != 0) {
+        code_ = 404;  // 文件不存在，或者请求的是目录，不是文件
+    }
     else if(code_ == -1) { // 构造函数初始化时 code_ = -1
         code_ = 200;  
     }
-    // 进入到这里时，code_ 已经设定为 200、400、403、404
+    // 只有正常的 200 响应才处理 Range，可能转为 206 或 416
+    if(code_ == 200 && !range_.Empty()) {
+        ParseRange_();
+    }
+    // 进入到这里时，code_ 已经设定为 200、206、400、403、404、416
     ErrorHtml_();        // 找预先写好的 ErrorHtml: 400、403、404, 并将文件信息存入 stat
     AddStateLine_(buff); // 添加状态行，并写入 buff
     AddHeader_(buff);    // 添加相应头，并写入 buff
     AddContent_(buff);   // 找到文件资源，并映射到相应的共享内存，然后将文件大小 写入 buff
 }
-
-char* HttpResponse::File() {
-    return mmFile_;  // 文件内容指针
+// 响应体总长度 (所有分段之和)
+size_t HttpResponse::BodyLen() const {
+    size_t len = 0;
+    for(const auto& iov : body_) {
+        len += iov.iov_len;
+    }
+    return len;
 }
 
-size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size; // 文件大小
+// 查找 path_ 对应的文件，并将文件信息存入 mmFileStat_
+// 优先从归档文件中查找 (一次哈希探测，无系统调用)，未找到时回退到 srcDir 下的文件
+// 磁盘文件通过文件缓存获取，并发未命中时只加载一次；完整路径在 arena 中拼接
+bool HttpResponse::OpenFile_(int* err) {
+    *err = 0;
+    file_.reset();
+    bundleEntry_ = Bundle::Instance()->Find(path_.data, path_.len, &archive_);
+    if(bundleEntry_) {
+        mmFileStat_ = { 0 };
+        mmFileStat_.st_size = bundleEntry_->dataLen;
+        mmFileStat_.st_mtime = bundleEntry_->mtime;
+        return true;
+    }
+    StrRef fullPath = arena_->Concat(srcDir_, path_);
+    file_ = FileCache::Instance()->Get(fullPath.data, fullPath.len, err);
+    if(!file_) {
+        mmFileStat_ = { 0 };
+        return false;
+    }
+    mmFileStat_ = file_->st;
+    return true;
 }
 
 void HttpResponse::ErrorHtml_() {
-    if(CODE_PATH.count(code_) == 1) {
-        path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);  // 获取指定路径文件或者文件夹信息
+    const string* page = Router::Instance()->ErrorPage(code_);  // 错误页在路由表中注册
+    if(page) {
+        path_ = *page;
+        int err = 0;
+        OpenFile_(&err);  // 获取指定路径文件信息
     }
 }
-// 添加状态行，写入到 buff
-void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
+// 解析 Range 头，例如：
+// Range: bytes=0-499          前 500 字节
+// Range: bytes=500-           从 500 字节到结尾
+// Range: bytes=-500           最后 500 字节
+// Range: bytes=0-0,-1         多个区间，以 multipart/byteranges 返回
+// 语法错误或区间过多时忽略 Range，按 200 返回完整内容；全部区间不可满足时返回 416
+// 区间按起点排序，重叠或相邻的合并为一个；各区间长度之和超过文件大小 (如 bytes=0-,0-) 时同样返回完整内容
+// 直接在请求头上解析，区间先放在栈上，不分配内存
+void HttpResponse::ParseRange_() {
+    if(!IfRangeMatch_()) { return; }  // 资源已经变化，返回完整内容
+    static const char PREFIX[] = "bytes=";
+    const size_t prefixLen = sizeof(PREFIX) - 1;
+    if(range_.len < prefixLen || memcmp(range_.data, PREFIX, prefixLen) != 0) { return; }
+
+    const off_t size = mmFileStat_.st_size;
+    ByteRange ranges[MAX_RANGES];
+    size_t n = 0;
+    size_t count = 0;
+    off_t total = 0;
+    const char* end = range_.data + range_.len;
+    for(const char* p = range_.data + prefixLen; p <= end; ) {
+        const char* b = p;
+        const char* e = static_cast<const char*>(memchr(p, ',', end - p));
+        if(!e) { e = end; }
+        p = e + 1;
+        // 去掉首尾空白
+        while(b < e && (*b == ' ' || *b == '\t')) { b++; }
+        while(e > b && (e[-1] == ' ' || e[-1] == '\t')) { e--; }
+        if(b == e) { continue; }
+
+        const char* dash = static_cast<const char*>(memchr(b, '-', e - b));
+        if(!dash) { return; }
+        off_t first = 0, last = 0;
+        int hasFirst = ParseOffset_(b, dash, &first);
+        int hasLast = ParseOffset_(dash + 1, e, &last);
+        if(hasFirst < 0 || hasLast < 0 || (!hasFirst && !hasLast)) {
+            return;  // 语法错误
+        }
+        if(++count > MAX_RANGES) { return; }  // 区间过多，直接返回完整内容
+
+        ByteRange r;
+        if(!hasFirst) {  // 后缀区间 -N
+            if(last == 0 || size == 0) { continue; }
+            r.first = last >= size ? 0 : size - last;
+            r.last = size - 1;
+        } else {
+            r.first = first;
+            r.last = hasLast ? last : size - 1;
+            if(hasLast && r.last < r.first) { return; }  // 语法错误
+            if(r.first >= size) { continue; }  // 该区间不可满足
+            if(r.last >= size) { r.last = size - 1; }
+        }
+        ranges[n++] = r;
+        total += r.last - r.first + 1;
+    }
+    if(count == 0) { return; }
+    if(n == 0) {
+        code_ = 416;
+        return;
+    }
+    if(total > size) { return; }  // 重叠的区间会重复发送同一段内容
+    sort(ranges, ranges + n, [](const ByteRange& a, const ByteRange& b) { return a.first < b.first; });
+    size_t merged = 0;
+    for(size_t i = 1; i < n; i++) {
+        if(ranges[i].first <= ranges[merged].last + 1) {
+            ranges[merged].last = max(ranges[merged].last, ranges[i].last);
+        } else {
+            ranges[++merged] = ranges[i];
+        }
+    }
+    ranges_.assign(ranges, ranges + merged + 1);
+    code_ = 206;
+    if(ranges_.size() > 1) {
+        static atomic<unsigned long> boundaryId(0);
+        char buf[24];
+        snprintf(buf, sizeof(buf), "%020lu", ++boundaryId);
+        boundary_ = buf;
+    }
+}
+// 区间端点：返回 1 并写入 value；为空返回 0；不是数字或超过 18 位返回 -1
+int HttpResponse::ParseOffset_(const char* begin, const char* end, off_t* value) {
+    if(begin == end) { return 0; }
+    if(end - begin > 18) { return -1; }
+    off_t v = 0;
+    for(const char* p = begin; p < end; p++) {
+        if(*p < '0' || *p > '9') { return -1; }
+        v = v * 10 + (*p - '0');
     }
-    else {
+    *value = v;
+    return 1;
+}
+// If-Range 可以是 ETag 或 Last-Modified，只有与当前资源一致时 Range 才生效
+bool HttpResponse::IfRangeMatch_() const {
+    if(ifRange_.Empty()) { return true; }
+    char buf[64];
+    if(ifRange_.data[0] == '"') {
+        // 强校验，弱 ETag (W/) 不会匹配
+        return ifRange_ == StrRef(buf, ETag_(mmFileStat_.st_mtime, mmFileStat_.st_size, buf));
+    }
+    return ifRange_ == StrRef(buf, HttpDate_(mmFileStat_.st_mtime, buf));
+}
+// 添加状态行，写入到 buff
+// 各行先在栈上格式化，生成响应头不分配内存
+void HttpResponse::AddStateLine_(ChainBuffer& buff) {
+    auto it = CODE_STATUS.find(code_);
+    if(it == CODE_STATUS.end()) {
         code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+        it = CODE_STATUS.find(400);
     }
     // 例子：HTTP/1.1 200 OK\r\n
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    char line[64];
+    buff.Append(line, snprintf(line, sizeof(line), "HTTP/1.1 %d %s\r\n", code_, it->second.c_str()));
 }
 // 添加相应头，写入到 buff
-void HttpResponse::AddHeader_(Buffer& buff) {
-    buff.Append("Connection: ");
+void HttpResponse::AddHeader_(ChainBuffer& buff) {
+    // Date 每秒格式化一次
+    const CachedClock::Second& now = CachedClock::Wall();
+    buff.Append("Date: ");
+    buff.Append(now.date, now.dateLen);
+    buff.Append("\r\nConnection: ");
     if(isKeepAlive_) {
         buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
+        if(keepAliveMax_ > 0) {
+            char line[64];
+            buff.Append(line, snprintf(line, sizeof(line), "Keep-Alive: timeout=%d, max=%d\r\n",
+                                       keepAliveTimeout_, keepAliveMax_));
+        }
     } else{
         buff.Append("close\r\n");
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    if(hasContent_) {
+        buff.Append("Content-type: " + contentType_ + "\r\n");
+        if(!encoding_.empty()) {
+            buff.Append("Content-Encoding: " + encoding_ + "\r\n");
+        }
+        // 可压缩的类型是否压缩取决于请求的 Accept-Encoding，未压缩的响应同样标明，中间缓存才不会混用两种内容
+        if(!encoding_.empty() || Compressible(contentType_)) {
+            buff.Append("Vary: Accept-Encoding\r\n");
+        }
+        return;
+    }
+    if(code_ == 206 && ranges_.size() > 1) {
+        buff.Append("Content-type: multipart/byteranges; boundary=" + boundary_ + "\r\n");
+    } else if(code_ == 416 || (!file_ && !bundleEntry_)) {
+        buff.Append("Content-type: text/html\r\n");  // 响应体为 ErrorContent 生成的错误页，与文件类型无关
+    } else {
+        StrRef type = GetFileType_();
+        buff.Append("Content-type: ");
+        buff.Append(type.data, type.len);
+        buff.Append("\r\n");
+    }
+    if(bundleEntry_ && (code_ == 200 || code_ == 206)) {
+        // 归档文件中预先生成的响应头
+        buff.Append(archive_->Header(bundleEntry_), bundleEntry_->hdrLen);
+    }
+    else if(code_ == 200 || code_ == 206) {
+        char line[192];
+        int n = snprintf(line, sizeof(line), "Accept-Ranges: bytes\r\nETag: ");
+        n += ETag_(mmFileStat_.st_mtime, mmFileStat_.st_size, line + n);
+        n += snprintf(line + n, sizeof(line) - n, "\r\nLast-Modified: ");
+        n += HttpDate_(mmFileStat_.st_mtime, line + n);
+        n += snprintf(line + n, sizeof(line) - n, "\r\n");
+        buff.Append(line, n);
+    }
     // 例子: 
     // Connection: keep-alive
-    // Keep-alive: max=6, timeout=120
+    // Keep-Alive: timeout=15, max=99
     // Content-type: text/html
+    // Accept-Ranges: bytes
 }
 
-void HttpResponse::AddContent_(Buffer& buff) {
-    // 打开对应文件
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) { 
+void HttpResponse::AddContent_(ChainBuffer& buff) {
+    if(code_ == 416) {
+        buff.Append("Content-Range: bytes */" + to_string(mmFileStat_.st_size) + "\r\n");
+        ErrorContent(buff, "Requested Range Not Satisfiable!");
+        return;
+    }
+    if(!file_ && !bundleEntry_) {
         ErrorContent(buff, "File NotFound!");
         return; 
     }
+    LOG_DEBUG("file path %s%s", srcDir_, path_.data);
+    // 归档文件或缓存中的整文件映射，大文件为 nullptr
+    char* base = bundleEntry_ ? const_cast<char*>(archive_->Data(bundleEntry_)) : file_->data;
+    int fd = bundleEntry_ ? archive_->Fd() : file_->fd;
+    off_t fileOff = bundleEntry_ ? bundleEntry_->dataOff : 0;
+    if(code_ != 206) {
+        // 完整内容：直接使用已有的整文件映射，大文件再单独映射
+        if(mmFileStat_.st_size > 0) {
+            char* data = base ? base : MapRange_(file_->fd, 0, mmFileStat_.st_size);
+            if(!data) {
+                ErrorContent(buff, "File NotFound!");
+                return;
+            }
+            AddBody_(data, mmFileStat_.st_size, fd, fileOff);
+        }
+        char line[64];
+        buff.Append(line, snprintf(line, sizeof(line), "Content-length: %lld\r\n\r\n",
+                                   static_cast<long long>(mmFileStat_.st_size)));
+        // buff 中添加 Content-length: 1000\r\n\r\n
+        return;
+    }
+    // 部分内容：整文件映射中直接取区间，否则只映射请求的区间
+    const string total = "/" + to_string(mmFileStat_.st_size);
+    vector<char*> datas;
+    for(const auto& r : ranges_) {
+        char* data = base ? base + r.first : MapRange_(file_->fd, r.first, r.last - r.first + 1);
+        if(!data) {
+            UnmapFile();
+            ErrorContent(buff, "File NotFound!");
+            return;
+        }
+        datas.push_back(data);
+    }
+
+    if(ranges_.size() == 1) {
+        const ByteRange& r = ranges_[0];
+        size_t len = r.last - r.first + 1;
+        AddBody_(datas[0], len, fd, fileOff + r.first);
+        buff.Append("Content-Range: bytes " + to_string(r.first) + "-" + to_string(r.last) + total + "\r\n");
+        buff.Append("Content-length: " + to_string(len) + "\r\n\r\n");
+        return;
+    }
+    // multipart/byteranges，先拼好全部分段头，再取指针 (避免 parts_ 扩容导致指针失效)
+    // \r\n--boundary\r\nContent-type: xx\r\nContent-Range: bytes a-b/size\r\n\r\n<data> ... \r\n--boundary--\r\n
+    const string type = GetFileType_().Str();
+    vector<size_t> offsets;
+    for(const auto& r : ranges_) {
+        offsets.push_back(parts_.size());
+        parts_ += "\r\n--" + boundary_ + "\r\n";
+        parts_ += "Content-type: " + type + "\r\n";
+        parts_ += "Content-Range: bytes " + to_string(r.first) + "-" + to_string(r.last) + total + "\r\n\r\n";
+    }
+    offsets.push_back(parts_.size());
+    parts_ += "\r\n--" + boundary_ + "--\r\n";
+    offsets.push_back(parts_.size());
+
+    for(size_t i = 0; i < ranges_.size(); i++) {
+        AddBody_(&parts_[offsets[i]], offsets[i + 1] - offsets[i]);
+        AddBody_(datas[i], ranges_[i].last - ranges_[i].first + 1, fd, fileOff + ranges_[i].first);
+    }
+    AddBody_(&parts_[offsets[ranges_.size()]], offsets[ranges_.size() + 1] - offsets[ranges_.size()]);
+    buff.Append("Content-length: " + to_string(BodyLen()) + "\r\n\r\n");
+}
+// 映射文件 [offset, offset + len)，mmap 的偏移需要按页对齐，返回值指向 offset 处
+char* HttpResponse::MapRange_(int fd, off_t offset, size_t len) {
+    static const off_t pageSize = sysconf(_SC_PAGESIZE);
+    off_t aligned = offset & ~(pageSize - 1);
+    size_t mapLen = len + (offset - aligned);
     // 将文件映射到内存提高文件的访问速度 MAP_PRIVATE 建立一个写入时拷贝的私有映射
-    LOG_DEBUG("file path %s", (srcDir_ + path_).data());
-    // 共享内存映射
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
-        return; 
+    void* ret = mmap(0, mapLen, PROT_READ, MAP_PRIVATE, fd, aligned);
+    if(ret == MAP_FAILED) {
+        return nullptr;
     }
-    // 类型转换
-    mmFile_ = (char*)mmRet;
-    close(srcFd);  // 关闭 srcFd，应为共享内存已经映射了，无需 srcFd 保持打开
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
-    // buff 中添加 Content-length: 1000\r\n\r\n
+    maps_.push_back({ static_cast<char*>(ret), mapLen });
+    return static_cast<char*>(ret) + (offset - aligned);
+}
+
+// 检查映射的文件内容是否都已在 page cache 中 (mincore)
+// 如果有页不在内存中，writev 时会因缺页而阻塞在磁盘 IO 上
+bool HttpResponse::IsResident() const {
+    static const size_t pageSize = sysconf(_SC_PAGESIZE);
+    unsigned char vec[1024];
+    for(const auto& seg : body_) {
+        // mincore 要求地址按页对齐
+        uintptr_t begin = reinterpret_cast<uintptr_t>(seg.iov_base) & ~(pageSize - 1);
+        uintptr_t end = reinterpret_cast<uintptr_t>(seg.iov_base) + seg.iov_len;
+        size_t pages = (end - begin + pageSize - 1) / pageSize;
+        // 分批检查，避免大文件一次性申请很大的 vec
+        for(size_t i = 0; i < pages; i += sizeof(vec)) {
+            size_t n = std::min(pages - i, sizeof(vec));
+            if(mincore(reinterpret_cast<void*>(begin + i * pageSize), n * pageSize, vec) < 0) {
+                return true;  // 无法判断时按热数据处理，走原来的路径
+            }
+            for(size_t j = 0; j < n; j++) {
+                if(!(vec[j] & 1)) { return false; }
+            }
+        }
+    }
+    return true;
+}
+// 将映射的文件内容读入 page cache，任务在独立的磁盘 IO 线程中执行 (会阻塞)
+// MADV_WILLNEED 触发预读，MADV_POPULATE_READ 等待全部页就绪
+// 不直接访问内存，这样即使连接已关闭、映射被提前释放也只会返回错误 (ENOMEM) 而不会崩溃
+std::function<void()> HttpResponse::PrefetchTask() const {
+#ifndef MADV_POPULATE_READ
+#define MADV_POPULATE_READ 22
+#endif
+    std::vector<struct iovec> segs(body_.begin(), body_.end());  // body_ 位于连接的 arena 中，随连接复用
+    std::shared_ptr<const FileEntry> file = file_;
+    std::shared_ptr<const BundleArchive> archive = archive_;
+    string path = path_.Str();
+    return [segs, file, archive, path] {
+        static const size_t pageSize = sysconf(_SC_PAGESIZE);
+        for(const auto& seg : segs) {
+            uintptr_t begin = reinterpret_cast<uintptr_t>(seg.iov_base) & ~(pageSize - 1);
+            size_t len = reinterpret_cast<uintptr_t>(seg.iov_base) + seg.iov_len - begin;
+            madvise(reinterpret_cast<void*>(begin), len, MADV_WILLNEED);
+            if(madvise(reinterpret_cast<void*>(begin), len, MADV_POPULATE_READ) < 0 && errno != EINVAL && errno != ENOMEM) {
+                LOG_WARN("Prefetch %s error: %d", path.c_str(), errno);
+            }
+        }
+    };
+}
+
+// 添加一个响应体分段，fd/offset 为该分段在文件中的位置 (内存内容 fd 为 -1)
+void HttpResponse::AddBody_(char* data, size_t len, int fd, off_t offset) {
+    body_.push_back({ data, len });
+    bodyFiles_.push_back({ fd, offset });
 }
 
 void HttpResponse::UnmapFile() { // 释放共享内存
-    if(mmFile_) {
-        // 释放共享内存
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
+    for(auto& m : maps_) {
+        munmap(m.first, m.second);
     }
+    maps_.clear();
+    body_.clear();
+    bodyFiles_.clear();
+    file_.reset();
+    archive_.reset();
+    bundleEntry_ = nullptr;
+}
+// arena 中的存储直接放弃 (与空容器交换)，之后 arena 可以 Reset
+void HttpResponse::Release() {
+    UnmapFile();
+    shared_.reset();
+    stream_.reset();
+    hasContent_ = false;
+    path_ = range_ = ifRange_ = StrRef();
+    string().swap(content_);
+    string().swap(parts_);
+    decltype(ranges_)(ranges_.get_allocator()).swap(ranges_);
+    Iovecs(body_.get_allocator()).swap(body_);
+    FileSegs(bodyFiles_.get_allocator()).swap(bodyFiles_);
+    decltype(maps_)(maps_.get_allocator()).swap(maps_);
+    if(own_) { own_->Release(); }
 }
 // 判断文件类型 
-string HttpResponse::GetFileType_() {
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos) {
-        return "text/plain";
+StrRef HttpResponse::GetFileType_() const {
+    if(bundleEntry_) {
+        return StrRef(archive_->Type(bundleEntry_), bundleEntry_->typeLen);
     }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
+    return TypeOf_(path_);
+}
+
+// type 可以带参数，例如 "text/html; charset=utf-8"
+bool HttpResponse::Compressible(const string& type) {
+    size_t end = type.find(';');
+    end = type.find_last_not_of(' ', end == string::npos ? string::npos : end - 1);
+    return end != string::npos && COMPRESS_TYPE.count(type.substr(0, end + 1)) > 0;
+}
+
+string HttpResponse::FileType(const string& path) {
+    return TypeOf_(path).Str();
+}
+// 返回的类型指向 SUFFIX_TYPE 中的字符串；后缀不超过 SSO 长度，查找时不分配内存
+StrRef HttpResponse::TypeOf_(const StrRef& path) {
+    const char* dot = static_cast<const char*>(memrchr(path.data, '.', path.len));
+    size_t len = dot ? path.data + path.len - dot : 0;
+    if(len > 0 && len <= 8) {
+        auto it = SUFFIX_TYPE.find(string(dot, len));
+        if(it != SUFFIX_TYPE.end()) {
+            return it->second;
+        }
     }
     return "text/plain";
 }
+// 强 ETag，由修改时间与文件大小生成，例如 "5f1e2a3b-d7769"
+string HttpResponse::ETag(time_t mtime, off_t size) {
+    char buf[64];
+    return string(buf, ETag_(mtime, size, buf));
+}
+// HTTP-date 格式的时间，例如 Fri, 03 Sep 2021 08:00:00 GMT
+string HttpResponse::HttpDate(time_t t) {
+    char buf[64];
+    return string(buf, HttpDate_(t, buf));
+}
+
+int HttpResponse::ETag_(time_t mtime, off_t size, char* buf) {
+    return snprintf(buf, 64, "\"%lx-%lx\"", (unsigned long)mtime, (unsigned long)size);
+}
+
+int HttpResponse::HttpDate_(time_t t, char* buf) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, 64, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
 // 错误消息内容
-void HttpResponse::ErrorContent(Buffer& buff, string message) 
+void HttpResponse::ErrorContent(ChainBuffer& buff, string message) 
 {
+    string body = ErrorBody(code_, message);
+    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
+    buff.Append(body);
+}
+
+string HttpResponse::ErrorBody(int code, const string& message) {
     string body;
     string status;
     body += "<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\">";
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
+    if(CODE_STATUS.count(code) == 1) {
+        status = CODE_STATUS.find(code)->second;
     } else {
         status = "Bad Request";
     }
-    body += to_string(code_) + " : " + status  + "\n";
+    body += to_string(code) + " : " + status  + "\n";
     body += "<p>" + message + "</p>";
     body += "<hr><em>simpleWebServer</em></body></html>";
-
-    buff.Append("Content-length: " + to_string(body.size()) + "\r\n\r\n");
-    buff.Append(body);
+    return body;
 }
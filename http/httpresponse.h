@@ -1,56 +1,138 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-25
  * @copyleft Apache 2.0
  */ 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef HTTP_RESPONSE_H
 #define HTTP_RESPONSE_H
 
 #include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <algorithm>
+#include <functional>
 #include <fcntl.h>      
 #include <unistd.h>      
 #include <sys/stat.h>    
 #include <sys/mman.h>    
 
-#include "../buffer/buffer.h"
+#include "../buffer/chainbuffer.h"
+#include "../buffer/arena.h"
 #include "../log/log.h"
+#include "filecache.h"
+#include "bundle.h"
+#include "router.h"
+#include "responsestream.h"
 
 class HttpResponse {
 public:
-    HttpResponse();
+    // 路径、Range 与响应体分段等请求级的数据分配在 arena 中 (见 HttpRequest)，为 nullptr 时使用自己的 Arena
+    explicit HttpResponse(Arena* arena = nullptr);
     ~HttpResponse();
+    HttpResponse(const HttpResponse&) = delete;
+    HttpResponse& operator=(const HttpResponse&) = delete;
 
-    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
-    void MakeResponse(Buffer& buff);
+    // srcDir 须在响应发送完之前有效，path 复制到 arena
+    void Init(const char* srcDir, const StrRef& path, bool isKeepAlive = false, int code = -1);
+    void SetRange(const StrRef& range, const StrRef& ifRange);
+    // 响应头 Keep-Alive 中提示的空闲超时 (秒) 与该连接剩余的请求数，需在 Init 之后调用
+    void SetKeepAlive(int timeout, int max);
+    void SetContent(const std::string& content, const std::string& type);
+    void SetContent(const std::shared_ptr<const std::string>& content, const std::string& type);
+    // 响应体由 stream 逐步产生，见 ResponseStream::Start
+    void SetStream(const std::shared_ptr<ResponseStream>& stream, const std::string& type);
+    std::shared_ptr<ResponseStream> GetStream() const { return stream_; }
+    // 内存中的响应体已按 encoding 编码 (gzip)，需在 SetContent / SetStream 之后调用
+    void SetEncoding(const std::string& encoding) { encoding_ = encoding; }
+    std::shared_ptr<const std::string> SharedContent() const { return shared_; }
+    void MakeResponse(ChainBuffer& buff);
     void UnmapFile();
-    char* File();
-    size_t FileLen() const;
-    void ErrorContent(Buffer& buff, std::string message);
+    void Release();  // 响应发送完后释放文件引用、响应体与各字段占用的内存 (空闲连接，共用的 arena 随后 Reset)
+    bool IsResident() const;
+    // 返回预读响应体的任务，交给磁盘 IO 线程执行；任务自带分段副本并持有文件引用，不再访问本对象
+    std::function<void()> PrefetchTask() const;
+    // 响应体分段对应的文件位置，fd 为 -1 表示内存中的内容 (用于 sendfile)
+    struct FileSeg {
+        int fd;
+        off_t offset;
+    };
+    typedef std::vector<struct iovec, ArenaAllocator<struct iovec>> Iovecs;
+    typedef std::vector<FileSeg, ArenaAllocator<FileSeg>> FileSegs;
+    const Iovecs& Body() const { return body_; }
+    const FileSegs& BodyFiles() const { return bodyFiles_; }
+    size_t BodyLen() const;
+    void ErrorContent(ChainBuffer& buff, std::string message);
+    static std::string ErrorBody(int code, const std::string& message);
     int Code() const { return code_; }
+    bool HasContent() const { return hasContent_; }
+    const std::string& Content() const { return shared_ ? *shared_ : content_; }
+    const std::string& ContentType() const { return contentType_; }
+
+    static std::string FileType(const std::string& path);
+    static bool Compressible(const std::string& type);
+    static std::string ETag(time_t mtime, off_t size);
+    static std::string HttpDate(time_t t);
+
+    static const size_t MAX_RANGES = 16;  // 超过该数量的 Range 请求直接返回完整内容
 
 private:
-    void AddStateLine_(Buffer &buff);
-    void AddHeader_(Buffer &buff);
-    void AddContent_(Buffer &buff);
+    struct ByteRange {  // 闭区间 [first, last]
+        off_t first;
+        off_t last;
+    };
+
+    void AddStateLine_(ChainBuffer& buff);
+    void AddHeader_(ChainBuffer& buff);
+    void AddContent_(ChainBuffer& buff);
 
+    bool OpenFile_(int* err);
     void ErrorHtml_();
-    std::string GetFileType_();
+    void ParseRange_();
+    bool IfRangeMatch_() const;
+    static int ParseOffset_(const char* begin, const char* end, off_t* value);
+    char* MapRange_(int fd, off_t offset, size_t len);
+    void AddBody_(char* data, size_t len, int fd = -1, off_t offset = 0);
+    StrRef GetFileType_() const;
+    static StrRef TypeOf_(const StrRef& path);
+    // 写入 buf (至少 64 字节)，返回长度
+    static int ETag_(time_t mtime, off_t size, char* buf);
+    static int HttpDate_(time_t t, char* buf);
 
     int code_;
     bool isKeepAlive_;
+    int keepAliveTimeout_;
+    int keepAliveMax_;      // 为 0 时不发送 Keep-Alive 头
 
-    std::string path_;
-    std::string srcDir_;
+    std::unique_ptr<Arena> own_;  // 没有传入 arena 时使用
+    Arena* arena_;
+    StrRef path_;
+    const char* srcDir_;
     
-    char* mmFile_; 
     struct stat mmFileStat_;
+    std::shared_ptr<const FileEntry> file_;  // 文件缓存项，响应发送完之前保持引用
+    std::shared_ptr<const BundleArchive> archive_;  // 命中归档文件时的映射
+    const BundleEntry* bundleEntry_;
+
+    bool hasContent_;          // 响应体为内存中的内容，而不是文件
+    std::string content_;
+    std::string contentType_;
+    std::shared_ptr<const std::string> shared_;  // 非空时代替 content_
+    std::shared_ptr<ResponseStream> stream_;
+    std::string encoding_;  // Content-Encoding
+
+    StrRef range_;          // 请求头 Range
+    StrRef ifRange_;        // 请求头 If-Range
+    std::vector<ByteRange, ArenaAllocator<ByteRange>> ranges_;  // 解析后可满足的区间 (已排序、合并)
+    std::string boundary_;  // multipart/byteranges 分隔符
+    std::string parts_;     // multipart 各分段的头部与结束分隔符
+
+    Iovecs body_;         // 响应体分段，指向映射内存、parts_ 或 content_
+    FileSegs bodyFiles_;  // 与 body_ 一一对应
+    std::vector<std::pair<char*, size_t>, ArenaAllocator<std::pair<char*, size_t>>> maps_;  // 需要 munmap 的映射区域
 
     static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
+    static const std::unordered_set<std::string> COMPRESS_TYPE;
     static const std::unordered_map<int, std::string> CODE_STATUS;
-    static const std::unordered_map<int, std::string> CODE_PATH;
     
 };
 
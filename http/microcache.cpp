@@ -0,0 +1,207 @@
+#include "microcache.h"
+
+using namespace std;
+
+MicroCache* MicroCache::Instance() {
+    static MicroCache inst;  // 静态单例
+    return &inst;
+}
+
+int64_t MicroCache::NowMS_() {
+    return CachedClock::NowMS();
+}
+
+MicroCache::Shard& MicroCache::ShardOf_(const string& key) {
+    return shards_[hash<string>()(key) % SHARDS];
+}
+// HEAD 与 GET 共用缓存项；带 Authorization / Cookie 而路由未将其列入 vary 的请求不缓存，
+// 避免把一个用户的响应返回给其他用户。返回空串表示不使用缓存
+string MicroCache::Key_(const Route& route, const HttpRequest& request) {
+    const string& method = request.method();
+    if(method != "GET" && method != "HEAD") { return ""; }
+    for(const char* name : { "Authorization", "Cookie" }) {
+        if(request.GetHeader(name).empty()) { continue; }
+        bool varied = false;
+        for(const auto& h : route.vary) {
+            if(strcasecmp(h.c_str(), name) == 0) { varied = true; }
+        }
+        if(!varied) { return ""; }
+    }
+    string key = "GET " + request.path();
+    for(const auto& h : route.vary) {
+        key += "\n" + h + ": " + request.GetHeader(h);
+    }
+    return key;
+}
+// 调用处理函数，参数按请求路径重新匹配 (后台刷新时请求为副本)
+void MicroCache::Run_(const Route& route, HttpRequest& request, HttpResponse& response) {
+    RouteMatch match;
+    Router::Instance()->Match(request.MethodRef(), request.PathRef(), &match);
+    route.handler(request, response, match);
+}
+
+void MicroCache::Fill_(HttpResponse& response, const Entry& entry) {
+    response.SetContent(entry.body, entry.type);
+}
+
+bool MicroCache::Serve(const Route& route, HttpRequest& request, HttpResponse& response, const char* srcDir) {
+    string key = Key_(route, request);
+    if(key.empty()) { return false; }
+    Shard& shard = ShardOf_(key);
+    int64_t now = NowMS_();
+
+    unique_lock<mutex> locker(shard.mtx);
+    auto it = shard.entries.find(key);
+    if(it != shard.entries.end()) {
+        shared_ptr<Entry> entry = it->second;
+        shard.lru.splice(shard.lru.begin(), shard.lru, entry->lru);  // 移到 LRU 头部
+        if(now < entry->expires) {
+            hits_++;
+            Fill_(response, *entry);
+            return true;
+        }
+        if(now < entry->staleUntil && executor_) {
+            // 返回旧内容，第一个发现过期的请求发起后台刷新
+            stale_++;
+            bool refresh = !entry->refreshing;
+            entry->refreshing = true;
+            locker.unlock();
+            Fill_(response, *entry);
+            if(refresh) { Refresh_(&route, request, key, srcDir); }
+            return true;
+        }
+    }
+    misses_++;
+
+    // 已有线程在生成同一个 key：等待其结果，结果不可缓存时自行调用处理函数
+    auto fit = shard.flights.find(key);
+    if(fit != shard.flights.end()) {
+        shared_ptr<Flight> flight = fit->second;
+        coalesced_++;
+        flight->cond.wait(locker, [&flight] { return flight->done; });
+        if(!flight->entry) { return false; }
+        Fill_(response, *flight->entry);
+        return true;
+    }
+
+    // 第一个未命中的请求负责生成，处理函数执行期间不持有锁
+    shared_ptr<Flight> flight = make_shared<Flight>();
+    shard.flights[key] = flight;
+    locker.unlock();
+
+    Run_(route, request, response);
+
+    locker.lock();
+    shared_ptr<Entry> entry = Store_(shard, key, route, response);
+    flight->done = true;
+    flight->entry = entry;
+    shard.flights.erase(key);
+    locker.unlock();
+    flight->cond.notify_all();
+    if(entry) { Fill_(response, *entry); }  // 与缓存共享响应体
+    return true;
+}
+// 后台重新生成：请求复制一份交给 executor_，完成后替换缓存项
+void MicroCache::Refresh_(const Route* route, const HttpRequest& request, const string& key, const char* srcDir) {
+    refreshes_++;
+    HttpRequest copy = request;
+    executor_([this, route, copy, key, srcDir]() mutable {
+        HttpResponse response;
+        response.Init(srcDir, copy.PathRef(), false, 200);
+        Run_(*route, copy, response);
+        Shard& shard = ShardOf_(key);
+        lock_guard<mutex> locker(shard.mtx);
+        if(!Store_(shard, key, *route, response)) {
+            // 新结果不可缓存：旧内容保留到 stale 窗口结束，之后按未命中处理
+            auto it = shard.entries.find(key);
+            if(it != shard.entries.end()) { it->second->refreshing = false; }
+        }
+    });
+}
+// 只缓存 200 的内存响应 (不含 stream)；持有 shard.mtx 时调用，返回新的缓存项，不可缓存时返回 nullptr
+shared_ptr<MicroCache::Entry> MicroCache::Store_(Shard& shard, const string& key, const Route& route,
+                                                const HttpResponse& response) {
+    if(response.Code() != 200 || !response.HasContent() || response.GetStream() ||
+       response.Content().size() > MAX_ENTRY_SIZE) {
+        return nullptr;
+    }
+    shared_ptr<Entry> entry = make_shared<Entry>();
+    entry->key = key;
+    entry->type = response.ContentType();
+    entry->body = make_shared<const string>(response.Content());
+    entry->expires = NowMS_() + route.cacheTtl;
+    entry->staleUntil = entry->expires + route.cacheStale;
+    entry->refreshing = false;
+    entry->bytes = key.size() + entry->type.size() + entry->body->size() + sizeof(Entry);
+
+    if(shard.entries.count(key)) { Erase_(shard, key); }
+    shard.lru.push_front(key);
+    entry->lru = shard.lru.begin();
+    shard.entries[key] = entry;
+    shard.bytes += entry->bytes;
+    MemBudget::Instance()->Add(MemBudget::MICRO_CACHE, entry->bytes);
+    // 超过分片的上限时从 LRU 尾部淘汰
+    while(shard.bytes > MAX_BYTES / SHARDS && shard.lru.size() > 1) {
+        Erase_(shard, shard.lru.back());
+        evictions_++;
+    }
+    return entry;
+}
+
+void MicroCache::Erase_(Shard& shard, const string& key) {
+    auto it = shard.entries.find(key);
+    assert(it != shard.entries.end());
+    shard.bytes -= it->second->bytes;
+    MemBudget::Instance()->Add(MemBudget::MICRO_CACHE, -static_cast<int64_t>(it->second->bytes));
+    shard.lru.erase(it->second->lru);
+    shard.entries.erase(it);
+}
+
+// 先从各分片平均淘汰，仍然不够时再依次淘汰
+size_t MicroCache::Trim(size_t bytes) {
+    size_t freed = 0;
+    size_t share = (bytes + SHARDS - 1) / SHARDS;
+    for(int pass = 0; pass < 2 && freed < bytes; pass++) {
+        for(auto& shard : shards_) {
+            lock_guard<mutex> locker(shard.mtx);
+            size_t before = shard.bytes;
+            while(freed + before - shard.bytes < bytes && (pass > 0 || before - shard.bytes < share) &&
+                  !shard.lru.empty()) {
+                Erase_(shard, shard.lru.back());
+                evictions_++;
+            }
+            freed += before - shard.bytes;
+        }
+    }
+    return freed;
+}
+
+MicroCache::Stats MicroCache::GetStats() {
+    Stats stats = { 0 };
+    stats.hits = hits_;
+    stats.stale = stale_;
+    stats.misses = misses_;
+    stats.coalesced = coalesced_;
+    stats.refreshes = refreshes_;
+    stats.evictions = evictions_;
+    for(auto& shard : shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        stats.entries += shard.entries.size();
+        stats.bytes += shard.bytes;
+    }
+    return stats;
+}
+// 文本格式的统计信息，每行一个指标
+string MicroCache::StatsStr() {
+    Stats s = GetStats();
+    string str;
+    str += "microcache_hits " + to_string(s.hits) + "\n";
+    str += "microcache_stale " + to_string(s.stale) + "\n";
+    str += "microcache_misses " + to_string(s.misses) + "\n";
+    str += "microcache_coalesced " + to_string(s.coalesced) + "\n";
+    str += "microcache_refreshes " + to_string(s.refreshes) + "\n";
+    str += "microcache_evictions " + to_string(s.evictions) + "\n";
+    str += "microcache_entries " + to_string(s.entries) + "\n";
+    str += "microcache_bytes " + to_string(s.bytes) + "\n";
+    return str;
+}
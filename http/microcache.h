@@ -0,0 +1,107 @@
+#ifndef MICRO_CACHE_H
+#define MICRO_CACHE_H
+
+#include <unordered_map>
+#include <list>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+#include "../timer/cachedclock.h"
+#include "../log/log.h"
+#include "../buffer/membudget.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+#include "router.h"
+
+// 处理函数响应的短时缓存，key 为 方法 + 路径 (含查询串) + 路由指定的请求头
+// 新鲜期内直接返回；过期后的 stale 窗口内仍返回旧内容，同时只由一个后台任务重新生成
+// 按 key 的哈希分片加锁，每个分片单独 LRU 淘汰，总大小不超过 MAX_BYTES
+class MicroCache {
+public:
+    typedef std::function<void(std::function<void()>)> Executor;  // 后台刷新任务的执行者
+
+    struct Stats {
+        uint64_t hits;       // 新鲜命中
+        uint64_t stale;      // 返回过期内容
+        uint64_t misses;     // 未命中，同步调用处理函数
+        uint64_t coalesced;  // 等待其他线程生成结果的请求数
+        uint64_t refreshes;  // 后台刷新次数
+        uint64_t evictions;
+        size_t entries;
+        size_t bytes;
+    };
+
+    static MicroCache* Instance();
+
+    void SetExecutor(Executor executor) { executor_ = executor; }
+
+    // route 开启了缓存时由缓存填充 response (必要时调用处理函数并存入缓存)
+    // 返回 false 表示该请求不使用缓存，由调用者直接调用处理函数
+    bool Serve(const Route& route, HttpRequest& request, HttpResponse& response, const char* srcDir);
+
+    // 内存超出预算时调用：按 LRU 淘汰，直到释放 bytes 字节或缓存为空，返回释放的字节数
+    size_t Trim(size_t bytes);
+
+    Stats GetStats();
+    std::string StatsStr();
+
+    static const int SHARDS = 16;
+    static const size_t MAX_BYTES = 64 << 20;       // 所有分片的总大小上限
+    static const size_t MAX_ENTRY_SIZE = 1 << 20;   // 超过该大小的响应不缓存
+
+private:
+    struct Entry {
+        std::string key;
+        std::string type;
+        std::shared_ptr<const std::string> body;
+        int64_t expires;     // 新鲜期结束时间 (毫秒)
+        int64_t staleUntil;  // stale 窗口结束时间
+        bool refreshing;     // 已有后台任务在刷新
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+    // 一次正在进行的同步生成，同一 key 后到的请求等待其结果
+    struct Flight {
+        Flight() : done(false) {}
+        bool done;
+        std::shared_ptr<Entry> entry;  // 结果不可缓存时为 nullptr
+        std::condition_variable cond;
+    };
+    struct Shard {
+        Shard() : bytes(0) {}
+        std::mutex mtx;
+        std::unordered_map<std::string, std::shared_ptr<Entry>> entries;
+        std::unordered_map<std::string, std::shared_ptr<Flight>> flights;
+        std::list<std::string> lru;  // 头部为最近使用
+        size_t bytes;
+    };
+
+    MicroCache() = default;
+
+    static std::string Key_(const Route& route, const HttpRequest& request);
+    static void Run_(const Route& route, HttpRequest& request, HttpResponse& response);
+    std::shared_ptr<Entry> Store_(Shard& shard, const std::string& key, const Route& route,
+                                  const HttpResponse& response);
+    void Refresh_(const Route* route, const HttpRequest& request, const std::string& key, const char* srcDir);
+    void Erase_(Shard& shard, const std::string& key);
+    Shard& ShardOf_(const std::string& key);
+    static void Fill_(HttpResponse& response, const Entry& entry);
+    static int64_t NowMS_();
+
+    Shard shards_[SHARDS];
+    Executor executor_;
+
+    std::atomic<uint64_t> hits_{0};
+    std::atomic<uint64_t> stale_{0};
+    std::atomic<uint64_t> misses_{0};
+    std::atomic<uint64_t> coalesced_{0};
+    std::atomic<uint64_t> refreshes_{0};
+    std::atomic<uint64_t> evictions_{0};
+};
+
+#endif //MICRO_CACHE_H
@@ -0,0 +1,328 @@
+#include "proxyconn.h"
+
+using namespace std;
+
+// 逐跳 (hop-by-hop) 头部，不转发
+static bool IsHopHeader(const StrRef& name) {
+    static const char* HOP[] = { "Connection", "Keep-Alive", "Proxy-Connection", "TE", "Trailer",
+                                 "Transfer-Encoding", "Upgrade", "Content-Length", "X-Forwarded-For" };
+    for(const char* hop : HOP) {
+        if(name.EqualsIgnoreCase(hop)) { return true; }
+    }
+    return false;
+}
+
+ProxyConn::ProxyConn(Upstream* upstream, const HttpRequest& request, const string& clientIp)
+    : upstream_(upstream), backend_(0), fd_(-1), reused_(false), state_(CONNECTING), 
+      failed_(false), timedOut_(false), aborted_(false), paused_(false), clientIdle_(true), 
+      clientKeepAlive_(request.IsKeepAlive()), upstreamKeepAlive_(false), 
+      headRequest_(request.method() == "HEAD"), relayed_(0), sent_(0),
+      chunked_(false), untilClose_(false), remaining_(0), chunkState_(CHUNK_SIZE), chunkLeft_(0) {
+    // 转发给上游的请求：HTTP/1.1 keep-alive，追加 X-Forwarded-For
+    request_ = request.method() + " " + request.path() + " HTTP/1.1\r\n";
+    for(const auto& h : request.headers()) {
+        if(!IsHopHeader(h.name)) {
+            request_ += h.name.Str() + ": " + h.value.Str() + "\r\n";
+        }
+    }
+    string xff = request.GetHeader("X-Forwarded-For");
+    request_ += "X-Forwarded-For: " + (xff.empty() ? clientIp : xff + ", " + clientIp) + "\r\n";
+    request_ += "Connection: keep-alive\r\n";
+    string body = request.body();
+    if(!body.empty() || !request.GetHeader("Content-Length").empty()) {
+        request_ += "Content-Length: " + to_string(body.size()) + "\r\n";
+    }
+    request_ += "\r\n" + body;
+}
+
+ProxyConn::~ProxyConn() {
+    assert(!timer_.prev);  // 已从时间轮中取消
+    if(fd_ >= 0) { upstream_->Release(backend_, fd_, false); }
+}
+
+int ProxyConn::Connect() {
+    lock_guard<mutex> locker(mtx_);
+    fd_ = upstream_->Acquire(&backend_, &reused_);
+    if(fd_ < 0) {
+        Fail_("no upstream available");
+        return -1;
+    }
+    state_ = reused_ ? SENDING : CONNECTING;
+    LOG_DEBUG("Proxy %s -> %s, fd:%d, reused:%d", upstream_->Prefix().c_str(), 
+              upstream_->Name(backend_).c_str(), fd_, reused_);
+    return fd_;
+}
+
+uint32_t ProxyConn::OnEvent(bool* wakeClient) {
+    lock_guard<mutex> locker(mtx_);
+    *wakeClient = false;
+    if(aborted_ && state_ != DONE) {
+        Fail_("client closed");
+    }
+    if(state_ == CONNECTING) {
+        // 非阻塞 connect 完成后 socket 可写，通过 SO_ERROR 判断是否成功
+        int err = 0;
+        socklen_t len = sizeof(err);
+        getsockopt(fd_, SOL_SOCKET, SO_ERROR, &err, &len);
+        if(err != 0) {
+            upstream_->MarkFailed(backend_);
+            Fail_("connect error");
+        } else {
+            state_ = SENDING;
+        }
+    }
+    if(state_ == SENDING) {
+        if(!Send_()) {
+            Fail_("send error");
+        } else if(sent_ < request_.size()) {
+            return EPOLLOUT;
+        } else {
+            state_ = HEAD;
+            upstreamKeepAlive_ = true;
+        }
+    }
+    if(state_ == HEAD || state_ == BODY) {
+        Recv_();
+    }
+    if(clientIdle_ && (out_.ReadableBytes() > 0 || state_ == DONE)) {
+        clientIdle_ = false;
+        *wakeClient = true;
+    }
+    if(state_ == DONE) { return 0; }
+    if(out_.ReadableBytes() >= HIGH_WATER) {
+        paused_ = true;
+        return 0;
+    }
+    return EPOLLIN;
+}
+
+bool ProxyConn::IsFinished() {
+    lock_guard<mutex> locker(mtx_);
+    return state_ == DONE;
+}
+
+ProxyConn::DRAIN_STATE ProxyConn::Drain(ChainBuffer& buff, int* resumeFd) {
+    lock_guard<mutex> locker(mtx_);
+    *resumeFd = -1;
+    if(failed_ && relayed_ == 0) {
+        out_.RetrieveAll();  // 不完整的响应丢弃，改为返回 502 / 504
+        return timedOut_ ? DRAIN_GATEWAY_TIMEOUT : DRAIN_BAD_GATEWAY;
+    }
+    if(out_.ReadableBytes() > 0) {
+        relayed_ += out_.ReadableBytes();
+        buff.Append(out_);
+        out_.RetrieveAll();
+        if(paused_ && state_ != DONE) {
+            paused_ = false;
+            *resumeFd = fd_;
+        }
+        return DRAIN_DATA;
+    }
+    if(state_ == DONE) {
+        return failed_ ? DRAIN_FAILED : DRAIN_DONE;
+    }
+    clientIdle_ = true;
+    return DRAIN_WAIT;
+}
+
+void ProxyConn::ReleaseUpstream() {
+    lock_guard<mutex> locker(mtx_);
+    if(fd_ < 0) { return; }
+    // 响应完整读完、没有多余数据时连接才能复用
+    bool keepAlive = !failed_ && state_ == DONE && upstreamKeepAlive_ && in_.ReadableBytes() == 0;
+    upstream_->Release(backend_, fd_, keepAlive);
+    fd_ = -1;
+}
+
+void ProxyConn::Abort() {
+    lock_guard<mutex> locker(mtx_);
+    aborted_ = true;
+    clientIdle_ = false;
+    Fail_("client closed");  // 已经读完的响应不受影响，上游连接仍可复用
+}
+
+bool ProxyConn::Timeout(bool* wakeClient) {
+    lock_guard<mutex> locker(mtx_);
+    *wakeClient = false;
+    if(paused_ && state_ != DONE) { return false; }
+    if(state_ != DONE) {
+        timedOut_ = true;
+        Fail_("timeout");
+    }
+    if(clientIdle_) {
+        clientIdle_ = false;
+        *wakeClient = true;
+    }
+    return true;
+}
+
+bool ProxyConn::KeepAlive() {
+    lock_guard<mutex> locker(mtx_);
+    return clientKeepAlive_ && !failed_ && !untilClose_;
+}
+
+bool ProxyConn::Send_() {
+    while(sent_ < request_.size()) {
+        ssize_t len = send(fd_, request_.data() + sent_, request_.size() - sent_, MSG_NOSIGNAL);
+        if(len < 0) {
+            return errno == EAGAIN || errno == EWOULDBLOCK;
+        }
+        sent_ += len;
+    }
+    return true;
+}
+// 读上游直到 EAGAIN，待转发的数据超过 HIGH_WATER 时停止
+void ProxyConn::Recv_() {
+    while(state_ != DONE && out_.ReadableBytes() < HIGH_WATER) {
+        int err = 0;
+        ssize_t len = in_.ReadFd(fd_, &err);
+        if(len > 0) {
+            while(state_ == HEAD && ParseHead_()) {}
+            if(state_ == BODY) { ParseBody_(); }
+            continue;
+        }
+        if(len == 0) {
+            if(state_ == BODY && untilClose_) {
+                state_ = DONE;  // 没有长度信息的响应以连接关闭结束
+            } else {
+                Fail_("upstream closed");
+            }
+        } else if(err != EAGAIN && err != EWOULDBLOCK) {
+            Fail_("read error");
+        }
+        break;
+    }
+}
+// 解析上游的状态行和响应头，去掉逐跳头部后转发
+// 1xx 临时响应直接丢弃，返回 true 继续解析最终响应
+bool ProxyConn::ParseHead_() {
+    const char CRLF2[] = "\r\n\r\n";
+    const char* end = search(in_.Peek(), in_.BeginWriteConst(), CRLF2, CRLF2 + 4);
+    if(end == in_.BeginWriteConst()) {
+        if(in_.ReadableBytes() > MAX_HEAD) { Fail_("response head too large"); }
+        return false;
+    }
+    string head(in_.Peek(), end + 2);
+    in_.RetrieveUntil(end + 4);
+    size_t lineEnd = head.find("\r\n");
+    string statusLine = head.substr(0, lineEnd);
+    if(statusLine.compare(0, 5, "HTTP/") != 0 || statusLine.size() < 12) {
+        Fail_("invalid status line");
+        return false;
+    }
+    int code = atoi(statusLine.c_str() + 9);
+    if(code >= 100 && code < 200) { return true; }
+    upstreamKeepAlive_ = statusLine.compare(5, 3, "1.1") == 0;
+
+    string out = statusLine + "\r\n";
+    bool hasLength = false;
+    size_t pos = lineEnd + 2;
+    while(pos < head.size()) {
+        size_t next = head.find("\r\n", pos);
+        string line = head.substr(pos, next - pos);
+        pos = next + 2;
+        size_t colon = line.find(':');
+        if(colon == string::npos) { continue; }
+        string name = line.substr(0, colon);
+        size_t vb = line.find_first_not_of(' ', colon + 1);
+        string value = (vb == string::npos) ? "" : line.substr(vb);
+        if(strcasecmp(name.c_str(), "Connection") == 0) {
+            if(strcasestr(value.c_str(), "close")) { upstreamKeepAlive_ = false; }
+            if(strcasestr(value.c_str(), "keep-alive")) { upstreamKeepAlive_ = true; }
+            continue;
+        }
+        if(strcasecmp(name.c_str(), "Keep-Alive") == 0 || strcasecmp(name.c_str(), "Proxy-Connection") == 0) {
+            continue;
+        }
+        if(strcasecmp(name.c_str(), "Transfer-Encoding") == 0 && strcasestr(value.c_str(), "chunked")) {
+            chunked_ = true;
+        }
+        if(strcasecmp(name.c_str(), "Content-Length") == 0) {
+            hasLength = true;
+            remaining_ = strtoull(value.c_str(), nullptr, 10);
+        }
+        out += line + "\r\n";
+    }
+    bool noBody = headRequest_ || code == 204 || code == 304;
+    if(!noBody && !chunked_ && !hasLength) {
+        untilClose_ = true;
+        upstreamKeepAlive_ = false;
+    }
+    out += (clientKeepAlive_ && !untilClose_) ? "Connection: keep-alive\r\n\r\n" : "Connection: close\r\n\r\n";
+    out_.Append(out);
+    state_ = (noBody || (!chunked_ && hasLength && remaining_ == 0)) ? DONE : BODY;
+    return false;
+}
+// 响应体原样转发，只跟踪长度以确定响应结束的位置
+void ProxyConn::ParseBody_() {
+    size_t len = in_.ReadableBytes();
+    if(untilClose_) {
+        out_.Append(in_.Peek(), len);
+        in_.RetrieveAll();
+        return;
+    }
+    if(chunked_) {
+        size_t consumed = 0;
+        if(!ParseChunked_(&consumed)) {
+            Fail_("invalid chunked body");
+            return;
+        }
+        out_.Append(in_.Peek(), consumed);
+        in_.Retrieve(consumed);
+        return;
+    }
+    size_t n = min(len, remaining_);
+    out_.Append(in_.Peek(), n);
+    in_.Retrieve(n);
+    remaining_ -= n;
+    if(remaining_ == 0) { state_ = DONE; }
+}
+// chunked 编码：size CRLF data CRLF ... 0 CRLF [trailer CRLF] CRLF
+// *consumed 为本次可以转发的完整部分的长度
+bool ProxyConn::ParseChunked_(size_t* consumed) {
+    const char* data = in_.Peek();
+    size_t len = in_.ReadableBytes();
+    size_t pos = 0;
+    while(pos < len && state_ != DONE) {
+        if(chunkState_ == CHUNK_DATA) {
+            size_t n = min(chunkLeft_, len - pos);
+            pos += n;
+            chunkLeft_ -= n;
+            if(chunkLeft_ == 0) { chunkState_ = CHUNK_DATA_CRLF; }
+            continue;
+        }
+        if(chunkState_ == CHUNK_DATA_CRLF) {
+            if(len - pos < 2) { break; }
+            if(data[pos] != '\r' || data[pos + 1] != '\n') { return false; }
+            pos += 2;
+            chunkState_ = CHUNK_SIZE;
+            continue;
+        }
+        const char* lineEnd = static_cast<const char*>(memmem(data + pos, len - pos, "\r\n", 2));
+        if(!lineEnd) {
+            if(len - pos > 1024) { return false; }  // 长度行或 trailer 过长
+            break;
+        }
+        size_t lineLen = lineEnd - (data + pos);
+        if(chunkState_ == CHUNK_SIZE) {
+            char* endp = nullptr;
+            unsigned long long size = strtoull(data + pos, &endp, 16);
+            if(endp == data + pos) { return false; }
+            chunkLeft_ = size;
+            chunkState_ = size == 0 ? CHUNK_TRAILER : CHUNK_DATA;
+        } else if(lineLen == 0) {  // CHUNK_TRAILER 的空行，响应结束
+            state_ = DONE;
+        }
+        pos += lineLen + 2;
+    }
+    *consumed = pos;
+    return true;
+}
+
+void ProxyConn::Fail_(const char* reason) {
+    if(state_ == DONE) { return; }
+    LOG_WARN("Proxy %s fd:%d error: %s", upstream_->Prefix().c_str(), fd_, reason);
+    failed_ = true;
+    upstreamKeepAlive_ = false;
+    state_ = DONE;
+}
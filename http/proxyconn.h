@@ -0,0 +1,108 @@
+#ifndef PROXY_CONN_H
+#define PROXY_CONN_H
+
+#include <string>
+#include <mutex>
+#include <algorithm>
+#include <string.h>
+#include <strings.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "httprequest.h"
+#include "gateway.h"
+#include "upstream.h"
+#include "../timer/timewheel.h"
+
+// 一次代理请求：把请求发给上游，并把上游的响应边收边转发给客户端
+// 上游 fd 的事件与客户端的写事件在不同 worker 中处理，二者共享的状态由 mtx_ 保护
+// 上游读到的数据积压超过 HIGH_WATER 时暂停读上游，客户端取走数据后再恢复
+class ProxyConn : public Gateway {
+public:
+    ProxyConn(Upstream* upstream, const HttpRequest& request, const std::string& clientIp);
+    ~ProxyConn();
+
+    // 取得上游连接，返回 fd，失败返回 -1
+    int Connect();
+    int Fd() const { return fd_; }
+
+    // 处理上游 fd 上的事件 (worker 中调用)
+    // 返回需要重新注册的事件，0 表示暂停或已结束 (IsFinished)
+    // *wakeClient 为 true 时客户端在等待数据，需要为其注册 EPOLLOUT
+    uint32_t OnEvent(bool* wakeClient);
+    bool IsFinished();
+
+    DRAIN_STATE Drain(ChainBuffer& buff, int* resumeFd) override;
+
+    // 结束后释放上游连接：响应完整且可复用时放回连接池
+    void ReleaseUpstream();
+    // 客户端提前关闭：本次代理失败，调用方随后释放上游连接
+    void Abort();
+    // 上游超过不活动超时 (主线程的超时回调中调用)：本次代理失败，尚未转发数据时客户端收到 504
+    // 因客户端接收过慢而暂停读上游时不算超时，返回 false
+    bool Timeout(bool* wakeClient);
+    // 上游的不活动超时，由 WebServer 的时间轮管理，释放上游连接时取消
+    TimerNode* Timer() { return &timer_; }
+
+    bool KeepAlive() override;
+
+    static const size_t HIGH_WATER = 256 << 10;    // 待转发数据的积压上限
+    static const size_t MAX_HEAD = 64 << 10;       // 上游响应头上限
+
+private:
+    enum STATE {
+        CONNECTING = 0,
+        SENDING,
+        HEAD,
+        BODY,
+        DONE,
+    };
+    enum CHUNK_STATE {
+        CHUNK_SIZE = 0,
+        CHUNK_DATA,
+        CHUNK_DATA_CRLF,
+        CHUNK_TRAILER,
+    };
+
+    bool Send_();
+    void Recv_();
+    bool ParseHead_();
+    void ParseBody_();
+    bool ParseChunked_(size_t* consumed);
+    void Fail_(const char* reason);
+
+    Upstream* upstream_;
+    size_t backend_;
+    int fd_;
+    bool reused_;
+
+    std::mutex mtx_;
+    STATE state_;
+    bool failed_;
+    bool timedOut_;
+    bool aborted_;
+    bool paused_;          // 积压过多，暂停读上游
+    bool clientIdle_;      // 客户端没有数据可发，等待唤醒
+    bool clientKeepAlive_;
+    bool upstreamKeepAlive_;
+    bool headRequest_;
+    size_t relayed_;       // 已交给客户端的字节数
+
+    std::string request_;  // 发往上游的请求
+    size_t sent_;
+    Buffer in_;            // 从上游读到、尚未解析的数据
+    Buffer out_;           // 待转发给客户端的数据
+
+    // 响应体的长度：Content-Length、chunked，或读到 EOF 为止
+    bool chunked_;
+    bool untilClose_;
+    size_t remaining_;
+    CHUNK_STATE chunkState_;
+    size_t chunkLeft_;
+
+    TimerNode timer_;
+};
+
+#endif //PROXY_CONN_H
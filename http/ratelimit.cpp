@@ -0,0 +1,151 @@
+#include "ratelimit.h"
+
+using namespace std;
+
+const char RateLimit::RESPONSE_429[] =
+        "HTTP/1.1 429 Too Many Requests\r\n"
+        "Connection: close\r\n"
+        "Retry-After: 1\r\n"
+        "Content-type: text/plain\r\n"
+        "Content-length: 18\r\n\r\n"
+        "Too many requests\n";
+
+RateLimit* RateLimit::Instance() {
+    static RateLimit inst;  // 静态单例
+    return &inst;
+}
+
+int64_t RateLimit::NowMS_() {
+    return CachedClock::NowMS();
+}
+
+void RateLimit::SetIpLimits(const Limits& limits) {
+    ip_ = limits;
+    if(ip_.burst < ip_.rate) { ip_.burst = ip_.rate; }
+    open_ = ip_.rate > 0 || ip_.maxConns > 0 || prefix_.rate > 0 || prefix_.maxConns > 0;
+    LOG_INFO("Rate limit per IP: %d/s, burst %d, conns %d", ip_.rate, ip_.burst, ip_.maxConns);
+}
+
+void RateLimit::SetPrefixLimits(const Limits& limits) {
+    prefix_ = limits;
+    if(prefix_.burst < prefix_.rate) { prefix_.burst = prefix_.rate; }
+    open_ = ip_.rate > 0 || ip_.maxConns > 0 || prefix_.rate > 0 || prefix_.maxConns > 0;
+    LOG_INFO("Rate limit per /24: %d/s, burst %d, conns %d", prefix_.rate, prefix_.burst, prefix_.maxConns);
+}
+
+RateLimit::Shard& RateLimit::ShardOf_(uint64_t key) {
+    // 同一网段的地址低位不同，乘法哈希后取高位，分散到各个分片
+    return shards_[(key * 0x9E3779B97F4A7C15ULL) >> 58];
+}
+// IP 与网段都未超过连接数上限时才计数
+bool RateLimit::Connect(in_addr_t addr) {
+    if(!open_) { return true; }
+    if(ip_.maxConns > 0 && !Connect_(IpKey_(addr), ip_.maxConns)) {
+        rejectedConns_++;
+        return false;
+    }
+    if(prefix_.maxConns > 0 && !Connect_(PrefixKey_(addr), prefix_.maxConns)) {
+        if(ip_.maxConns > 0) { Disconnect_(IpKey_(addr)); }
+        rejectedConns_++;
+        return false;
+    }
+    return true;
+}
+
+void RateLimit::Disconnect(in_addr_t addr) {
+    if(ip_.maxConns > 0) { Disconnect_(IpKey_(addr)); }
+    if(prefix_.maxConns > 0) { Disconnect_(PrefixKey_(addr)); }
+}
+// IP 的令牌取到而网段的桶为空时，IP 的令牌不退回
+bool RateLimit::Acquire(in_addr_t addr) {
+    if(!open_) { return true; }
+    int64_t now = NowMS_();
+    if((ip_.rate > 0 && !Acquire_(IpKey_(addr), ip_, now)) ||
+       (prefix_.rate > 0 && !Acquire_(PrefixKey_(addr), prefix_, now))) {
+        rejectedRequests_++;
+        return false;
+    }
+    return true;
+}
+
+bool RateLimit::Connect_(uint64_t key, int maxConns) {
+    Shard& shard = ShardOf_(key);
+    lock_guard<mutex> locker(shard.mtx);
+    Bucket& bucket = Find_(shard, key, (key >> 32) ? prefix_ : ip_, NowMS_());
+    if(bucket.conns >= maxConns) { return false; }
+    bucket.conns++;
+    return true;
+}
+
+void RateLimit::Disconnect_(uint64_t key) {
+    Shard& shard = ShardOf_(key);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.buckets.find(key);
+    if(it != shard.buckets.end() && it->second.conns > 0) {
+        it->second.conns--;
+    }
+}
+
+bool RateLimit::Acquire_(uint64_t key, const Limits& limits, int64_t now) {
+    Shard& shard = ShardOf_(key);
+    lock_guard<mutex> locker(shard.mtx);
+    Bucket& bucket = Find_(shard, key, limits, now);
+    Refill_(bucket, limits, now);
+    if(bucket.tokens < MILLI) { return false; }
+    bucket.tokens -= MILLI;
+    return true;
+}
+// 持有 shard.mtx 时调用，不存在时创建满的桶
+RateLimit::Bucket& RateLimit::Find_(Shard& shard, uint64_t key, const Limits& limits, int64_t now) {
+    auto it = shard.buckets.find(key);
+    if(it != shard.buckets.end()) { return it->second; }
+    if(shard.buckets.size() >= shard.sweepAt) { Sweep_(shard, now); }
+    Bucket& bucket = shard.buckets[key];
+    bucket.tokens = limits.burst * MILLI;
+    bucket.last = now;
+    bucket.conns = 0;
+    return bucket;
+}
+// 每毫秒补充 rate 个毫令牌，即每秒 rate 个令牌
+void RateLimit::Refill_(Bucket& bucket, const Limits& limits, int64_t now) {
+    int64_t elapsed = now - bucket.last;
+    if(elapsed <= 0) { return; }
+    int64_t full = limits.burst * MILLI;
+    bucket.tokens = min(full, bucket.tokens + elapsed * limits.rate);
+    bucket.last = now;
+}
+// 没有连接且已经回满的桶与新建的桶相同，可以删除；清理后分片大小翻倍时才再次清理
+void RateLimit::Sweep_(Shard& shard, int64_t now) {
+    for(auto it = shard.buckets.begin(); it != shard.buckets.end(); ) {
+        const Limits& limits = (it->first >> 32) ? prefix_ : ip_;
+        Bucket& bucket = it->second;
+        Refill_(bucket, limits, now);
+        if(bucket.conns == 0 && bucket.tokens >= limits.burst * MILLI) {
+            it = shard.buckets.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    size_t sweepAt = shard.buckets.size() * 2;
+    shard.sweepAt = sweepAt > SWEEP_MIN ? sweepAt : SWEEP_MIN;
+}
+
+RateLimit::Stats RateLimit::GetStats() {
+    Stats stats = { 0 };
+    stats.rejectedConns = rejectedConns_;
+    stats.rejectedRequests = rejectedRequests_;
+    for(auto& shard : shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        stats.buckets += shard.buckets.size();
+    }
+    return stats;
+}
+// 文本格式的统计信息，每行一个指标
+string RateLimit::StatsStr() {
+    Stats s = GetStats();
+    string str;
+    str += "ratelimit_rejected_conns " + to_string(s.rejectedConns) + "\n";
+    str += "ratelimit_rejected_requests " + to_string(s.rejectedRequests) + "\n";
+    str += "ratelimit_buckets " + to_string(s.buckets) + "\n";
+    return str;
+}
@@ -0,0 +1,89 @@
+#ifndef RATE_LIMIT_H
+#define RATE_LIMIT_H
+
+#include <unordered_map>
+#include <string>
+#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include <netinet/in.h>
+
+#include "../timer/cachedclock.h"
+#include "../log/log.h"
+
+// 按客户端 IP 与所在 /24 网段的限流：令牌桶限制每秒请求数，另外限制同时打开的连接数
+// 桶按 key 的哈希分片加锁，只在分片变大时顺带清理已回满且没有连接的桶 (等同于新桶)
+// 默认不开启，各项为 0 表示不限制
+class RateLimit {
+public:
+    struct Limits {
+        int rate;      // 每秒补充的令牌 (请求) 数
+        int burst;     // 桶容量，允许的突发请求数
+        int maxConns;  // 同时打开的连接数
+    };
+    struct Stats {
+        uint64_t rejectedConns;
+        uint64_t rejectedRequests;
+        size_t buckets;
+    };
+
+    static RateLimit* Instance();
+
+    // 在服务器启动前设置
+    void SetIpLimits(const Limits& limits);
+    void SetPrefixLimits(const Limits& limits);
+    bool IsOpen() const { return open_; }
+
+    // 新连接：未超过连接数上限时计数并返回 true，之后须调用 Disconnect
+    bool Connect(in_addr_t addr);
+    void Disconnect(in_addr_t addr);
+    // 新请求：取一个令牌，桶为空时返回 false
+    bool Acquire(in_addr_t addr);
+
+    Stats GetStats();
+    std::string StatsStr();
+
+    static const char RESPONSE_429[];  // 预先生成的完整响应，之后关闭连接
+
+    static const int SHARDS = 64;
+    static const size_t SWEEP_MIN = 1024;  // 分片中的桶超过该数目后才清理
+    static const int64_t MILLI = 1000;     // 令牌以 1/1000 为单位，整数运算
+
+private:
+    struct Bucket {
+        int64_t tokens;  // 毫令牌
+        int64_t last;    // 上次补充的时间 (毫秒)
+        int conns;
+    };
+    // 独占缓存行，避免相邻分片的锁互相影响
+    struct alignas(64) Shard {
+        Shard() : sweepAt(SWEEP_MIN) {}
+        std::mutex mtx;
+        std::unordered_map<uint64_t, Bucket> buckets;
+        size_t sweepAt;
+    };
+
+    RateLimit() : open_(false) { ip_ = prefix_ = { 0, 0, 0 }; }
+
+    bool Connect_(uint64_t key, int maxConns);
+    void Disconnect_(uint64_t key);
+    bool Acquire_(uint64_t key, const Limits& limits, int64_t now);
+    Bucket& Find_(Shard& shard, uint64_t key, const Limits& limits, int64_t now);
+    void Refill_(Bucket& bucket, const Limits& limits, int64_t now);
+    void Sweep_(Shard& shard, int64_t now);
+    Shard& ShardOf_(uint64_t key);
+    // IP 与网段使用同一张表，高 32 位区分
+    static uint64_t IpKey_(in_addr_t addr) { return ntohl(addr); }
+    static uint64_t PrefixKey_(in_addr_t addr) { return (1ULL << 32) | (ntohl(addr) & 0xFFFFFF00); }
+    static int64_t NowMS_();
+
+    bool open_;
+    Limits ip_;
+    Limits prefix_;
+    Shard shards_[SHARDS];
+
+    std::atomic<uint64_t> rejectedConns_{0};
+    std::atomic<uint64_t> rejectedRequests_{0};
+};
+
+#endif //RATE_LIMIT_H
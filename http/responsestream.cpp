@@ -0,0 +1,184 @@
+#include "responsestream.h"
+#include "httprequest.h"
+#include "httpresponse.h"
+
+using namespace std;
+
+shared_ptr<ResponseStream> ResponseStream::Start(HttpRequest& request, HttpResponse& response,
+                                                 const string& type) {
+    bool chunked = request.version() == "1.1";
+    bool headRequest = request.method() == "HEAD";
+    shared_ptr<ResponseStream> stream = make_shared<ResponseStream>(
+            chunked, chunked && request.IsKeepAlive(), headRequest);
+    response.SetStream(stream, type);
+#ifdef WITH_GZIP
+    if(!headRequest && Gzip::Instance()->Accepted(request) && HttpResponse::Compressible(type)) {
+        stream->gzip_.reset(new GzipEncoder(Gzip::Instance()->Level()));
+        response.SetEncoding("gzip");
+    }
+#endif
+    return stream;
+}
+
+ResponseStream::ResponseStream(bool chunked, bool keepAlive, bool headRequest)
+    : chunked_(chunked), keepAlive_(keepAlive), headRequest_(headRequest),
+      clientIdle_(false), paused_(false), done_(false), aborted_(false), finished_(false) {
+#ifdef WITH_GZIP
+    bytesIn_ = bytesOut_ = 0;
+#endif
+}
+// 数据总是被接收，返回值只提示生产者是否应暂停
+bool ResponseStream::Write(const char* data, size_t len) {
+    lock_guard<mutex> locker(mtx_);
+    if(aborted_ || done_) { return false; }
+    if(len == 0 || headRequest_) { return true; }
+#ifdef WITH_GZIP
+    if(gzip_) {
+        raw_.Append(data, len);
+    } else
+#endif
+    if(chunked_) {
+        char size[32];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", len);
+        out_.Append(size, n);
+        out_.Append(data, len);
+        out_.Append("\r\n", 2);
+    } else {
+        out_.Append(data, len);
+    }
+    Wake_();
+    if(Backlog_() >= HIGH_WATER) {
+        paused_ = true;
+        return false;
+    }
+    return true;
+}
+
+void ResponseStream::End() {
+    lock_guard<mutex> locker(mtx_);
+    if(aborted_ || done_) { return; }
+    done_ = true;
+    // 压缩时的结束块在 Drain 输出 gzip 尾部之后添加
+    if(chunked_ && !headRequest_ && !Compressing_()) {
+        out_.Append("0\r\n\r\n", 5);
+    }
+    writable_ = nullptr;  // 释放回调持有的生产者状态
+    Wake_();
+}
+
+bool ResponseStream::IsAborted() {
+    lock_guard<mutex> locker(mtx_);
+    return aborted_;
+}
+
+void ResponseStream::OnWritable(function<void()> callback) {
+    lock_guard<mutex> locker(mtx_);
+    if(aborted_ || done_) { return; }
+    writable_ = callback;
+}
+
+void ResponseStream::SetWaker(function<void()> waker) {
+    lock_guard<mutex> locker(mtx_);
+    waker_ = waker;
+}
+
+Gateway::DRAIN_STATE ResponseStream::Drain(ChainBuffer& buff, int* resumeFd) {
+    *resumeFd = -1;
+    function<void()> callback;
+    bool compress = false;
+#ifdef WITH_GZIP
+    bool finish = false;
+    string slice;
+#endif
+    {
+        lock_guard<mutex> locker(mtx_);
+#ifdef WITH_GZIP
+        // 每次最多压缩 SLICE 字节，结束后再压缩空输入以输出 gzip 尾部
+        if(gzip_ && !finished_ && (raw_.ReadableBytes() > 0 || done_)) {
+            size_t n = raw_.ReadableBytes() < Gzip::SLICE ? raw_.ReadableBytes() : Gzip::SLICE;
+            slice.assign(raw_.Peek(), n);
+            raw_.Retrieve(n);
+            finish = finished_ = done_ && raw_.ReadableBytes() == 0;
+            compress = true;
+        }
+#endif
+        if(!compress && out_.ReadableBytes() == 0) {
+            if(done_) { return DRAIN_DONE; }
+            clientIdle_ = true;
+            return DRAIN_WAIT;
+        }
+        buff.Append(out_);
+        out_.RetrieveAll();
+        if(paused_ && Backlog_() < HIGH_WATER) {
+            paused_ = false;
+            callback = writable_;
+        }
+    }
+#ifdef WITH_GZIP
+    if(compress && !Compress_(slice, finish, buff)) {
+        return DRAIN_FAILED;
+    }
+#endif
+    // 客户端并未处于等待状态，回调中的 Write 不会唤醒客户端，新数据在下一次 Drain 时取走
+    if(callback) { callback(); }
+    return DRAIN_DATA;
+}
+
+bool ResponseStream::KeepAlive() {
+    lock_guard<mutex> locker(mtx_);
+    return keepAlive_ && done_ && !aborted_;
+}
+
+void ResponseStream::Abort() {
+    lock_guard<mutex> locker(mtx_);
+    aborted_ = true;
+    clientIdle_ = false;
+    waker_ = nullptr;
+    writable_ = nullptr;
+    out_.RetrieveAll();
+}
+
+void ResponseStream::CacheAs(const shared_ptr<const string>& body) {
+#ifdef WITH_GZIP
+    cacheKey_ = body;
+#endif
+}
+
+#ifdef WITH_GZIP
+// 压缩一段数据并按 chunked 编码写入 buff，输出 gzip 尾部后结束响应
+bool ResponseStream::Compress_(const string& slice, bool finish, ChainBuffer& buff) {
+    string gz;
+    if(!gzip_->Compress(slice.data(), slice.size(), finish, gz)) {
+        LOG_WARN("gzip stream failed");
+        return false;
+    }
+    bytesIn_ += slice.size();
+    bytesOut_ += gz.size();
+    if(chunked_ && !gz.empty()) {
+        char size[32];
+        int n = snprintf(size, sizeof(size), "%zx\r\n", gz.size());
+        buff.Append(size, n);
+        buff.Append(gz);
+        buff.Append("\r\n", 2);
+    } else {
+        buff.Append(gz);
+    }
+    if(cacheKey_) { captured_ += gz; }
+    if(finish) {
+        if(chunked_) { buff.Append("0\r\n\r\n", 5); }
+        Gzip::Instance()->Count(bytesIn_, bytesOut_);
+        if(cacheKey_) {
+            Gzip::Instance()->Insert(cacheKey_, make_shared<const string>(move(captured_)));
+            cacheKey_.reset();
+        }
+    }
+    return true;
+}
+#endif
+
+void ResponseStream::Wake_() {
+    if(clientIdle_ && waker_) {
+        clientIdle_ = false;
+        waker_();
+    }
+}
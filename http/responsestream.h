@@ -0,0 +1,85 @@
+#ifndef RESPONSE_STREAM_H
+#define RESPONSE_STREAM_H
+
+#include <string>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#include "../buffer/buffer.h"
+#include "../log/log.h"
+#include "gateway.h"
+#include "gzip.h"
+
+class HttpRequest;
+class HttpResponse;
+
+// 处理函数逐步生成的响应体：HTTP/1.1 使用 chunked，HTTP/1.0 以关闭连接结束
+// Write / End 可以在任意线程调用；数据暂存在 out_ 中，客户端发送完已有数据后由 Drain 取走
+// 客户端接受 gzip 且类型可压缩时 (make GZIP=1) 数据先暂存在 raw_ 中，每次 Drain 压缩一段，不会长时间占用 worker
+// 积压达到 HIGH_WATER 时 Write 返回 false，生产者应暂停，客户端取走数据后调用 OnWritable 注册的回调
+class ResponseStream : public Gateway, public std::enable_shared_from_this<ResponseStream> {
+public:
+    // 在处理函数中调用：响应头在处理函数返回后发送，响应体改由返回的 stream 产生
+    static std::shared_ptr<ResponseStream> Start(HttpRequest& request, HttpResponse& response,
+                                                 const std::string& type);
+
+    ResponseStream(bool chunked, bool keepAlive, bool headRequest);
+
+    // 返回 false 表示应暂停写入：积压已达上限 (之后会回调 OnWritable)，或客户端已断开
+    bool Write(const char* data, size_t len);
+    bool Write(const std::string& data) { return Write(data.data(), data.size()); }
+    void End();
+    bool IsAborted();
+
+    // 暂停的生产者在积压被取走后收到回调，在 worker 中调用，不应阻塞
+    void OnWritable(std::function<void()> callback);
+
+    // 以下由 HttpConn / WebServer 调用
+    void SetWaker(std::function<void()> waker);
+    DRAIN_STATE Drain(ChainBuffer& buff, int* resumeFd) override;
+    bool KeepAlive() override;
+    void Abort();   // 客户端提前关闭
+    bool Chunked() const { return chunked_; }
+    // 压缩结果完整时存入 Gzip 的缓存，key 为 body (微缓存中的响应体)
+    void CacheAs(const std::shared_ptr<const std::string>& body);
+
+    static const size_t HIGH_WATER = 256 << 10;  // 待发送数据的积压上限
+
+private:
+    void Wake_();
+    size_t Backlog_() const { return raw_.ReadableBytes() + out_.ReadableBytes(); }
+#ifdef WITH_GZIP
+    bool Compressing_() const { return gzip_ != nullptr; }
+#else
+    bool Compressing_() const { return false; }
+#endif
+#ifdef WITH_GZIP
+    bool Compress_(const std::string& slice, bool finish, ChainBuffer& buff);
+#endif
+
+    const bool chunked_;
+    const bool keepAlive_;
+    const bool headRequest_;   // HEAD 请求只发送响应头
+
+    std::mutex mtx_;
+    std::function<void()> waker_;
+    std::function<void()> writable_;
+    bool clientIdle_;  // 客户端已发送完所有数据，等待唤醒
+    bool paused_;      // Write 曾因积压返回 false
+    bool done_;
+    bool aborted_;
+    bool finished_;    // 压缩器已输出 gzip 尾部
+    Buffer raw_;       // 待压缩的数据
+    Buffer out_;
+#ifdef WITH_GZIP
+    // 只由 Drain 所在的线程使用，不需要加锁
+    std::unique_ptr<GzipEncoder> gzip_;
+    std::shared_ptr<const std::string> cacheKey_;
+    std::string captured_;  // 完整的压缩结果，cacheKey_ 非空时才记录
+    size_t bytesIn_;
+    size_t bytesOut_;
+#endif
+};
+
+#endif //RESPONSE_STREAM_H
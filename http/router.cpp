@@ -0,0 +1,285 @@
+#include "router.h"
+
+using namespace std;
+
+string RouteMatch::Param(const string& name) const {
+    if(!route) { return ""; }
+    for(int i = 0; i < count && i < static_cast<int>(route->params.size()); i++) {
+        if(route->params[i] == name) {
+            return string(path + values[i].off, values[i].len);
+        }
+    }
+    return "";
+}
+
+Router::Node::Node() {
+    for(int i = 0; i < METHOD_COUNT; i++) {
+        exact[i] = prefix[i] = -1;
+    }
+}
+
+Router* Router::Instance() {
+    static Router inst;  // 静态单例
+    return &inst;
+}
+// 默认页面：原先 ParsePath_ 中的首页与状态码页面
+Router::Router() : root_(new Node), hasGateway_(false) {
+    AddStatic("/", "/welcome.html");
+    AddStatic("/index", "/index.html");
+    AddErrorPage(400, "/400.html");
+    AddErrorPage(403, "/403.html");
+    AddErrorPage(404, "/404.html");
+}
+
+bool Router::AddStatic(const string& pattern, const string& file, int methods) {
+    Route route;
+    route.type = Route::STATIC;
+    route.pattern = pattern;
+    route.file = file;
+    return Add_(methods, route);
+}
+
+bool Router::AddHandler(int methods, const string& pattern, Route::Handler handler, bool localOnly) {
+    Route route;
+    route.type = Route::HANDLER;
+    route.pattern = pattern;
+    route.handler = handler;
+    route.localOnly = localOnly;
+    return Add_(methods, route);
+}
+
+bool Router::AddProxy(const string& prefix, Upstream* upstream) {
+    Route route;
+    route.type = Route::PROXY;
+    route.pattern = prefix + "*";
+    route.upstream = upstream;
+    if(!Add_(ANY, route)) { return false; }
+    hasGateway_ = true;
+    return true;
+}
+
+bool Router::AddFastCgi(const string& prefix, FcgiBackend* fcgi) {
+    Route route;
+    route.type = Route::FASTCGI;
+    route.pattern = prefix + "*";
+    route.fcgi = fcgi;
+    if(!Add_(ANY, route)) { return false; }
+    hasGateway_ = true;
+    return true;
+}
+
+// 同一 pattern 按不同方法注册的多个处理函数都开启缓存
+bool Router::SetCache(const string& pattern, int ttlMs, int staleMs, const vector<string>& vary) {
+    bool found = false;
+    for(auto& route : routes_) {
+        if(route.type == Route::HANDLER && route.pattern == pattern) {
+            route.cacheTtl = max(ttlMs, 0);
+            route.cacheStale = max(staleMs, 0);
+            route.vary = vary;
+            found = true;
+        }
+    }
+    if(!found) {
+        LOG_ERROR("Router: no handler for %s to cache", pattern.c_str());
+    }
+    return found;
+}
+
+void Router::AddErrorPage(int code, const string& file) {
+    errorPages_[code] = file;
+    AddStatic("/" + to_string(code), file);
+}
+
+const string* Router::ErrorPage(int code) const {
+    auto it = errorPages_.find(code);
+    return it == errorPages_.end() ? nullptr : &it->second;
+}
+// 按 DFS 顺序展开，每个节点的静态子节点在 nodes_ 中连续存放
+void Router::Compile() {
+    nodes_.clear();
+    labels_.clear();
+    nodes_.emplace_back();
+    Flatten_(root_.get(), 0);
+    LOG_INFO("Router: %zu routes, %zu nodes", routes_.size(), nodes_.size());
+}
+
+void Router::Match(const StrRef& method, const StrRef& path, RouteMatch* match) const {
+    match->route = nullptr;
+    match->badMethod = false;
+    match->path = path.data;
+    const char* query = static_cast<const char*>(memchr(path.data, '?', path.len));
+    match->pathLen = query ? query - path.data : path.len;
+    match->count = 0;
+    if(nodes_.empty() || match->pathLen > UINT16_MAX) { return; }
+
+    State st;
+    st.method = MethodIndex_(method);
+    st.prefix = -1;
+    st.prefixLen = 0;
+    st.prefixCount = 0;
+    st.otherMethod = false;
+    if(Walk_(0, match->path, match->pathLen, 0, st, match)) { return; }
+    if(st.prefix >= 0) {
+        match->route = &routes_[st.prefix];
+        match->count = st.prefixCount;
+        memcpy(match->values, st.prefixValues, sizeof(RouteMatch::Span) * st.prefixCount);
+        return;
+    }
+    match->count = 0;
+    match->badMethod = st.otherMethod;
+}
+// 模式由静态文本、":name" 参数 (必须位于 '/' 之后，占满一段) 和末尾的 '*' (前缀匹配) 组成
+bool Router::Add_(int methods, Route route) {
+    const string& pattern = route.pattern;
+    if(pattern.empty() || pattern[0] != '/' || routes_.size() >= INT16_MAX) {
+        LOG_ERROR("Router: invalid pattern %s", pattern.c_str());
+        return false;
+    }
+    Node* node = root_.get();
+    bool prefix = false;
+    size_t i = 0;
+    while(i < pattern.size()) {
+        if(pattern[i] == ':') {
+            size_t end = min(pattern.find('/', i), pattern.size());
+            if(pattern[i - 1] != '/' || end == i + 1 || route.params.size() >= RouteMatch::MAX_PARAMS) {
+                LOG_ERROR("Router: invalid parameter in %s", pattern.c_str());
+                return false;
+            }
+            route.params.push_back(pattern.substr(i + 1, end - i - 1));
+            if(!node->param) { node->param.reset(new Node); }
+            node = node->param.get();
+            i = end;
+        } else if(pattern[i] == '*') {
+            if(i != pattern.size() - 1) {
+                LOG_ERROR("Router: '*' must be the last character of %s", pattern.c_str());
+                return false;
+            }
+            prefix = true;
+            i++;
+        } else {
+            size_t end = min(pattern.find_first_of(":*", i), pattern.size());
+            node = Insert_(node, pattern.substr(i, end - i));
+            i = end;
+        }
+    }
+    int idx = routes_.size();
+    routes_.push_back(move(route));
+    for(int m = 0; m < METHOD_COUNT; m++) {
+        if(methods & (1 << m)) {
+            (prefix ? node->prefix : node->exact)[m] = idx;  // 重复注册时后者覆盖前者
+        }
+    }
+    return true;
+}
+// 在 node 之下插入静态文本，与已有的边共享前缀时拆分该边，返回文本末尾对应的节点
+Router::Node* Router::Insert_(Node* node, const string& text) {
+    size_t pos = 0;
+    while(pos < text.size()) {
+        Node* next = nullptr;
+        for(auto& child : node->children) {
+            if(child->label[0] != text[pos]) { continue; }
+            size_t common = 0;
+            size_t max = min(child->label.size(), text.size() - pos);
+            while(common < max && child->label[common] == text[pos + common]) { common++; }
+            if(common < child->label.size()) {
+                unique_ptr<Node> mid(new Node);
+                mid->label = child->label.substr(0, common);
+                child->label.erase(0, common);
+                mid->children.push_back(move(child));
+                child = move(mid);
+            }
+            next = child.get();
+            pos += common;
+            break;
+        }
+        if(!next) {
+            unique_ptr<Node> leaf(new Node);
+            leaf->label = text.substr(pos);
+            next = leaf.get();
+            node->children.push_back(move(leaf));
+            pos = text.size();
+        }
+        node = next;
+    }
+    return node;
+}
+// nodes_[idx] 已预留，子节点先整体预留再逐个展开
+void Router::Flatten_(const Node* node, size_t idx) {
+    FlatNode flat;
+    flat.labelOff = labels_.size();
+    flat.labelLen = node->label.size();
+    labels_ += node->label;
+    flat.hasExact = flat.hasPrefix = false;
+    for(int m = 0; m < METHOD_COUNT; m++) {
+        flat.exact[m] = node->exact[m];
+        flat.prefix[m] = node->prefix[m];
+        flat.hasExact |= (node->exact[m] >= 0);
+        flat.hasPrefix |= (node->prefix[m] >= 0);
+    }
+    flat.childBegin = nodes_.size();
+    flat.childEnd = flat.childBegin + node->children.size();
+    nodes_.resize(flat.childEnd);
+    flat.param = -1;
+    if(node->param) {
+        flat.param = nodes_.size();
+        nodes_.emplace_back();
+        Flatten_(node->param.get(), flat.param);
+    }
+    for(size_t i = 0; i < node->children.size(); i++) {
+        Flatten_(node->children[i].get(), flat.childBegin + i);
+    }
+    nodes_[idx] = flat;
+}
+// 从 nodes_[idx] 继续匹配 path[pos...]，该节点的 label 已经匹配
+// 静态子节点优先，失败时回溯尝试参数子节点；途经的前缀路由中保留最长的一个
+bool Router::Walk_(int idx, const char* path, size_t len, size_t pos, State& st, RouteMatch* match) const {
+    const FlatNode& node = nodes_[idx];
+    if(node.hasPrefix) {
+        int r = node.prefix[st.method];
+        if(r < 0) {
+            st.otherMethod = true;
+        } else if(st.prefix < 0 || pos > st.prefixLen) {
+            st.prefix = r;
+            st.prefixLen = pos;
+            st.prefixCount = match->count;
+            memcpy(st.prefixValues, match->values, sizeof(RouteMatch::Span) * match->count);
+        }
+    }
+    if(pos == len) {
+        if(!node.hasExact) { return false; }
+        int r = node.exact[st.method];
+        if(r < 0) {
+            st.otherMethod = true;
+            return false;
+        }
+        match->route = &routes_[r];
+        return true;
+    }
+    for(uint32_t i = node.childBegin; i < node.childEnd; i++) {
+        const FlatNode& child = nodes_[i];
+        if(labels_[child.labelOff] != path[pos]) { continue; }
+        if(child.labelLen <= len - pos && memcmp(labels_.data() + child.labelOff, path + pos, child.labelLen) == 0 &&
+           Walk_(i, path, len, pos + child.labelLen, st, match)) {
+            return true;
+        }
+        break;
+    }
+    if(node.param >= 0 && match->count < RouteMatch::MAX_PARAMS) {
+        size_t end = pos;
+        while(end < len && path[end] != '/') { end++; }
+        if(end > pos) {
+            match->values[match->count++] = { static_cast<uint16_t>(pos), static_cast<uint16_t>(end - pos) };
+            if(Walk_(node.param, path, len, end, st, match)) { return true; }
+            match->count--;
+        }
+    }
+    return false;
+}
+
+int Router::MethodIndex_(const StrRef& method) {
+    static const char* METHODS[METHOD_COUNT - 1] = { "GET", "HEAD", "POST", "PUT", "DELETE", "OPTIONS", "PATCH" };
+    for(int i = 0; i < METHOD_COUNT - 1; i++) {
+        if(method == METHODS[i]) { return i; }
+    }
+    return METHOD_COUNT - 1;
+}
@@ -0,0 +1,146 @@
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <stdint.h>
+#include <string.h>
+
+#include "../log/log.h"
+#include "../buffer/arena.h"
+
+class HttpRequest;
+class HttpResponse;
+class Upstream;
+class FcgiBackend;
+struct RouteMatch;
+
+struct Route {
+    enum TYPE {
+        STATIC = 0,  // 静态文件，file 非空时改写为该路径
+        HANDLER,     // 注册的处理函数
+        PROXY,       // 反向代理
+        FASTCGI,     // FastCGI 后端
+    };
+    typedef std::function<void(HttpRequest& request, HttpResponse& response, const RouteMatch& match)> Handler;
+
+    TYPE type = STATIC;
+    std::string pattern;
+    std::string file;
+    Handler handler;
+    Upstream* upstream = nullptr;
+    FcgiBackend* fcgi = nullptr;
+    bool localOnly = false;               // 只允许本机访问，其他地址按未匹配处理
+    std::vector<std::string> params;      // ":name" 参数名，按出现顺序
+    // 处理函数的微缓存 (见 MicroCache)，cacheTtl 为 0 时不缓存
+    int cacheTtl = 0;                     // 新鲜期 (毫秒)
+    int cacheStale = 0;                   // 过期后仍可返回旧内容、同时后台刷新的时长 (毫秒)
+    std::vector<std::string> vary;        // 参与缓存 key 的请求头
+};
+
+// 一次匹配的结果，参数值记录为在请求路径中的位置，匹配过程不分配内存
+struct RouteMatch {
+    static const int MAX_PARAMS = 8;
+    struct Span {
+        uint16_t off;
+        uint16_t len;
+    };
+
+    const Route* route;     // nullptr 表示没有匹配的路由，按原路径提供静态文件
+    bool badMethod;         // 路径有路由但方法不匹配 (405)
+    const char* path;
+    size_t pathLen;         // 不含查询串
+    int count;
+    Span values[MAX_PARAMS];
+
+    std::string Path() const { return std::string(path, pathLen); }
+    std::string Param(const std::string& name) const;  // 不存在时返回空串
+};
+
+// 路由表：精确 ("/status")、前缀 ("/api/*") 和带参数 ("/users/:id/posts") 的路由，按方法注册
+// Start 之前 Compile 为扁平数组存储的基数树，匹配时一次遍历路径
+// 优先级：精确 > 参数 > 前缀 (最长者)，都未匹配时按原路径提供静态文件
+class Router {
+public:
+    enum METHOD {
+        GET = 1 << 0,
+        HEAD = 1 << 1,
+        POST = 1 << 2,
+        PUT = 1 << 3,
+        DELETE = 1 << 4,
+        OPTIONS = 1 << 5,
+        PATCH = 1 << 6,
+        OTHER = 1 << 7,
+        ANY = 0xff,
+    };
+
+    static Router* Instance();
+
+    bool AddStatic(const std::string& pattern, const std::string& file, int methods = ANY);
+    bool AddHandler(int methods, const std::string& pattern, Route::Handler handler, bool localOnly = false);
+    bool AddProxy(const std::string& prefix, Upstream* upstream);
+    bool AddFastCgi(const std::string& prefix, FcgiBackend* fcgi);
+    // 注册了代理或 FastCGI 路由 (只支持 HTTP/1.1 的客户端连接)
+    bool HasGateway() const { return hasGateway_; }
+    // 为已注册的处理函数路由开启微缓存，pattern 需与注册时相同
+    bool SetCache(const std::string& pattern, int ttlMs, int staleMs, const std::vector<std::string>& vary);
+    // 错误页：响应码为 code 时返回 file，同时注册 "/code" 的静态路由
+    void AddErrorPage(int code, const std::string& file);
+    const std::string* ErrorPage(int code) const;
+
+    void Compile();  // 注册完成后生成匹配用的扁平结构，之后只读
+    // match 中的路径指向 path，path 须在使用 match 期间有效
+    void Match(const StrRef& method, const StrRef& path, RouteMatch* match) const;
+
+private:
+    static const int METHOD_COUNT = 8;
+
+    // 注册阶段的树：边上为静态字符串，参数子节点单独存放
+    struct Node {
+        std::string label;
+        std::vector<std::unique_ptr<Node>> children;  // 首字符互不相同
+        std::unique_ptr<Node> param;                  // ":name"，匹配到下一个 '/' 为止
+        int exact[METHOD_COUNT];
+        int prefix[METHOD_COUNT];
+        Node();
+    };
+    // 编译后的节点：子节点在 nodes_ 中连续存放，label 存放在 labels_ 中
+    struct FlatNode {
+        uint32_t labelOff;
+        uint32_t labelLen;
+        uint32_t childBegin;
+        uint32_t childEnd;
+        int32_t param;
+        bool hasExact;
+        bool hasPrefix;
+        int16_t exact[METHOD_COUNT];
+        int16_t prefix[METHOD_COUNT];
+    };
+    struct State {
+        int method;
+        int prefix;             // 目前最长的前缀路由
+        size_t prefixLen;
+        int prefixCount;
+        RouteMatch::Span prefixValues[RouteMatch::MAX_PARAMS];
+        bool otherMethod;       // 路径匹配了其他方法的路由
+    };
+
+    Router();
+    bool Add_(int methods, Route route);
+    Node* Insert_(Node* node, const std::string& text);
+    void Flatten_(const Node* node, size_t idx);
+    bool Walk_(int idx, const char* path, size_t len, size_t pos, State& st, RouteMatch* match) const;
+    static int MethodIndex_(const StrRef& method);
+
+    std::vector<Route> routes_;
+    std::unique_ptr<Node> root_;
+    std::vector<FlatNode> nodes_;
+    std::string labels_;
+    std::unordered_map<int, std::string> errorPages_;
+    bool hasGateway_;
+};
+
+#endif //ROUTER_H
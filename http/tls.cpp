@@ -0,0 +1,90 @@
+#include "tls.h"
+
+#ifdef WITH_TLS
+
+using namespace std;
+
+TlsContext* TlsContext::Instance() {
+    static TlsContext inst;  // 静态单例
+    return &inst;
+}
+
+// ALPN：客户端支持时优先选择 h2 (arg 为 http2_)，否则 http/1.1
+static int SelectAlpn(SSL* ssl, const unsigned char** out, unsigned char* outlen,
+                      const unsigned char* in, unsigned int inlen, void* arg) {
+    static const unsigned char protos[] = "\x02h2\x08http/1.1";
+    bool http2 = *static_cast<const bool*>(arg);
+    const unsigned char* offer = http2 ? protos : protos + 3;
+    unsigned int offerLen = http2 ? sizeof(protos) - 1 : sizeof(protos) - 4;
+    unsigned char* selected = nullptr;
+    if(SSL_select_next_proto(&selected, outlen, offer, offerLen, in, inlen) != OPENSSL_NPN_NEGOTIATED) {
+        return SSL_TLSEXT_ERR_NOACK;
+    }
+    *out = selected;
+    return SSL_TLSEXT_ERR_OK;
+}
+
+TlsContext::~TlsContext() {
+    if(ctx_) { SSL_CTX_free(ctx_); }
+}
+
+bool TlsContext::Init(const char* certFile, const char* keyFile) {
+    SSL_CTX* ctx = SSL_CTX_new(TLS_server_method());
+    if(!ctx) {
+        LOG_ERROR("SSL_CTX_new error!");
+        return false;
+    }
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+    if(SSL_CTX_use_certificate_chain_file(ctx, certFile) != 1 ||
+       SSL_CTX_use_PrivateKey_file(ctx, keyFile, SSL_FILETYPE_PEM) != 1 ||
+       SSL_CTX_check_private_key(ctx) != 1) {
+        LOG_ERROR("Load cert %s / key %s error!", certFile, keyFile);
+        SSL_CTX_free(ctx);
+        return false;
+    }
+    // 非阻塞 socket 上允许部分写，且重试时缓冲区地址可以变化 (iov 推进后地址会变)
+    SSL_CTX_set_mode(ctx, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER |
+                          SSL_MODE_RELEASE_BUFFERS);
+    // 会话复用：服务端 session ID 缓存 + session ticket (ticket 密钥属于 SSL_CTX，所有连接共用)
+    static const unsigned char sidCtx[] = "SimpleWebServer";
+    SSL_CTX_set_session_id_context(ctx, sidCtx, sizeof(sidCtx) - 1);
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSION_CACHE_SIZE);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+    // 内核支持时握手后由内核加密 (kTLS)，之后可以直接 sendfile
+    SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS);
+    SSL_CTX_set_alpn_select_cb(ctx, SelectAlpn, &http2_);
+
+    if(ctx_) { SSL_CTX_free(ctx_); }
+    ctx_ = ctx;
+    LOG_INFO("TLS enabled, cert: %s", certFile);
+    return true;
+}
+
+SSL* TlsContext::NewSsl(int fd) {
+    assert(ctx_);
+    SSL* ssl = SSL_new(ctx_);
+    if(!ssl) { return nullptr; }
+    SSL_set_fd(ssl, fd);
+    SSL_set_accept_state(ssl);
+    return ssl;
+}
+
+bool TlsContext::IsHttp2(SSL* ssl) {
+    const unsigned char* proto = nullptr;
+    unsigned int len = 0;
+    SSL_get0_alpn_selected(ssl, &proto, &len);
+    return len == 2 && memcmp(proto, "h2", 2) == 0;
+}
+// 会话缓存统计，用于 /status
+string TlsContext::StatsStr() {
+    if(!ctx_) { return ""; }
+    string str;
+    str += "tls_handshakes " + to_string(SSL_CTX_sess_accept_good(ctx_)) + "\n";
+    str += "tls_session_hits " + to_string(SSL_CTX_sess_hits(ctx_)) + "\n";
+    str += "tls_session_misses " + to_string(SSL_CTX_sess_misses(ctx_)) + "\n";
+    str += "tls_session_cached " + to_string(SSL_CTX_sess_number(ctx_)) + "\n";
+    return str;
+}
+
+#endif //WITH_TLS
@@ -0,0 +1,42 @@
+#ifndef TLS_H
+#define TLS_H
+
+// HTTPS 支持，需使用 make TLS=1 编译 (依赖 OpenSSL)
+// 本地测试可以生成自签名证书：
+//   openssl req -x509 -newkey rsa:2048 -nodes -days 365 -subj "/CN=localhost" -keyout ./bin/server.key -out ./bin/server.crt
+#ifdef WITH_TLS
+
+#include <string>
+#include <string.h>
+#include <openssl/ssl.h>
+#include <openssl/err.h>
+
+#include "../log/log.h"
+
+class TlsContext {
+public:
+    static TlsContext* Instance();
+
+    // 加载证书与私钥，并开启会话缓存 / session ticket / kTLS / ALPN
+    bool Init(const char* certFile, const char* keyFile);
+    bool IsOpen() const { return ctx_ != nullptr; }
+    // ALPN 是否提供 h2，默认提供；有代理 / FastCGI 路由时关闭 (这类请求只能通过 HTTP/1.1 转发)
+    void SetHttp2(bool enable) { http2_ = enable; }
+
+    SSL* NewSsl(int fd);
+    static bool IsHttp2(SSL* ssl);  // 握手时 ALPN 协商结果为 h2
+    std::string StatsStr();
+
+    static const long SESSION_CACHE_SIZE = 20480;  // 服务端 session ID 缓存条数
+    static const long SESSION_TIMEOUT = 300;       // 会话有效期 (秒)
+
+private:
+    TlsContext() : ctx_(nullptr), http2_(true) {}
+    ~TlsContext();
+
+    SSL_CTX* ctx_;  // 所有连接共享，会话缓存与 ticket 密钥也因此在所有 worker 之间共享
+    bool http2_;
+};
+
+#endif //WITH_TLS
+#endif //TLS_H
@@ -0,0 +1,138 @@
+#include "upstream.h"
+
+using namespace std;
+
+Upstream::Upstream(const string& prefix, POLICY policy) 
+    : prefix_(prefix), policy_(policy), next_(0) {}
+
+Upstream::~Upstream() {
+    for(auto& backend : backends_) {
+        for(int fd : backend.idle) { close(fd); }
+    }
+}
+
+bool Upstream::AddBackend(const string& hostPort) {
+    size_t colon = hostPort.rfind(':');
+    if(colon == string::npos) { return false; }
+    Backend backend;
+    backend.addr = { 0 };
+    backend.addr.sin_family = AF_INET;
+    int port = atoi(hostPort.c_str() + colon + 1);
+    if(port <= 0 || port > 65535 ||
+       inet_pton(AF_INET, hostPort.substr(0, colon).c_str(), &backend.addr.sin_addr) != 1) {
+        return false;
+    }
+    backend.addr.sin_port = htons(port);
+    backend.name = hostPort;
+    backend.active = 0;
+    backend.failUntil = 0;
+    backends_.push_back(backend);
+    return true;
+}
+
+int Upstream::Acquire(size_t* idx, bool* reused) {
+    lock_guard<mutex> locker(mtx_);
+    int64_t now = NowMS_();
+    // 依次尝试各个后端，同步返回失败 (例如 ECONNREFUSED) 时换下一个
+    for(size_t tries = 0; tries < backends_.size(); tries++) {
+        size_t i = Pick_(now);
+        Backend& backend = backends_[i];
+        int fd = PopIdle_(backend);
+        *reused = (fd >= 0);
+        if(fd < 0) { fd = Connect_(backend.addr); }
+        if(fd >= 0) {
+            backend.active++;
+            *idx = i;
+            return fd;
+        }
+        LOG_WARN("Upstream %s connect error: %d", backend.name.c_str(), errno);
+        backend.failUntil = now + FAIL_TIMEOUT_MS;
+    }
+    return -1;
+}
+
+void Upstream::Release(size_t idx, int fd, bool keepAlive) {
+    lock_guard<mutex> locker(mtx_);
+    Backend& backend = backends_[idx];
+    backend.active--;
+    if(keepAlive && backend.idle.size() < MAX_IDLE) {
+        backend.idle.push_back(fd);
+    } else {
+        close(fd);
+    }
+}
+
+void Upstream::MarkFailed(size_t idx) {
+    lock_guard<mutex> locker(mtx_);
+    backends_[idx].failUntil = NowMS_() + FAIL_TIMEOUT_MS;
+}
+// 跳过最近失败过的后端 (全部失败时仍然选择)
+// ROUND_ROBIN：按顺序轮流；LEAST_CONN：活跃连接数最少的，相同时按轮询顺序
+size_t Upstream::Pick_(int64_t now) {
+    size_t n = backends_.size();
+    size_t start = next_++ % n;
+    size_t best = start;
+    bool found = false;
+    for(size_t k = 0; k < n; k++) {
+        size_t i = (start + k) % n;
+        const Backend& backend = backends_[i];
+        if(backend.failUntil > now) { continue; }
+        if(!found || (policy_ == LEAST_CONN && backend.active < backends_[best].active)) {
+            best = i;
+            found = true;
+        }
+        if(policy_ == ROUND_ROBIN) { break; }
+    }
+    return best;
+}
+// 取出一个仍然可用的空闲连接：MSG_PEEK 读到 EOF 或意外的数据说明后端已关闭该连接
+int Upstream::PopIdle_(Backend& backend) {
+    while(!backend.idle.empty()) {
+        int fd = backend.idle.back();
+        backend.idle.pop_back();
+        char c;
+        ssize_t ret = recv(fd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+        if(ret < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+            return fd;
+        }
+        close(fd);
+    }
+    return -1;
+}
+
+int Upstream::Connect_(const struct sockaddr_in& addr) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if(fd < 0) { return -1; }
+    int nodelay = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &nodelay, sizeof(nodelay));
+    if(connect(fd, (const struct sockaddr*)&addr, sizeof(addr)) < 0 && errno != EINPROGRESS) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    return fd;
+}
+
+int64_t Upstream::NowMS_() {
+    return CachedClock::NowMS();
+}
+
+Proxy* Proxy::Instance() {
+    static Proxy inst;  // 静态单例
+    return &inst;
+}
+
+bool Proxy::AddRoute(const string& prefix, const vector<string>& backends, Upstream::POLICY policy) {
+    if(prefix.empty() || prefix[0] != '/' || backends.empty()) { return false; }
+    unique_ptr<Upstream> upstream(new Upstream(prefix, policy));
+    for(const auto& backend : backends) {
+        if(!upstream->AddBackend(backend)) {
+            LOG_ERROR("Proxy %s: invalid backend %s", prefix.c_str(), backend.c_str());
+            return false;
+        }
+    }
+    if(!Router::Instance()->AddProxy(prefix, upstream.get())) { return false; }
+    routes_.push_back(move(upstream));
+    return true;
+}
@@ -0,0 +1,84 @@
+#ifndef UPSTREAM_H
+#define UPSTREAM_H
+
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+#include "../timer/cachedclock.h"
+#include "../log/log.h"
+#include "router.h"
+
+// 反向代理的一组后端 (对应一个路径前缀)
+// 每个后端维护 keep-alive 空闲连接池，按轮询或最少连接数选择后端
+class Upstream {
+public:
+    enum POLICY {
+        ROUND_ROBIN = 0,
+        LEAST_CONN,
+    };
+
+    Upstream(const std::string& prefix, POLICY policy);
+    ~Upstream();
+
+    bool AddBackend(const std::string& hostPort);  // 例如 "127.0.0.1:8080"
+
+    // 选择后端并取得一个非阻塞连接：优先复用空闲连接，否则发起非阻塞 connect
+    // 返回 fd，失败时返回 -1；*idx 为后端下标，*reused 表示连接来自连接池
+    int Acquire(size_t* idx, bool* reused);
+    // 请求结束：keepAlive 时放回连接池，否则关闭
+    void Release(size_t idx, int fd, bool keepAlive);
+    // 连接失败，该后端在 FAIL_TIMEOUT_MS 内不再被优先选择
+    void MarkFailed(size_t idx);
+
+    const std::string& Prefix() const { return prefix_; }
+    std::string Name(size_t idx) const { return backends_[idx].name; }
+
+    static const size_t MAX_IDLE = 32;           // 每个后端最多保留的空闲连接数
+    static const int64_t FAIL_TIMEOUT_MS = 1000;
+
+private:
+    struct Backend {
+        struct sockaddr_in addr;
+        std::string name;
+        int active;                // 正在使用的连接数
+        int64_t failUntil;         // 在此之前视为不可用 (毫秒)
+        std::vector<int> idle;     // 空闲的 keep-alive 连接
+    };
+
+    size_t Pick_(int64_t now);
+    int PopIdle_(Backend& backend);
+    static int Connect_(const struct sockaddr_in& addr);
+    static int64_t NowMS_();
+
+    std::string prefix_;
+    POLICY policy_;
+    size_t next_;                  // 轮询位置
+    std::vector<Backend> backends_;
+    std::mutex mtx_;
+};
+
+// 各代理路由的上游组，路径匹配由 Router 完成；在 Start 之前添加，之后只读
+class Proxy {
+public:
+    static Proxy* Instance();
+
+    bool AddRoute(const std::string& prefix, const std::vector<std::string>& backends,
+                  Upstream::POLICY policy = Upstream::ROUND_ROBIN);
+    bool Empty() const { return routes_.empty(); }
+
+private:
+    Proxy() = default;
+
+    std::vector<std::unique_ptr<Upstream>> routes_;
+};
+
+#endif //UPSTREAM_H
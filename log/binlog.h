@@ -0,0 +1,165 @@
+#ifndef BIN_LOG_H
+#define BIN_LOG_H
+
+#include <stdint.h>
+#include <string.h>
+#include <type_traits>
+
+// 二进制日志 (make BINLOG=1)：调用处只记录格式串的编号与原始参数，由 logdecode 离线还原为文本
+// 文件以 Magic() 开头，之后为连续的记录：
+//   FORMAT  'F' varint(id) u8(level) varint(len) 格式串
+//   LINE    'L' varint(id) i64(微秒时间戳) u8(参数个数) 各参数
+// 参数为 u8(类型) 加内容：整数为 zigzag / 无符号 varint，DOUBLE 为 8 字节，STR 为 varint(len) 加内容
+// 每个文件开头重新写入已注册的全部格式串，单个文件可以独立解码
+class BinLog {
+public:
+    static const char* Magic() { return "BINLOG1\n"; }
+    static const size_t MAGIC_LEN = 8;
+    static const int MAX_FORMATS = 1024;
+    static const int MAX_ARGS = 16;
+    static const size_t MAX_RECORD = 4096;  // 单条记录的上限，字符串参数超出时截断
+
+    enum RECORD : char {
+        FORMAT = 'F',
+        LINE = 'L',
+    };
+    enum TYPE : uint8_t {
+        INT = 1,
+        UINT,
+        DOUBLE,
+        STR,
+        PTR,
+    };
+
+    // 格式串中的一个转换说明，如 "%-5.*s"
+    struct Spec {
+        const char* begin;  // '%' 的位置
+        size_t len;
+        char conv;          // 转换字符，'%' 表示 "%%"
+        int bits;           // 整数的宽度：8 (hh)、16 (h)、32 (无修饰)、64 (l / ll / z / j / t)
+        bool starWidth;     // 宽度与精度为 '*' 时各自先消耗一个 int 参数
+        bool starPrec;
+        int prec;           // 固定精度，-1 表示没有
+    };
+
+    // 从 p 开始找下一个转换说明，找到时 p 移到其后
+    static bool NextSpec(const char*& p, Spec* spec) {
+        while(*p && *p != '%') { p++; }
+        if(!*p) { return false; }
+        spec->begin = p++;
+        spec->starWidth = spec->starPrec = false;
+        spec->prec = -1;
+        spec->bits = 32;
+        while(*p && strchr("-+ #0", *p)) { p++; }
+        if(*p == '*') { spec->starWidth = true; p++; }
+        while(*p >= '0' && *p <= '9') { p++; }
+        if(*p == '.') {
+            p++;
+            if(*p == '*') { spec->starPrec = true; p++; }
+            else {
+                spec->prec = 0;
+                while(*p >= '0' && *p <= '9') { spec->prec = spec->prec * 10 + (*p++ - '0'); }
+            }
+        }
+        while(*p && strchr("hlLqjzt", *p)) {
+            if(*p == 'h') { spec->bits = spec->bits == 16 ? 8 : 16; }
+            else { spec->bits = 64; }
+            p++;
+        }
+        spec->conv = *p ? *p++ : '%';
+        spec->len = p - spec->begin;
+        return true;
+    }
+
+    static char* PutVarint(char* p, uint64_t v) {
+        while(v >= 0x80) {
+            *p++ = static_cast<char>(v | 0x80);
+            v >>= 7;
+        }
+        *p++ = static_cast<char>(v);
+        return p;
+    }
+    static const char* GetVarint(const char* p, const char* end, uint64_t* v) {
+        *v = 0;
+        for(int shift = 0; p < end && shift < 64; shift += 7) {
+            uint8_t b = static_cast<uint8_t>(*p++);
+            *v |= static_cast<uint64_t>(b & 0x7f) << shift;
+            if(!(b & 0x80)) { return p; }
+        }
+        return nullptr;
+    }
+
+    // 按参数的静态类型编码一条 LINE 记录，buf 为 MAX_RECORD 字节
+    class Writer {
+    public:
+        Writer(char* buf, const int* prec): p_(buf), end_(buf + MAX_RECORD), prec_(prec), idx_(0), argc_(0), last_(0) {}
+
+        void Begin(int id, int64_t usec, int argc) {
+            argc_ = argc;
+            *p_++ = LINE;
+            p_ = PutVarint(p_, id);
+            memcpy(p_, &usec, sizeof(usec));
+            p_ += sizeof(usec);
+            *p_++ = static_cast<char>(argc);
+        }
+        void Put() {}
+        template<class T, class... Rest>
+        void Put(T v, Rest... rest) {
+            Put_(v);
+            idx_++;
+            Put(rest...);
+        }
+        char* End() const { return p_; }
+
+    private:
+        template<class T>
+        typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value>::type Put_(T v) {
+            int64_t s = static_cast<int64_t>(v);
+            last_ = s;
+            if(std::is_signed<T>::value) {
+                *p_++ = INT;
+                p_ = PutVarint(p_, (static_cast<uint64_t>(s) << 1) ^ static_cast<uint64_t>(s >> 63));
+            } else {
+                *p_++ = UINT;
+                p_ = PutVarint(p_, static_cast<uint64_t>(v));
+            }
+        }
+        template<class T>
+        typename std::enable_if<std::is_floating_point<T>::value>::type Put_(T v) {
+            double d = v;
+            *p_++ = DOUBLE;
+            memcpy(p_, &d, sizeof(d));
+            p_ += sizeof(d);
+        }
+        // "%.*s" 等带精度的字符串可能不以 '\0' 结尾，最多读取精度指定的长度
+        void Put_(const char* s) {
+            if(!s) { s = "(null)"; }
+            // 为其后的参数各留出最长的编码 (类型加 10 字节的 varint)
+            size_t limit = (end_ - p_) - ARG_MAX_LEN * (argc_ - idx_);
+            int prec = prec_[idx_];
+            if(prec == -2 && last_ >= 0 && static_cast<size_t>(last_) < limit) { limit = last_; }
+            else if(prec >= 0 && static_cast<size_t>(prec) < limit) { limit = prec; }
+            size_t len = strnlen(s, limit);
+            *p_++ = STR;
+            p_ = PutVarint(p_, len);
+            memcpy(p_, s, len);
+            p_ += len;
+        }
+        void Put_(char* s) { Put_(static_cast<const char*>(s)); }
+        void Put_(const void* v) {
+            *p_++ = PTR;
+            p_ = PutVarint(p_, reinterpret_cast<uintptr_t>(v));
+        }
+
+        static const int ARG_MAX_LEN = 11;
+
+        char* p_;
+        char* end_;
+        const int* prec_;  // 各参数作为字符串时的精度，-1 没有，-2 为前一个参数
+        int idx_;
+        int argc_;
+        int64_t last_;     // 上一个整数参数
+    };
+};
+
+#endif //BIN_LOG_H
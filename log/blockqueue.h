@@ -1,12 +1,9 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-16
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef BLOCKQUEUE_H
 #define BLOCKQUEUE_H
 
@@ -1,204 +1,282 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-16
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include "log.h"
 
 using namespace std;
 // 构造函数
 Log::Log() {
     lineCount_ = 0;
-    isAsync_ = false;
-    writeThread_ = nullptr;
-    deque_ = nullptr;
+    fileIndex_ = 0;
     toDay_ = 0;
-    fp_ = nullptr;
+    isOpen_ = false;
+    level_ = 1;
+    isAsync_ = false;
+    isClose_ = false;
+    fd_ = -1;
+    path_ = nullptr;
+    suffix_ = nullptr;
+    formatCount_ = 0;
 }
-// 析构函数
+// 析构函数：通知写线程写完剩余的内容后退出
 Log::~Log() {
-    // writeThread 线程存在，且可以 joinable 确保它并不在 detach 状态
     if(writeThread_ && writeThread_->joinable()) {
-        // 先刷一遍 pop push
-        while(!deque_->empty()) {
-            deque_->flush();  // 会有往 deque 中 push 的操作, 一直没有 push 操作
-        };
-        // 关闭 deque
-        deque_->Close();
+        {
+            lock_guard<mutex> locker(mtx_);
+            isClose_ = true;
+        }
+        cond_.notify_one();
+        fullCond_.notify_all();
         writeThread_->join();
     }
-    if(fp_) {
-        lock_guard<mutex> locker(mtx_);
-        flush();
-        fclose(fp_);
+    if(fd_ >= 0) {
+        close(fd_);
     }
 }
-// 注意，以下两个操作，都是对队列的操作，所以需要
-// 获取 Log 等级
-int Log::GetLevel() {
-    lock_guard<mutex> locker(mtx_);
-    return level_;
-}
-// 设置 Log 等级
-void Log::SetLevel(int level) {
-    lock_guard<mutex> locker(mtx_);
-    level_ = level;
-}
 
 void Log::init(int level = 1, const char* path, const char* suffix,
     int maxQueueSize) {
-    isOpen_ = true;
     level_ = level;
-    if(maxQueueSize > 0) {
-        isAsync_ = true;
-        if(!deque_) {
-            // 创建输出 BlockDeque
-            unique_ptr<BlockDeque<std::string>> newDeque(new BlockDeque<std::string>);
-            deque_ = move(newDeque);
-            // 创建 写线程 (只有一个写线程)
-            std::unique_ptr<std::thread> NewThread(new thread(FlushLogThread));
-            writeThread_ = move(NewThread);
+    path_ = path;
+    suffix_ = suffix;
+    {
+        lock_guard<mutex> locker(mtx_);
+        toDay_ = -1;    // 按当前日期打开文件
+        Rotate_(0);
+        assert(fd_ >= 0);
+        if(maxQueueSize > 0 && !writeThread_) {
+            isAsync_ = true;
+            current_.reset(new LogBuffer);
+            next_.reset(new LogBuffer);
+            // 创建写线程 (只有一个写线程)
+            writeThread_.reset(new thread(FlushLogThread));
         }
+    }
+    isOpen_ = true;
+}
+// 日期变化或当前文件的行数达到 MAX_LINES 时打开新文件
+// 同步方式下持有锁时调用，异步方式下 init 之后只在写线程中调用
+// 例如 bin/log/2021_07_01.log，同一天第 n 个按行数切分的文件为 bin/log/2021_07_01-n.log
+void Log::Rotate_(size_t lines) {
+    struct tm t = CachedClock::Wall().local;
+    lineCount_ += lines;
+    if(toDay_ == t.tm_mday && lineCount_ < MAX_LINES) { return; }
+    if(toDay_ != t.tm_mday) {
+        toDay_ = t.tm_mday;
+        fileIndex_ = 0;
     } else {
-        isAsync_ = false;
+        fileIndex_++;
     }
-
     lineCount_ = 0;
 
-    time_t timer = time(nullptr);
-    struct tm *sysTime = localtime(&timer);
-    struct tm t = *sysTime;
-    path_ = path;
-    suffix_ = suffix;
     char fileName[LOG_NAME_LEN] = {0};
-    // 按照格式将时间信息写入文件，并将其作为文件名
-    // 例如 bin/log/2021_07_01.log
-    snprintf(fileName, LOG_NAME_LEN - 1, "%s/%04d_%02d_%02d%s", 
-            path_, t.tm_year + 1900, t.tm_mon + 1, t.tm_mday, suffix_);
-    toDay_ = t.tm_mday;
+    char tail[36] = {0};
+    snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
+    if(fileIndex_ == 0) {
+        snprintf(fileName, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
+    } else {
+        snprintf(fileName, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, fileIndex_, suffix_);
+    }
+    if(fd_ >= 0) {
+        close(fd_);
+    }
+    fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0) {
+        mkdir(path_, 0777);
+        fd_ = open(fileName, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    }
+#ifdef LOG_BINARY
+    WriteFormats_();
+#endif
+}
+// 二进制日志的文件头与已注册的全部格式串，之前的文件中定义过的格式串在新文件中也能解码
+void Log::WriteFormats_() {
+    string header(BinLog::Magic(), BinLog::MAGIC_LEN);
+    int count = formatCount_.load(memory_order_acquire);
+    char rec[BinLog::MAX_RECORD];
+    for(int id = 0; id < count; id++) {
+        size_t len = EncodeFormat_(id, rec);
+        header.append(rec, len);
+    }
+    struct iovec iov = {&header[0], header.size()};
+    WriteFile_(&iov, 1);
+}
 
-    {
-        lock_guard<mutex> locker(mtx_);
-        buff_.RetrieveAll();
-        if(fp_) { 
-            flush();
-            fclose(fp_); 
-        }
-        // 创建打开文件，并且可利用文件指针追加内容到文件
-        fp_ = fopen(fileName, "a");
-        if(fp_ == nullptr) {
-            mkdir(path_, 0777);
-            fp_ = fopen(fileName, "a");
-        } 
-        assert(fp_ != nullptr);
+int Log::RegisterFormat(int level, const char* format) {
+    lock_guard<mutex> locker(formatMtx_);
+    int id = formatCount_.load(memory_order_relaxed);
+    if(id >= BinLog::MAX_FORMATS) { return -1; }
+    Format& f = formats_[id];
+    f.format = format;
+    f.level = level;
+    for(int i = 0; i < BinLog::MAX_ARGS; i++) { f.prec[i] = -1; }
+    // 记下字符串参数的精度，带精度的字符串可能不以 '\0' 结尾
+    int arg = 0;
+    BinLog::Spec spec;
+    const char* p = format;
+    while(BinLog::NextSpec(p, &spec)) {
+        if(spec.conv == '%') { continue; }
+        arg += spec.starWidth + spec.starPrec;
+        if(arg >= BinLog::MAX_ARGS) { break; }
+        if(spec.conv == 's') { f.prec[arg] = spec.starPrec ? -2 : spec.prec; }
+        arg++;
     }
+    formatCount_.store(id + 1, memory_order_release);
+    char rec[BinLog::MAX_RECORD];
+    Append_(rec, EncodeFormat_(id, rec));
+    return id;
+}
+// 'F' varint(id) u8(level) varint(len) 格式串
+size_t Log::EncodeFormat_(int id, char* rec) const {
+    const Format& f = formats_[id];
+    size_t len = strnlen(f.format, BinLog::MAX_RECORD - 32);
+    char* p = rec;
+    *p++ = BinLog::FORMAT;
+    p = BinLog::PutVarint(p, id);
+    *p++ = static_cast<char>(f.level);
+    p = BinLog::PutVarint(p, len);
+    memcpy(p, f.format, len);
+    return p + len - rec;
 }
 
 void Log::write(int level, const char *format, ...) {
-    struct timeval now = {0, 0};
-    gettimeofday(&now, nullptr);
-    time_t tSec = now.tv_sec;
-    struct tm *sysTime = localtime(&tSec);
-    struct tm t = *sysTime;
+    // 在线程自己的行缓冲区中格式化，不需要加锁
+    thread_local char line[LINE_SIZE];
+    // 输出年月日 时间，例子：2021-07-01 11:01:33.310956
+    // 本地时间与时间戳每秒只格式化一次 (localtime 内部有全局锁)
+    long usec = 0;
+    const CachedClock::Second& sec = CachedClock::Wall(&usec);
+    int n = snprintf(line, LINE_SIZE, "%s.%06ld ", sec.log, usec);
+    n += AppendLogLevelTitle_(level, line + n);  // 添加日志头
+    // 可变参数输入（Log 真实内容），超出行缓冲区的部分截断
     va_list vaList;
+    va_start(vaList, format); 
+    int m = vsnprintf(line + n, LINE_SIZE - n - 1, format, vaList);
+    va_end(vaList);
+    if(m > 0) { n += m < LINE_SIZE - n - 1 ? m : LINE_SIZE - n - 2; }
+    line[n++] = '\n';
+    Append_(line, n);
+}
 
-    /* 日志日期 日志行数 */
-    // 如果发现日志日期不对，或者日志行数超过了规定的行数，就重新创建一个新的文件来存日志信息
-    if (toDay_ != t.tm_mday || (lineCount_ && (lineCount_  %  MAX_LINES == 0)))
-    {
-        unique_lock<mutex> locker(mtx_);
-        locker.unlock();
-        
-        char newFile[LOG_NAME_LEN];
-        char tail[36] = {0};
-        snprintf(tail, 36, "%04d_%02d_%02d", t.tm_year + 1900, t.tm_mon + 1, t.tm_mday);
-        // 天数不一样，改一下后面的日期
-        if (toDay_ != t.tm_mday)
-        {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s%s", path_, tail, suffix_);
-            toDay_ = t.tm_mday;
-            lineCount_ = 0;
-        }
-        // 行数达到最大上限，就将文件名后多加一个 lineCount_  / MAX_LINES
-        // 例子 bin/log/2021_07_01-1.log
-        else {
-            snprintf(newFile, LOG_NAME_LEN - 72, "%s/%s-%d%s", path_, tail, (lineCount_  / MAX_LINES), suffix_);
-        }
-        
-        locker.lock();
-        flush();
-        fclose(fp_);
-        fp_ = fopen(newFile, "a");
-        assert(fp_ != nullptr);
+void Log::Append_(const char* data, size_t n) {
+    unique_lock<mutex> locker(mtx_);
+    if(!isAsync_) {
+        // 同步方式：直接写入文件
+        Rotate_(1);
+        if(fd_ >= 0 && ::write(fd_, data, n) < 0) {}
+        return;
     }
-
-    {
-        unique_lock<mutex> locker(mtx_);
-        lineCount_++;
-        // 输出年月日 时间 
-        // 例子：2021-07-01 11:01:33.310956
-        int n = snprintf(buff_.BeginWrite(), 128, "%d-%02d-%02d %02d:%02d:%02d.%06ld ",
-                    t.tm_year + 1900, t.tm_mon + 1, t.tm_mday,
-                    t.tm_hour, t.tm_min, t.tm_sec, now.tv_usec);
-                    
-        buff_.HasWritten(n);
-        AppendLogLevelTitle_(level);  // 添加日志头
-        // 可变参数输入（Log 真实内容）
-        va_start(vaList, format); 
-        int m = vsnprintf(buff_.BeginWrite(), buff_.WritableBytes(), format, vaList);
-        va_end(vaList);
-
-        buff_.HasWritten(m);
-        buff_.Append("\n\0", 2); // 加回车
-
-        // 看使用同步，还是异步写 Log
-        if(isAsync_ && deque_ && !deque_->full()) {
-            // 将 buff 中 read buff 区域内容 push 到 队列中，之后处理（异步方式）
-            deque_->push_back(buff_.RetrieveAllToStr()); 
+    // 当前缓冲区写满后交给写线程，换上预备的缓冲区
+    // 等待写入的缓冲区达到 MAX_BUFFERS 时，等写线程取走后再继续 (与磁盘速度相同，不丢弃)
+    if(current_->Avail() < n) {
+        while(full_.size() >= MAX_BUFFERS && !isClose_) {
+            fullCond_.wait(locker);
+        }
+        full_.push_back(move(current_));
+        if(next_) {
+            current_ = move(next_);
         } else {
-            // 否则直接写入文件（同步方式）
-            fputs(buff_.Peek(), fp_);
+            current_.reset(new LogBuffer);  // 写入很多、写线程来不及归还时
         }
-        buff_.RetrieveAll();  // 缓冲区重置
+        cond_.notify_one();
     }
+    memcpy(current_->data + current_->len, data, n);
+    current_->len += n;
+    current_->lines++;
 }
 
-void Log::AppendLogLevelTitle_(int level) {
+int Log::AppendLogLevelTitle_(int level, char* buf) {
+    const char* title;
     switch(level) {
     case 0:
-        buff_.Append("[debug]: ", 9);
+        title = "[debug]: ";
         break;
     case 1:
-        buff_.Append("[info] : ", 9);
+        title = "[info] : ";
         break;
     case 2:
-        buff_.Append("[warn] : ", 9);
+        title = "[warn] : ";
         break;
     case 3:
-        buff_.Append("[error]: ", 9);
+        title = "[error]: ";
         break;
     default:
-        buff_.Append("[info] : ", 9);
+        title = "[info] : ";
         break;
     }
+    memcpy(buf, title, 9);
+    return 9;
 }
 
 void Log::flush() {
     if(isAsync_) { 
-        deque_->flush(); // 异步方式，通知消费者 pop
+        cond_.notify_one();  // 异步方式，唤醒写线程
     }
-    fflush(fp_);         // 清空缓存
 }
-
+// 写线程持有两个空缓冲区，每次与 current_ / next_ 交换，取走已写满的缓冲区后在锁外写入文件
 void Log::AsyncWrite_() {  // 线程入口函数
-    string str = "";
-    while(deque_->pop(str)) {     // pop 会在阻塞状态，等待 deque_->flush 通知
-        lock_guard<mutex> locker(mtx_);  // 必须要加锁，str 为临界资源，可能在 fputs 的过程中 被 pop 操作修改
-        fputs(str.c_str(), fp_);  // 将 str 写入 文件
+    unique_ptr<LogBuffer> spare1(new LogBuffer);
+    unique_ptr<LogBuffer> spare2(new LogBuffer);
+    vector<unique_ptr<LogBuffer>> toWrite;
+    vector<struct iovec> iov;
+    bool closing = false;
+    while(!closing) {
+        {
+            unique_lock<mutex> locker(mtx_);
+            if(full_.empty() && !isClose_) {
+                cond_.wait_for(locker, chrono::milliseconds(static_cast<int64_t>(FLUSH_INTERVAL_MS)));
+            }
+            closing = isClose_;
+            if(current_->len > 0) {
+                full_.push_back(move(current_));
+                current_ = move(spare1);
+            }
+            if(!next_) {
+                next_ = move(spare2);
+            }
+            toWrite.swap(full_);
+        }
+        fullCond_.notify_all();  // 唤醒等待写线程取走缓冲区的写入者
+        // 按缓冲区检查日期与行数，切分后的文件行数最多多出一个缓冲区
+        iov.clear();
+        size_t lines = 0;
+        for(auto& buf : toWrite) {
+            iov.push_back({buf->data, buf->len});
+            lines += buf->lines;
+            if(lineCount_ + lines >= MAX_LINES) {
+                WriteFile_(iov.data(), iov.size());
+                Rotate_(lines);
+                iov.clear();
+                lines = 0;
+            }
+        }
+        WriteFile_(iov.data(), iov.size());
+        Rotate_(lines);
+        // 留下两个缓冲区，供下一轮交换
+        for(auto& buf : toWrite) {
+            buf->len = 0;
+            buf->lines = 0;
+            if(!spare1) {
+                spare1 = move(buf);
+            } else if(!spare2) {
+                spare2 = move(buf);
+            }
+        }
+        toWrite.clear();
+        if(!spare1) { spare1.reset(new LogBuffer); }
+        if(!spare2) { spare2.reset(new LogBuffer); }
+    }
+}
+// 普通文件的 writev 只在磁盘已满等错误时部分写入，此时丢弃剩余的部分
+void Log::WriteFile_(const struct iovec* iov, int count) {
+    while(count > 0 && fd_ >= 0) {
+        int n = count < IOV_MAX ? count : IOV_MAX;
+        if(writev(fd_, iov, n) < 0 && errno == EINTR) { continue; }
+        iov += n;
+        count -= n;
     }
 }
 
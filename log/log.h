@@ -1,28 +1,36 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-16
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef LOG_H
 #define LOG_H
 
 #include <mutex>
 #include <string>
 #include <thread>
-#include <sys/time.h>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <condition_variable>
 #include <string.h>
 #include <stdarg.h>           
 #include <assert.h>
+#include <errno.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/uio.h>
 #include <sys/stat.h>         
-#include "blockqueue.h"
-#include "../buffer/buffer.h"
+#include "../timer/cachedclock.h"
+#include "binlog.h"
 
+// 异步方式为双缓冲 (muduo)：各线程在自己的行缓冲区中格式化，加锁只为复制到当前缓冲区，
+// 写满的缓冲区交给写线程，写线程每 FLUSH_INTERVAL_MS 或有缓冲区写满时整批取走，用 writev 写入文件
 class Log {
 public:
+    // maxQueueCapacity 为 0 时同步写入，否则开启写线程
     void init(int level, const char* path = "./log", 
                 const char* suffix =".log",
                 int maxQueueCapacity = 1024);
@@ -31,51 +39,104 @@ public:
     static void FlushLogThread();
 
     void write(int level, const char *format,...);
-    void flush();
+    void flush();  // 异步方式下唤醒写线程，立即写入已有的内容
 
-    int GetLevel();
-    void SetLevel(int level);
-    bool IsOpen() { return isOpen_; }
+    // 二进制日志 (见 BinLog)：每个调用处第一次执行时注册格式串 (须为字面量)，返回其编号，格式串过多时返回 -1
+    int RegisterFormat(int level, const char* format);
+    // 只复制参数，不格式化
+    template<class... Args>
+    void WriteBinary(int id, Args... args) {
+        static_assert(sizeof...(Args) <= BinLog::MAX_ARGS, "too many log arguments");
+        if(id < 0) { return; }
+        thread_local char rec[BinLog::MAX_RECORD];
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        BinLog::Writer writer(rec, formats_[id].prec);
+        writer.Begin(id, static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000, sizeof...(Args));
+        writer.Put(args...);
+        Append_(rec, writer.End() - rec);
+    }
+
+    int GetLevel() const { return level_.load(std::memory_order_relaxed); }
+    void SetLevel(int level) { level_.store(level, std::memory_order_relaxed); }
+    bool IsOpen() const { return isOpen_.load(std::memory_order_relaxed); }
     
 private:
     Log();
-    void AppendLogLevelTitle_(int level);
+    static int AppendLogLevelTitle_(int level, char* buf);
     virtual ~Log();
     void AsyncWrite_();
+    void Append_(const char* data, size_t len);
+    void Rotate_(size_t lines);
+    void WriteFile_(const struct iovec* iov, int count);
+    void WriteFormats_();
+    size_t EncodeFormat_(int id, char* rec) const;
 
 private:
     static const int LOG_PATH_LEN = 256;
     static const int LOG_NAME_LEN = 256;
     static const int MAX_LINES = 50000;
+    static const int LINE_SIZE = 4096;           // 单行的上限，超过时截断
+    static const size_t BUFFER_SIZE = 1 << 20;
+    static const size_t MAX_BUFFERS = 16;        // 等待写入的缓冲区上限
+    static const int FLUSH_INTERVAL_MS = 1000;
+
+    struct LogBuffer {
+        char data[BUFFER_SIZE];
+        size_t len = 0;
+        size_t lines = 0;
+        size_t Avail() const { return BUFFER_SIZE - len; }
+    };
 
     const char* path_;
     const char* suffix_;
 
-    int MAX_LINES_;
-
-    int lineCount_;
+    size_t lineCount_;  // 当前文件中的行数
+    int fileIndex_;     // 当天按行数切分的序号
     int toDay_;
 
-    bool isOpen_;
- 
-    Buffer buff_;
-    int level_;
+    std::atomic<bool> isOpen_;
+    std::atomic<int> level_;
     bool isAsync_;
+    bool isClose_;
 
-    FILE* fp_;
-    std::unique_ptr<BlockDeque<std::string>> deque_; 
+    int fd_;
+    std::unique_ptr<LogBuffer> current_;  // 正在写入的缓冲区
+    std::unique_ptr<LogBuffer> next_;     // 预备的空缓冲区
+    std::vector<std::unique_ptr<LogBuffer>> full_;  // 已写满、等待写线程取走的缓冲区
     std::unique_ptr<std::thread> writeThread_;
     std::mutex mtx_;
+    std::condition_variable cond_;      // 唤醒写线程
+    std::condition_variable fullCond_;  // 等待写入的缓冲区过多时，写入者等待写线程取走
+
+    struct Format {
+        const char* format;
+        int level;
+        int prec[BinLog::MAX_ARGS];  // 各参数作为字符串时的精度 (见 BinLog::Writer)
+    };
+    Format formats_[BinLog::MAX_FORMATS];
+    std::atomic<int> formatCount_;  // 已注册的格式串，formats_ 中此前的项不再改变
+    std::mutex formatMtx_;
 };
 
+#ifdef LOG_BINARY
+#define LOG_BASE(level, format, ...) \
+    do {\
+        Log* log = Log::Instance();\
+        if (log->IsOpen() && log->GetLevel() <= level) {\
+            static const int logFormatId = log->RegisterFormat(level, format);\
+            log->WriteBinary(logFormatId, ##__VA_ARGS__); \
+        }\
+    } while(0);
+#else
 #define LOG_BASE(level, format, ...) \
     do {\
         Log* log = Log::Instance();\
         if (log->IsOpen() && log->GetLevel() <= level) {\
             log->write(level, format, ##__VA_ARGS__); \
-            log->flush();\
         }\
     } while(0);
+#endif
 
 #define LOG_DEBUG(format, ...) do {LOG_BASE(0, format, ##__VA_ARGS__)} while(0);
 #define LOG_INFO(format, ...) do {LOG_BASE(1, format, ##__VA_ARGS__)} while(0);
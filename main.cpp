@@ -1,12 +1,9 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-18
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include <unistd.h>
 #include "server/webserver.h"
 
@@ -14,6 +11,11 @@ int main() {
     WebServer server(
         20000, 3, 60000, false,            // 端口 ET模式 timeoutMs 优雅退出  
         6, true, 1, 1024);                 // 线程池数量 日志开关 日志等级 日志异步队列容量 
+    // server.LoadBundle("./bin/resources.bundle");   // 可选：从 make bundle 生成的归档文件提供静态资源
+    // server.EnableTls("./bin/server.crt", "./bin/server.key");  // 可选：HTTPS，需要 make TLS=1 编译
+    // server.EnableGzip(6);  // 可选：动态响应的 gzip 压缩，需要 make GZIP=1 编译
+    // server.AddProxy("/api/", {"127.0.0.1:8080", "127.0.0.1:8081"});  // 可选：反向代理到本机的上游服务
+    // server.AddFastCgi("/php/", "unix:/run/php/php-fpm.sock", "/var/www");  // 可选：动态页面交给 FastCGI 后端 (如 php-fpm)
     server.Start();
 } 
   
\ No newline at end of file
@@ -1,6 +1,3 @@
-<<<<<<< HEAD
-#include "webserver.h"
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-17
@@ -10,22 +7,26 @@
 
 #include "webserver.h"
 
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 using namespace std;
 // 构造函数初始化相关变量，定时器，线程池，epoll
 WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int threadNum, bool openLog, int logLevel, int logQueSize):
-            port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller())
+            port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), idleTimeoutMS_(KEEPALIVE_IDLE_MS), isClose_(false),
+            timer_(new TimeWheel([this](int id) { OnTimeout_(id); })), threadpool_(new ThreadPool(threadNum)),
+            diskpool_(new ThreadPool(DISK_THREADS)), diskTasks_(0), epoller_(new Epoller()), shedAt_(0)
     {
+    // 上游超时须早于客户端超时，客户端才能收到 504
+    upstreamTimeoutMS_ = timeoutMS_ > 0 && timeoutMS_ / 2 < UPSTREAM_TIMEOUT_MS ? timeoutMS_ / 2 : UPSTREAM_TIMEOUT_MS;
     srcDir_ = getcwd(nullptr, 256);  // pwd 获得根目录
     assert(srcDir_);
     strncat(srcDir_, "/resources/", 16);
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
+    signal(SIGPIPE, SIG_IGN);  // 对端已关闭时写入返回 EPIPE，而不是终止进程
     
     InitEventMode_(trigMode);
+    InitRoutes_();
     if(!InitSocket_()) { isClose_ = true;}
 
     if(openLog) {
@@ -49,6 +50,108 @@ WebServer::~WebServer() {
     free(srcDir_);
 }
 
+// 从归档文件提供静态资源 (由 make bundle 生成)，归档中没有的文件仍从 srcDir 读取
+bool WebServer::LoadBundle(const char* path) {
+    return Bundle::Instance()->Open(path);
+}
+
+// 开启 HTTPS，之后所有新连接都先进行 TLS 握手 (需要 make TLS=1 编译)
+bool WebServer::EnableTls(const char* certFile, const char* keyFile) {
+#ifdef WITH_TLS
+    return TlsContext::Instance()->Init(certFile, keyFile);
+#else
+    LOG_ERROR("TLS is not supported, rebuild with: make TLS=1");
+    return false;
+#endif
+}
+
+void WebServer::SetKeepAlive(int maxRequests, int idleTimeoutMS) {
+    HttpConn::maxRequests = std::max(maxRequests, 1);
+    idleTimeoutMS_ = idleTimeoutMS > MIN_IDLE_MS ? idleTimeoutMS : MIN_IDLE_MS;
+    HttpConn::keepAliveTimeout = idleTimeoutMS_ / 1000;
+}
+
+void WebServer::SetClientTimeouts(int headerTimeoutMS, int minRate) {
+    HttpConn::headerTimeoutMS = headerTimeoutMS > MIN_IDLE_MS ? headerTimeoutMS : MIN_IDLE_MS;
+    HttpConn::minRate = minRate > 0 ? minRate : 0;
+}
+
+void WebServer::SetRequestLimits(size_t maxLine, size_t maxHeader, size_t maxBody) {
+    HttpConn::maxRequestLine = maxLine;
+    HttpConn::maxHeaderSize = std::max(maxHeader, maxLine);
+    HttpConn::maxBodySize = maxBody;
+}
+
+void WebServer::SetRateLimit(const RateLimit::Limits& perIp, const RateLimit::Limits& perPrefix) {
+    RateLimit::Instance()->SetIpLimits(perIp);
+    RateLimit::Instance()->SetPrefixLimits(perPrefix);
+}
+
+void WebServer::SetMemoryLimits(size_t budget, size_t maxReadBuffer, size_t maxWriteBuffer) {
+    MemBudget::Instance()->SetLimit(budget);
+    HttpConn::maxReadBuffer = maxReadBuffer;
+    HttpConn::maxWriteBuffer = maxWriteBuffer;
+    LOG_INFO("Memory budget: %zu, read buffer: %zu, write buffer: %zu", budget, maxReadBuffer, maxWriteBuffer);
+}
+
+bool WebServer::EnableGzip(int level) {
+#ifdef WITH_GZIP
+    return Gzip::Instance()->Enable(level);
+#else
+    LOG_ERROR("gzip is not supported, rebuild with: make GZIP=1");
+    return false;
+#endif
+}
+
+bool WebServer::AddProxy(const char* prefix, const std::vector<std::string>& backends,
+                         Upstream::POLICY policy) {
+    return Proxy::Instance()->AddRoute(prefix, backends, policy);
+}
+
+bool WebServer::AddFastCgi(const char* prefix, const char* address, const char* root) {
+    // 后端连接在 worker 中按需建立，通过回调注册到 epoll
+    FastCgi::Instance()->SetPoller([this](int op, int fd, uint32_t events) {
+        if(op == EPOLL_CTL_ADD) {
+            epoller_->AddFd(fd, connEvent_ | events);
+        } else if(op == EPOLL_CTL_MOD) {
+            epoller_->ModFd(fd, connEvent_ | events);
+        } else {
+            epoller_->DelFd(fd);
+        }
+    });
+    return FastCgi::Instance()->AddRoute(prefix, address, root);
+}
+
+bool WebServer::AddHandler(int methods, const char* pattern, Route::Handler handler) {
+    return Router::Instance()->AddHandler(methods, pattern, handler);
+}
+bool WebServer::CacheHandler(const char* pattern, int ttlMs, int staleMs, const std::vector<std::string>& vary) {
+    return Router::Instance()->SetCache(pattern, ttlMs, staleMs, vary);
+}
+// 内置的处理函数，默认页面与错误页由 Router 注册
+void WebServer::InitRoutes_() {
+    // 微缓存的后台刷新交给 worker 线程池
+    MicroCache::Instance()->SetExecutor([this](std::function<void()> task) {
+        threadpool_->AddTask(std::move(task));
+    });
+    // 运行状态统计，只允许本机访问
+    Router::Instance()->AddHandler(Router::GET | Router::HEAD, "/status",
+        [](HttpRequest&, HttpResponse& response, const RouteMatch&) {
+            string stats = FileCache::Instance()->StatsStr();
+            stats += MicroCache::Instance()->StatsStr();
+            stats += RateLimit::Instance()->StatsStr();
+            stats += MemBudget::Instance()->StatsStr();
+            stats += AllocCount::StatsStr();
+#ifdef WITH_GZIP
+            stats += Gzip::Instance()->StatsStr();
+#endif
+#ifdef WITH_TLS
+            stats += TlsContext::Instance()->StatsStr();
+#endif
+            response.SetContent(stats, "text/plain");
+        }, true);
+}
+
 // 选择 epoll 监听事件的触发模式 
 // case 1: connEvent(客户端socket)  ET 模式
 // case 2: listenEvent(服务器 listen) ET 模式
@@ -80,13 +183,14 @@ void WebServer::InitEventMode_(int trigMode) {
 }
 
 void WebServer::Start() {
-    int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
+    Router::Instance()->Compile();  // 路由在此之前注册完毕
+#ifdef WITH_TLS
+    TlsContext::Instance()->SetHttp2(!Router::Instance()->HasGateway());
+#endif
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
     while(!isClose_) {
-        if(timeoutMS_ > 0) {
-            timeMS = timer_->GetNextTick();
-        }
-        int eventCnt = epoller_->Wait(timeMS);
+        // 超时由时间轮的 timerfd 作为普通事件送达，没有事件时一直阻塞
+        int eventCnt = epoller_->Wait();
         for(int i = 0; i < eventCnt; i++) {
             /* 处理事件 */
             int fd = epoller_->GetEventFd(i);
@@ -94,21 +198,33 @@ void WebServer::Start() {
             if(fd == listenFd_) {
                 DealListen_();
             }
+            else if(fd == timer_->Fd()) {
+                DealTimer_();
+            }
+            else if(IsUpstream_(fd)) {
+                DealUpstream_(fd);  // 上游连接的 fd 可能与已关闭的客户端 fd 相同，需要先判断
+            }
+            else if(IsFcgi_(fd)) {
+                DealFcgi_(fd);
+            }
+            else if(Conn_(fd)->IsClosed()) {
+                continue;  // 本轮中已关闭的后端连接的遗留事件
+            }
             else if(events & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+                CloseConn_(Conn_(fd));
             }
             else if(events & EPOLLIN) {
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                DealRead_(Conn_(fd));
             }
             else if(events & EPOLLOUT) {
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(Conn_(fd));
             } else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        if(MemBudget::Instance()->Excess() > 0) {
+            ShedMemory_();
+        }
     }
 }
 
@@ -121,22 +237,69 @@ void WebServer::SendError_(int fd, const char*info) {
     close(fd);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {
+// expired 为 true 时由超时回调调用：已持有 timerMtx_，节点也已从时间轮中移除
+void WebServer::CloseConn_(HttpConn* client, bool expired) {
     assert(client);
     LOG_INFO("Client[%d] quit!", client->GetFd());
+    // 定时器留在时间轮中的话，到期时会再次关闭同一个 fd (可能已分配给其他连接)
+    if(timeoutMS_ > 0 && !expired) {
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        timer_->Cancel(client->Timer());
+    }
+    std::shared_ptr<ProxyConn> proxy = client->GetProxy();
+    if(proxy) {
+        // 上游可能不再有任何事件，不能等 OnUpstream_ 释放
+        proxy->Abort();
+        FinishUpstream_(proxy, expired);
+    }
+    if(client->GetFcgi()) {
+        client->GetFcgi()->Abort();
+    }
+    if(client->GetStream()) {
+        client->GetStream()->Abort();
+    }
+    SetBusy_(client->GetFd());
     epoller_->DelFd(client->GetFd());
     client->Close();
 }
 
 void WebServer::AddClient_(int fd, sockaddr_in addr) {
     assert(fd > 0);
-    users_[fd].init(fd, addr);
+    HttpConn* client = Conn_(fd);
+    if(!client->init(fd, addr)) {
+        RateLimit::Instance()->Disconnect(addr.sin_addr.s_addr);
+        close(fd);
+        return;
+    }
     if(timeoutMS_ > 0) {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd]));
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        int timeout = client->RequestTimeLeft();  // 第一个请求的截止时间
+        timer_->Add(client->Timer(), fd, timeout < timeoutMS_ ? timeout : timeoutMS_);
     }
     epoller_->AddFd(fd, EPOLLIN | connEvent_);
     SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    LOG_INFO("Client[%d] in!", fd);
+}
+
+HttpConn* WebServer::Conn_(int fd) {
+    assert(fd >= 0 && fd < MAX_FD);
+    std::unique_ptr<HttpConn, ConnPageDeleter>& page = conns_[fd / CONN_PAGE];
+    if(!page) {
+        HttpConn* conns = static_cast<HttpConn*>(aligned_alloc(alignof(HttpConn), sizeof(HttpConn) * CONN_PAGE));
+        assert(conns);
+        for(int i = 0; i < CONN_PAGE; i++) {
+            new(conns + i) HttpConn();
+        }
+        page.reset(conns);
+    }
+    return page.get() + fd % CONN_PAGE;
+}
+
+void WebServer::ConnPageDeleter::operator()(HttpConn* page) const {
+    for(int i = 0; i < CONN_PAGE; i++) {
+        page[i].~HttpConn();
+    }
+    free(page);
 }
 
 void WebServer::DealListen_() {
@@ -145,30 +308,159 @@ void WebServer::DealListen_() {
     do {
         int fd = accept(listenFd_, (struct sockaddr *)&addr, &len);
         if(fd <= 0) { return;}
-        else if(HttpConn::userCount >= MAX_FD) {
+        // 进程打开的其他文件过多，fd 超出了连接表的范围
+        if(fd >= MAX_FD) {
             SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
-            return;
+            LOG_WARN("Client fd %d out of range!", fd);
+            continue;
+        }
+        // 同一 IP / 网段的连接过多：直接回复预先生成的 429
+        if(!RateLimit::Instance()->Connect(addr.sin_addr.s_addr)) {
+            SendError_(fd, RateLimit::RESPONSE_429);
+            continue;
+        }
+        // 连接数接近上限时先回收空闲的 keep-alive 连接，没有可回收的连接时才拒绝新客户端
+        if(HttpConn::userCount >= MAX_FD) {
+            if(!ReapIdle_()) {
+                RateLimit::Instance()->Disconnect(addr.sin_addr.s_addr);
+                SendError_(fd, "Server busy!");
+                LOG_WARN("Clients is full!");
+                return;
+            }
+        } else if(HttpConn::userCount >= REAP_WATER) {
+            ReapIdle_();
         }
         AddClient_(fd, addr);
     } while(listenEvent_ & EPOLLET);
 }
 
+void WebServer::DealTimer_() {
+    std::lock_guard<std::mutex> locker(timerMtx_);
+    timer_->Expire();
+}
+// 定时器的 id：客户端为其 fd，上游连接为 MAX_FD + fd
+void WebServer::OnTimeout_(int id) {
+    if(id < MAX_FD) {
+        HttpConn* client = Conn_(id);
+        client->ReplyTimeout();  // 到达请求的截止时间：回复 408 之后关闭
+        CloseConn_(client, true);
+        return;
+    }
+    int fd = id - MAX_FD;
+    std::shared_ptr<ProxyConn> proxy;
+    HttpConn* client = nullptr;
+    {
+        std::lock_guard<std::mutex> locker(upstreamMtx_);
+        auto it = upstreams_.find(fd);
+        if(it == upstreams_.end()) { return; }
+        proxy = it->second.first;
+        client = it->second.second;
+    }
+    bool wakeClient = false;
+    if(!proxy->Timeout(&wakeClient)) {
+        timer_->Add(proxy->Timer(), id, upstreamTimeoutMS_);  // 等待客户端取走数据
+        return;
+    }
+    FinishUpstream_(proxy, true);
+    if(wakeClient) {
+        if(timeoutMS_ > 0) { timer_->Adjust(client->Timer(), timeoutMS_); }
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+    }
+}
+
 void WebServer::DealRead_(HttpConn* client) {
     assert(client);
+    SetBusy_(client->GetFd());
     ExtentTime_(client);
     threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client));
 }
 
 void WebServer::DealWrite_(HttpConn* client) {
     assert(client);
+    SetBusy_(client->GetFd());
     ExtentTime_(client);
     threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
 }
 
 void WebServer::ExtentTime_(HttpConn* client) {
     assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+    if(timeoutMS_ > 0) {
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        timer_->Adjust(client->Timer(), timeoutMS_);
+    }
+}
+// 处理完请求、等待下一个请求的连接：改用空闲超时，并加入回收队列 (worker 中调用)
+void WebServer::SetIdle_(HttpConn* client) {
+    int fd = client->GetFd();
+    {
+        std::lock_guard<std::mutex> locker(idleMtx_);
+        if(idleIndex_.count(fd) == 0) {
+            idleIndex_[fd] = idleList_.insert(idleList_.end(), std::make_pair(fd, client->Generation()));
+        }
+    }
+    if(timeoutMS_ > 0) {
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        timer_->Adjust(client->Timer(), IdleTimeout_());
+    }
+}
+
+void WebServer::SetBusy_(int fd) {
+    std::lock_guard<std::mutex> locker(idleMtx_);
+    auto it = idleIndex_.find(fd);
+    if(it != idleIndex_.end()) {
+        idleList_.erase(it->second);
+        idleIndex_.erase(it);
+    }
+}
+// 连接数超过一半后，空闲超时随连接数线性缩短，达到 REAP_WATER 时为 MIN_IDLE_MS
+int WebServer::IdleTimeout_() const {
+    int users = HttpConn::userCount;
+    const int low = MAX_FD / 2;
+    if(users <= low || idleTimeoutMS_ <= MIN_IDLE_MS) { return idleTimeoutMS_; }
+    if(users >= REAP_WATER) { return MIN_IDLE_MS; }
+    int64_t shorter = static_cast<int64_t>(idleTimeoutMS_ - MIN_IDLE_MS) * (users - low) / (REAP_WATER - low);
+    return idleTimeoutMS_ - static_cast<int>(shorter);
+}
+// 关闭最早进入空闲的连接：只 shutdown，由随后的 EPOLLRDHUP 事件走正常的关闭流程，
+// 这样不会与恰好在处理该连接的 worker 冲突
+// shutdown 在 idleMtx_ 下进行：关闭连接时先 SetBusy_ 再 close，因此 fd 仍属于该连接；
+// 代数不一致说明槽位已经换成新连接，不能 shutdown
+bool WebServer::ReapIdle_() {
+    std::lock_guard<std::mutex> locker(idleMtx_);
+    while(!idleList_.empty()) {
+        int fd = idleList_.front().first;
+        uint32_t gen = idleList_.front().second;
+        idleList_.pop_front();
+        idleIndex_.erase(fd);
+        if(Conn_(fd)->Generation() != gen) {
+            LOG_DEBUG("Client[%d] reused, not reaped", fd);
+            continue;
+        }
+        shutdown(fd, SHUT_RDWR);
+        LOG_INFO("Client[%d] idle, reaped", fd);
+        return true;
+    }
+    return false;
+}
+
+// 超出内存预算：先按 LRU 淘汰缓存，仍然不够时关闭最早进入空闲的连接
+// 关闭的连接要等 EPOLLRDHUP 之后才释放内存，因此两次释放之间至少间隔 SHED_INTERVAL_MS
+void WebServer::ShedMemory_() {
+    int64_t now = CachedClock::NowMS();
+    if(now - shedAt_ < SHED_INTERVAL_MS) { return; }
+    shedAt_ = now;
+    size_t excess = MemBudget::Instance()->Excess();
+    size_t freed = MicroCache::Instance()->Trim(excess);
+#ifdef WITH_GZIP
+    if(freed < excess) { freed += Gzip::Instance()->Trim(excess - freed); }
+#endif
+    if(freed < excess) { freed += FileCache::Instance()->Trim(excess - freed); }
+    int conns = 0;
+    while(freed < excess && conns < SHED_CONNS && ReapIdle_()) {
+        conns++;
+    }
+    MemBudget::Instance()->CountShed(freed, conns);
+    LOG_WARN("Memory over budget by %zu, cache freed %zu, idle closed %d", excess, freed, conns);
 }
 
 void WebServer::OnRead_(HttpConn* client) {
@@ -185,18 +477,79 @@ void WebServer::OnRead_(HttpConn* client) {
 
 void WebServer::OnProcess(HttpConn* client) {
     if(client->process()) {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        if(client->GetProxy()) {
+            StartProxy_(client);
+            return;
+        }
+        if(client->GetFcgi()) {
+            StartFcgi_(client);
+            return;
+        }
+        if(client->GetStream()) {
+            StartStream_(client);
+            return;
+        }
+        // 响应内容不在 page cache 中：交给磁盘 IO 线程预读，完成后再注册 EPOLLOUT
+        // 这样 worker 不会阻塞在 writev 的缺页上，影响排在后面的其他连接
+        if(!client->IsResident()) {
+            if(++diskTasks_ <= MAX_DISK_TASKS) {
+                // 等待预读期间连接没有注册事件，只可能被超时关闭 (持有 timerMtx_)，槽位随后可能分配给新连接
+                // 因此完成时在 timerMtx_ 下核对槽位的代数，不一致说明原连接已关闭，丢弃结果
+                int fd = client->GetFd();
+                uint32_t gen = client->Generation();
+                diskpool_->AddTask([this, client, fd, gen, prefetch = client->PrefetchTask()] {
+                    prefetch();
+                    diskTasks_--;
+                    std::lock_guard<std::mutex> locker(timerMtx_);
+                    if(client->Generation() != gen) {
+                        LOG_DEBUG("Client[%d] closed during prefetch", fd);
+                        return;
+                    }
+                    epoller_->ModFd(fd, connEvent_ | EPOLLOUT);
+                });
+                return;
+            }
+            diskTasks_--;  // 磁盘 IO 队列已满，直接发送
+        }
+        // HTTP/2 发送期间仍需读取对端的 WINDOW_UPDATE 等帧，积压过多时除外
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT | (client->IsHttp2() && client->CanRead() ? EPOLLIN : 0));
     } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        // 请求尚未收齐：超时不晚于请求的截止时间，每次收到数据都不会延长
+        // 已处理过请求、正在等待下一个请求的连接为空闲连接，需在注册事件之前标记
+        int left = client->RequestTimeLeft();
+        if(left >= 0) {
+            if(timeoutMS_ > 0) {
+                std::lock_guard<std::mutex> locker(timerMtx_);
+                timer_->Adjust(client->Timer(), left < timeoutMS_ ? left : timeoutMS_);
+            }
+        } else if(!client->WantWrite() && (client->Requests() > 0 || client->IsHttp2())) {
+            SetIdle_(client);
+        }
+        // TLS 握手过程中可能需要等待可写
+        epoller_->ModFd(client->GetFd(), connEvent_ | (client->WantWrite() ? EPOLLOUT : EPOLLIN));
     }
 }
 
 void WebServer::OnWrite_(HttpConn* client) {
     assert(client);
+    if(client->WantWrite()) {  // 继续 TLS 握手
+        OnRead_(client);
+        return;
+    }
+    // 代理 / FastCGI 请求由上游唤醒时可能还没有待发送的数据，直接继续转发
+    if(client->ToWriteBytes() == 0 && client->HasGateway()) {
+        PullGateway_(client);
+        return;
+    }
     int ret = -1;
     int writeErrno = 0;
     ret = client->write(&writeErrno);
     if(client->ToWriteBytes() == 0) {
+        // 代理 / FastCGI 请求：继续转发后端的数据
+        if(client->HasGateway()) {
+            PullGateway_(client);
+            return;
+        }
         // 传输完成 
         if(client->IsKeepAlive()) {
             OnProcess(client);
@@ -205,14 +558,171 @@ void WebServer::OnWrite_(HttpConn* client) {
     }
     else if(ret < 0) {
         if(writeErrno == EAGAIN) {
-            // 继续传输 
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
-            return;
+            // 继续传输，对端不再接收时由定时器按发送截止时间关闭
+            int left = client->SendTimeLeft();
+            if(left != 0) {
+                if(left > 0 && timeoutMS_ > 0) {
+                    std::lock_guard<std::mutex> locker(timerMtx_);
+                    timer_->Adjust(client->Timer(), left < timeoutMS_ ? left : timeoutMS_);
+                }
+                epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT | (client->IsHttp2() && client->CanRead() ? EPOLLIN : 0));
+                return;
+            }
+            LOG_WARN("Client[%d](%s) reads too slowly, closed", client->GetFd(), client->GetIP());
         }
     }
     CloseConn_(client);
 }
 
+// 取得上游连接并注册到 epoll，连接建立 (可写) 后发送请求
+// 没有可用的上游时直接回复 502
+void WebServer::StartProxy_(HttpConn* client) {
+    std::shared_ptr<ProxyConn> proxy = client->GetProxy();
+    int fd = proxy->Connect();
+    if(fd < 0) {
+        PullGateway_(client);
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> locker(upstreamMtx_);
+        upstreams_[fd] = std::make_pair(proxy, client);
+    }
+    {
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        timer_->Add(proxy->Timer(), MAX_FD + fd, upstreamTimeoutMS_);
+    }
+    epoller_->AddFd(fd, connEvent_ | EPOLLOUT);
+}
+
+bool WebServer::IsUpstream_(int fd) {
+    if(Proxy::Instance()->Empty()) { return false; }
+    std::lock_guard<std::mutex> locker(upstreamMtx_);
+    return upstreams_.count(fd) > 0;
+}
+
+void WebServer::DealUpstream_(int fd) {
+    std::shared_ptr<ProxyConn> proxy;
+    HttpConn* client = nullptr;
+    uint32_t gen = 0;
+    {
+        // 客户端关闭时先移除上游再增加代数，找到上游时记下的代数属于原连接
+        std::lock_guard<std::mutex> locker(upstreamMtx_);
+        auto it = upstreams_.find(fd);
+        if(it == upstreams_.end()) { return; }
+        proxy = it->second.first;
+        client = it->second.second;
+        gen = client->Generation();
+    }
+    ExtentTime_(client);  // 上游有进展时客户端连接不应超时
+    {
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        timer_->Adjust(proxy->Timer(), upstreamTimeoutMS_);
+    }
+    threadpool_->AddTask(std::bind(&WebServer::OnUpstream_, this, proxy, client, client->GetFd(), gen));
+}
+
+void WebServer::OnUpstream_(std::shared_ptr<ProxyConn> proxy, HttpConn* client, int fd, uint32_t gen) {
+    bool wakeClient = false;
+    uint32_t events = proxy->OnEvent(&wakeClient);
+    if(proxy->IsFinished()) {
+        FinishUpstream_(proxy);
+    } else if(events) {
+        epoller_->ModFd(proxy->Fd(), connEvent_ | events);
+    }
+    // 积压过多时 events 为 0，等客户端取走数据后由 PullGateway_ 恢复
+    if(wakeClient) {
+        WakeClient_(client, fd, gen);
+    }
+}
+// 客户端的数据已经发送完，从后端取下一部分
+void WebServer::PullGateway_(HttpConn* client) {
+    int resumeFd = -1;
+    int state = client->PullGateway(&resumeFd);
+    if(resumeFd >= 0) {
+        epoller_->ModFd(resumeFd, connEvent_ | EPOLLIN);
+    }
+    switch(state) {
+    case Gateway::DRAIN_DATA:
+    case Gateway::DRAIN_BAD_GATEWAY:
+    case Gateway::DRAIN_GATEWAY_TIMEOUT:
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        break;
+    case Gateway::DRAIN_WAIT:
+        break;  // 后端收到数据后唤醒客户端
+    case Gateway::DRAIN_DONE:
+        if(client->IsKeepAlive()) {
+            client->EndGateway();
+            OnProcess(client);  // 处理后续请求或等待新请求
+            break;
+        }
+        CloseConn_(client);
+        break;
+    default:
+        CloseConn_(client);
+        break;
+    }
+}
+// 上游请求结束：取消超时，从 epoll 中移除后放回连接池或关闭
+// expired 为 true 时由超时回调调用，已持有 timerMtx_
+void WebServer::FinishUpstream_(const std::shared_ptr<ProxyConn>& proxy, bool expired) {
+    int fd = proxy->Fd();
+    if(fd < 0) { return; }
+    {
+        std::lock_guard<std::mutex> locker(upstreamMtx_);
+        if(upstreams_.erase(fd) == 0) { return; }
+    }
+    if(expired) {
+        timer_->Cancel(proxy->Timer());
+    } else {
+        std::lock_guard<std::mutex> locker(timerMtx_);
+        timer_->Cancel(proxy->Timer());
+    }
+    epoller_->DelFd(fd);
+    proxy->ReleaseUpstream();
+}
+
+// 交给 FastCGI 后端，后端连接收到该请求的数据后为客户端注册 EPOLLOUT
+void WebServer::StartFcgi_(HttpConn* client) {
+    std::shared_ptr<FcgiRequest> fcgi = client->GetFcgi();
+    int fd = client->GetFd();
+    uint32_t gen = client->Generation();
+    bool ok = fcgi->Start([this, client, fd, gen] {
+        WakeClient_(client, fd, gen);
+    });
+    if(!ok) {
+        PullGateway_(client);  // 回复 502
+    }
+}
+// 流式响应：先发送响应头，之后处理函数写入数据且客户端空闲时注册 EPOLLOUT
+void WebServer::StartStream_(HttpConn* client) {
+    int fd = client->GetFd();
+    uint32_t gen = client->Generation();
+    client->GetStream()->SetWaker([this, client, fd, gen] {
+        WakeClient_(client, fd, gen);
+    });
+    epoller_->ModFd(fd, connEvent_ | EPOLLOUT);
+}
+// 后端或处理函数在其他线程中唤醒客户端，与预读完成时相同：在 timerMtx_ 下核对槽位的代数
+// 不一致说明原连接已关闭，槽位可能已分配给新连接，不能为它注册 EPOLLOUT
+void WebServer::WakeClient_(HttpConn* client, int fd, uint32_t gen) {
+    std::lock_guard<std::mutex> locker(timerMtx_);
+    if(client->Generation() != gen) {
+        LOG_DEBUG("Client[%d] closed before wakeup", fd);
+        return;
+    }
+    epoller_->ModFd(fd, connEvent_ | EPOLLOUT);
+}
+
+bool WebServer::IsFcgi_(int fd) {
+    return FastCgi::Instance()->Find(fd) != nullptr;
+}
+// FastCGI 后端连接上的事件，连接由多个请求共享，在 worker 中分发给各个请求
+void WebServer::DealFcgi_(int fd) {
+    std::shared_ptr<FcgiConn> conn = FastCgi::Instance()->Find(fd);
+    if(!conn) { return; }
+    threadpool_->AddTask([conn] { conn->OnEvent(); });
+}
+
 /* Create listenFd */
 bool WebServer::InitSocket_() {
     int ret;
@@ -273,6 +783,11 @@ bool WebServer::InitSocket_() {
         close(listenFd_);
         return false;
     }
+    if(!epoller_->AddFd(timer_->Fd(), EPOLLIN)) {  // 上游超时总是需要
+        LOG_ERROR("Add timer error!");
+        close(listenFd_);
+        return false;
+    }
     SetFdNonblock(listenFd_);  // 需要将 listenFd 设置为非阻塞
     LOG_INFO("Server port:%d", port_);
     return true;
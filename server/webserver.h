@@ -1,24 +1,18 @@
-<<<<<<< HEAD
-=======
 /*
  * @Author       : mark
  * @Date         : 2020-06-17
  * @copyleft Apache 2.0
  */ 
 // 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #ifndef WEBSERVER_H
 #define WEBSERVER_H
 
 #include <unordered_map>
-<<<<<<< HEAD
-#include <fcntl.h>
-#include <unistd.h>
-=======
+#include <list>
 #include <fcntl.h>       // fcntl()
 #include <unistd.h>      // close()
->>>>>>> def492361972feedee60578307251dcb6ce473b1
 #include <assert.h>
+#include <signal.h>
 #include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
@@ -26,7 +20,7 @@
 #include "epoller.h"
 #include "threadpool.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timewheel.h"
 #include "../http/httpconn.h"
 
 class WebServer {
@@ -36,32 +30,100 @@ public:
         int threadNum, bool openLog, int logLevel, int logQueSize);
 
     ~WebServer();
+    bool LoadBundle(const char* path);
+    bool EnableTls(const char* certFile, const char* keyFile);
+    // 处理函数响应的 gzip 压缩，level 为 1-9 (需要 make GZIP=1 编译)
+    bool EnableGzip(int level);
+    // keep-alive：每个连接最多处理 maxRequests 个请求，请求之间最多空闲 idleTimeoutMS
+    // 构造函数中的 timeoutMS 为处理请求过程中的超时
+    void SetKeepAlive(int maxRequests, int idleTimeoutMS);
+    // 慢速客户端：请求行与头部须在 headerTimeoutMS 内收齐 (新连接从建立时开始计算)，
+    // 请求体与响应的平均速率不低于 minRate 字节/秒 (0 表示不限制)
+    void SetClientTimeouts(int headerTimeoutMS, int minRate);
+    // 请求大小上限：请求行 (414)、请求行与头部 (431)、请求体 (413)
+    void SetRequestLimits(size_t maxLine, size_t maxHeader, size_t maxBody);
+    // 按客户端 IP 与所在 /24 网段限制每秒请求数与同时打开的连接数，超过时回复 429
+    void SetRateLimit(const RateLimit::Limits& perIp, const RateLimit::Limits& perPrefix = { 0, 0, 0 });
+    // 内存：缓冲区与缓存的总预算 (0 表示不限制，超出时淘汰缓存、关闭空闲连接)，
+    // 每个连接读缓冲区中未处理的数据与写缓冲区积压的上限 (超过时暂停读取)
+    void SetMemoryLimits(size_t budget, size_t maxReadBuffer, size_t maxWriteBuffer);
+    // 反向代理：以 prefix 开头的请求转发给 backends ("ip:port") 之一
+    bool AddProxy(const char* prefix, const std::vector<std::string>& backends,
+                  Upstream::POLICY policy = Upstream::ROUND_ROBIN);
+    // FastCGI：以 prefix 开头的请求交给 address ("unix:/path" 或 "ip:port")，脚本位于 root 下
+    bool AddFastCgi(const char* prefix, const char* address, const char* root);
+    // 动态处理函数，pattern 见 Router，例如 "/users/:id"；methods 为 Router::METHOD 的组合
+    bool AddHandler(int methods, const char* pattern, Route::Handler handler);
+    // 为处理函数开启微缓存：ttlMs 内直接返回缓存，之后 staleMs 内返回旧内容并在后台刷新
+    // vary 为参与缓存 key 的请求头
+    bool CacheHandler(const char* pattern, int ttlMs, int staleMs = 0,
+                      const std::vector<std::string>& vary = {});
     void Start();
 
 private:
     bool InitSocket_(); 
     void InitEventMode_(int trigMode);
+    void InitRoutes_();
     void AddClient_(int fd, sockaddr_in addr);
   
     void DealListen_();
     void DealWrite_(HttpConn* client);
+    void DealTimer_();
+    void OnTimeout_(int id);
     void DealRead_(HttpConn* client);
 
     void SendError_(int fd, const char*info);
     void ExtentTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
+    void SetIdle_(HttpConn* client);
+    void SetBusy_(int fd);
+    int IdleTimeout_() const;
+    bool ReapIdle_();
+    void ShedMemory_();
+    void CloseConn_(HttpConn* client, bool expired = false);
 
     void OnRead_(HttpConn* client);
     void OnWrite_(HttpConn* client);
     void OnProcess(HttpConn* client);
 
-    static const int MAX_FD = 65536;
+    void StartProxy_(HttpConn* client);
+    bool IsUpstream_(int fd);
+    void DealUpstream_(int fd);
+    void OnUpstream_(std::shared_ptr<ProxyConn> proxy, HttpConn* client, int fd, uint32_t gen);
+    void PullGateway_(HttpConn* client);
+    void FinishUpstream_(const std::shared_ptr<ProxyConn>& proxy, bool expired = false);
+
+    void StartFcgi_(HttpConn* client);
+    bool IsFcgi_(int fd);
+    void DealFcgi_(int fd);
+
+    void StartStream_(HttpConn* client);
+    void WakeClient_(HttpConn* client, int fd, uint32_t gen);
+
+    static const int MAX_FD = 1 << 17;            // 最大连接数，也是连接表可以索引的 fd 上限
+    static const int REAP_WATER = MAX_FD / 10 * 9;  // 超过该连接数后每接受一个新连接回收一个空闲连接
+    static const int KEEPALIVE_IDLE_MS = 15000;     // 默认的空闲超时
+    static const int MIN_IDLE_MS = 1000;            // 连接数很多时缩短到的空闲超时
+    static const int SHED_INTERVAL_MS = 100;        // 超出内存预算时两次释放之间的间隔
+    static const int SHED_CONNS = 64;               // 每次最多关闭的空闲连接数
+    static const int DISK_THREADS = 2;       // 磁盘 IO 线程数
+    static const int MAX_DISK_TASKS = 256;   // 磁盘 IO 任务上限，超过后直接走原路径
+    static const int UPSTREAM_TIMEOUT_MS = 30000;  // 上游连接、发送请求与等待响应的不活动超时，超时回复 504
 
     static int SetFdNonblock(int fd);
 
+    // 连接表：按 fd 直接索引，每页 CONN_PAGE 个 HttpConn 连续存放 (按 cache line 对齐)
+    // 页在其中的 fd 第一次使用时分配，之后槽位地址不变 (定时器与任务中保存指针)；只在主线程中调用
+    HttpConn* Conn_(int fd);
+    struct ConnPageDeleter {
+        void operator()(HttpConn* page) const;
+    };
+    static const int CONN_PAGE = 256;
+
     int port_;
     bool openLinger_;
     int timeoutMS_;  // 毫秒MS 
+    int idleTimeoutMS_;  // keep-alive 连接在请求之间的空闲超时
+    int upstreamTimeoutMS_;
     bool isClose_;
     int listenFd_;
     char* srcDir_;
@@ -69,10 +131,23 @@ private:
     uint32_t listenEvent_;
     uint32_t connEvent_;
    
-    std::unique_ptr<HeapTimer> timer_;
+    std::unique_ptr<TimeWheel> timer_;
+    std::mutex timerMtx_;  // 空闲超时在 worker 中设置
     std::unique_ptr<ThreadPool> threadpool_;
+    std::unique_ptr<ThreadPool> diskpool_;   // 冷数据预读线程池，避免 worker 阻塞在缺页上
+    std::atomic<int> diskTasks_;
     std::unique_ptr<Epoller> epoller_;
-    std::unordered_map<int, HttpConn> users_;
+    std::unique_ptr<HttpConn, ConnPageDeleter> conns_[MAX_FD / CONN_PAGE];
+
+    // 空闲的 keep-alive 连接 (fd, 进入空闲时的代数)，按进入空闲的先后排列
+    std::mutex idleMtx_;
+    std::list<std::pair<int, uint32_t>> idleList_;
+    std::unordered_map<int, std::list<std::pair<int, uint32_t>>::iterator> idleIndex_;
+    int64_t shedAt_;  // 上次因超出内存预算而释放的时间 (毫秒)
+
+    // 正在使用的上游连接 fd -> (代理请求, 客户端连接)，worker 中增删，需要加锁
+    std::mutex upstreamMtx_;
+    std::unordered_map<int, std::pair<std::shared_ptr<ProxyConn>, HttpConn*>> upstreams_;
 };
 
 
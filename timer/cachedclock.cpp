@@ -0,0 +1,38 @@
+#include "cachedclock.h"
+
+CachedClock::CachedClock(): sec_(0), current_(0) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    Refresh_(ts.tv_sec);
+}
+
+CachedClock* CachedClock::Instance() {
+    static CachedClock clock;
+    return &clock;
+}
+
+const CachedClock::Second& CachedClock::Wall(long* usec) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+    if(usec) { *usec = ts.tv_nsec / 1000; }
+    CachedClock* clock = Instance();
+    if(clock->sec_.load(std::memory_order_acquire) != ts.tv_sec) {
+        clock->Refresh_(ts.tv_sec);
+    }
+    return clock->seconds_[clock->current_.load(std::memory_order_acquire)];
+}
+// 格式化到当前未使用的一份再切换，其他线程正在格式化时直接返回，读取者暂时使用上一秒的内容
+void CachedClock::Refresh_(time_t sec) {
+    std::unique_lock<std::mutex> locker(mtx_, std::try_to_lock);
+    if(!locker.owns_lock() || sec_.load(std::memory_order_relaxed) == sec) { return; }
+    int next = current_.load(std::memory_order_relaxed) ^ 1;
+    Second& s = seconds_[next];
+    s.sec = sec;
+    localtime_r(&sec, &s.local);
+    strftime(s.log, sizeof(s.log), "%Y-%m-%d %H:%M:%S", &s.local);
+    struct tm gmt;
+    gmtime_r(&sec, &gmt);
+    s.dateLen = strftime(s.date, sizeof(s.date), "%a, %d %b %Y %H:%M:%S GMT", &gmt);
+    current_.store(next, std::memory_order_release);
+    sec_.store(sec, std::memory_order_release);
+}
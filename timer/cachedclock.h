@@ -0,0 +1,42 @@
+#ifndef CACHED_CLOCK_H
+#define CACHED_CLOCK_H
+
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+// 粗粒度时钟：读取 CLOCK_*_COARSE (vDSO，不进入内核，精度为一个时钟中断周期，1~4 毫秒)
+// 墙上时间按秒缓存本地时间与格式化好的日志时间戳、HTTP Date，秒数变化后由第一个读取的线程重新格式化
+class CachedClock {
+public:
+    struct Second {
+        time_t sec;
+        struct tm local;  // 本地时间
+        char log[24];     // 日志时间戳 "2021-07-01 11:01:33"
+        char date[32];    // HTTP Date "Thu, 01 Jul 2021 03:01:33 GMT"
+        int dateLen;
+    };
+
+    // 单调时钟 (毫秒)，用于定时器、截止时间与限速
+    static int64_t NowMS() {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+        return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+    }
+    // 当前这一秒的墙上时间，usec 非空时写入秒内的微秒数
+    // 返回的内容在下一次切换秒数之前不变 (两份交替使用)，调用者应尽快复制出需要的部分
+    static const Second& Wall(long* usec = nullptr);
+
+private:
+    CachedClock();
+    static CachedClock* Instance();
+    void Refresh_(time_t sec);
+
+    std::atomic<time_t> sec_;
+    std::atomic<int> current_;
+    Second seconds_[2];
+    std::mutex mtx_;
+};
+
+#endif //CACHED_CLOCK_H
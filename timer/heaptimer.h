@@ -1,80 +0,0 @@
-<<<<<<< HEAD
-=======
-/*
- * @Author       : mark
- * @Date         : 2020-06-17
- * @copyleft Apache 2.0
- */ 
-
-// 原作者：mark, 以下为个人学习后进行的复现，增加注释，并进行了部分的修改
-
->>>>>>> def492361972feedee60578307251dcb6ce473b1
-#ifndef HEAP_TIMER_H
-#define HEAP_TIMER_H
-
-#include <queue>
-#include <unordered_map>
-#include <time.h>
-#include <algorithm>
-#include <arpa/inet.h> 
-#include <functional> 
-#include <assert.h> 
-#include <chrono>
-#include "../log/log.h"
-
-
-// 类型别名
-typedef std::function<void()> TimeoutCallBack;
-typedef std::chrono::high_resolution_clock Clock;
-typedef std::chrono::milliseconds MS;
-typedef Clock::time_point TimeStamp;
-
-// 定时器节点
-struct TimerNode {
-    int id;
-<<<<<<< HEAD
-    TimeStamp expires;    // 过期时间
-=======
-    TimeStamp expires;    // 过期事件
->>>>>>> def492361972feedee60578307251dcb6ce473b1
-    TimeoutCallBack cb;   // 回调函数
-    // < 的重载, 可以直接比较定时器节点
-    bool operator<(const TimerNode& t) {
-        return expires < t.expires;
-    }
-};
-class HeapTimer {
-public:
-    HeapTimer() { heap_.reserve(64); } // capacity = 64
-
-    ~HeapTimer() { clear(); }
-    
-    void adjust(int id, int newExpires);
-
-    void add(int id, int timeOut, const TimeoutCallBack& cb);
-
-    void doWork(int id);
-
-    void clear();
-
-    void tick();
-
-    void pop();
-
-    int GetNextTick();
-
-private:
-    void del_(size_t i);
-    
-    void siftup_(size_t i);
-
-    bool siftdown_(size_t index, size_t n);
-
-    void SwapNode_(size_t i, size_t j);
-
-    std::vector<TimerNode> heap_;
-
-    std::unordered_map<int, size_t> ref_;
-};
-
-#endif //HEAP_TIMER_H
\ No newline at end of file
@@ -0,0 +1,195 @@
+#include "timewheel.h"
+
+TimeWheel::TimeWheel(const TimeoutCallBack& cb): cb_(cb), current_(CachedClock::NowMS()), size_(0),
+        armed_(INT64_MAX) {
+    timerFd_ = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    assert(timerFd_ >= 0);
+    for(int i = 0; i < ROOT_SIZE; i++) {
+        root_[i].prev = root_[i].next = &root_[i];
+    }
+    for(int l = 0; l < LEVELS; l++) {
+        for(int i = 0; i < LEVEL_SIZE; i++) {
+            levels_[l][i].prev = levels_[l][i].next = &levels_[l][i];
+        }
+    }
+}
+
+TimeWheel::~TimeWheel() {
+    close(timerFd_);
+}
+// timerfd 按精确时间触发，此时粗粒度时钟可能还没有走到，到期处理使用精确时间
+int64_t TimeWheel::ClockMS_() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+}
+
+// level 层中 time 所在的槽 (链表哨兵)
+TimerNode* TimeWheel::Slot_(int level, int64_t time) {
+    if(level == 0) {
+        return &root_[time & (ROOT_SIZE - 1)];
+    }
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    return &levels_[level - 1][(time >> shift) & (LEVEL_SIZE - 1)];
+}
+// 按距 current_ 的时间选择层：第 0 层放 ROOT_SIZE 毫秒以内的，之后每层的范围扩大 LEVEL_SIZE 倍
+// 所在的槽需要处理的时刻 (第 0 层为到期，上层为放入下层) 早于 timerfd 时提前 timerfd
+void TimeWheel::Link_(TimerNode* node) {
+    int64_t expires = node->expires;
+    if(expires < current_) { expires = current_; }  // 已经超时：放入下一个处理的槽
+    int64_t delta = expires - current_;
+    if(delta > MAX_TIMEOUT) {
+        expires = current_ + MAX_TIMEOUT;  // 超出范围的放在最高层的最远处，到期时重新放置
+        delta = MAX_TIMEOUT;
+    }
+    int level = 0;
+    while(level < LEVELS && delta >= (int64_t(1) << (ROOT_BITS + level * LEVEL_BITS))) {
+        level++;
+    }
+    TimerNode* head = Slot_(level, expires);
+    node->prev = head->prev;
+    node->next = head;
+    head->prev->next = node;
+    head->prev = node;
+    int64_t due = expires;
+    if(level > 0) {
+        int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+        due = expires >> shift << shift;
+    }
+    if(due < armed_) {
+        Arm_(due);
+    }
+}
+
+void TimeWheel::Unlink_(TimerNode* node) {
+    node->prev->next = node->next;
+    node->next->prev = node->prev;
+    node->prev = node->next = nullptr;
+}
+
+void TimeWheel::Add(TimerNode* node, int id, int timeout) {
+    assert(node && id >= 0);
+    node->id = id;
+    if(node->prev) {
+        Adjust(node, timeout);
+        return;
+    }
+    int64_t now = CachedClock::NowMS();
+    if(size_ == 0) { current_ = now; }  // 空闲期间没有处理过的时刻不必再逐个处理
+    node->expires = now + timeout;
+    Link_(node);
+    size_++;
+}
+// 延长时只记下新的超时时刻，节点所在的槽到期时再按新时刻重新放置；缩短时立即移到对应的槽
+void TimeWheel::Adjust(TimerNode* node, int timeout) {
+    assert(node);
+    if(!node->prev) { return; }
+    int64_t expires = CachedClock::NowMS() + timeout;
+    if(expires >= node->expires) {
+        node->expires = expires;
+        return;
+    }
+    node->expires = expires;
+    Unlink_(node);
+    Link_(node);
+}
+
+void TimeWheel::Cancel(TimerNode* node) {
+    assert(node);
+    if(!node->prev) { return; }
+    Unlink_(node);
+    size_--;
+}
+// 将 level 层当前的槽中的节点重新放入下层，该层转完一圈时继续处理上一层
+void TimeWheel::Cascade_(int level) {
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    int idx = (current_ >> shift) & (LEVEL_SIZE - 1);
+    TimerNode* head = &levels_[level - 1][idx];
+    while(head->next != head) {
+        TimerNode* node = head->next;
+        Unlink_(node);
+        Link_(node);
+    }
+    if(idx == 0 && level < LEVELS) {
+        Cascade_(level + 1);
+    }
+}
+
+void TimeWheel::Tick_(int64_t now) {
+    while(current_ <= now) {
+        if(size_ == 0) {  // 没有定时器时直接跳到当前时刻
+            current_ = now + 1;
+            break;
+        }
+        int idx = current_ & (ROOT_SIZE - 1);
+        if(idx == 0) {
+            Cascade_(1);
+        }
+        // 先将整个槽摘下，回调中可能添加或取消其他节点
+        TimerNode* head = &root_[idx];
+        TimerNode list;
+        list.prev = list.next = &list;
+        if(head->next != head) {
+            list.next = head->next;
+            list.prev = head->prev;
+            list.next->prev = &list;
+            list.prev->next = &list;
+            head->prev = head->next = head;
+        }
+        while(list.next != &list) {
+            TimerNode* node = list.next;
+            Unlink_(node);
+            if(node->expires > current_) {  // 期间延长过
+                Link_(node);
+                continue;
+            }
+            size_--;
+            cb_(node->id);
+        }
+        current_++;
+    }
+}
+// 最早需要处理的槽：每层从当前位置向后找第一个非空的槽，取各层对应时刻中最早的
+// current_ 恰好在某层的边界上时，该层当前的槽还没有放入下层
+int64_t TimeWheel::NextDue_() const {
+    if(size_ == 0) { return INT64_MAX; }
+    int64_t due = INT64_MAX;
+    for(int j = 0; j < ROOT_SIZE; j++) {
+        const TimerNode* head = &root_[(current_ + j) & (ROOT_SIZE - 1)];
+        if(head->next != head) {
+            due = current_ + j;
+            break;
+        }
+    }
+    for(int l = 0; l < LEVELS; l++) {
+        int shift = ROOT_BITS + l * LEVEL_BITS;
+        int64_t base = current_ >> shift;
+        for(int j = (current_ & ((int64_t(1) << shift) - 1)) ? 1 : 0; j <= LEVEL_SIZE; j++) {
+            const TimerNode* head = &levels_[l][(base + j) & (LEVEL_SIZE - 1)];
+            if(head->next != head) {
+                int64_t t = (base + j) << shift;
+                if(t < due) { due = t; }
+                break;
+            }
+        }
+    }
+    return due;
+}
+// 绝对时间设置 timerfd，已经过去的时刻会立即触发；INT64_MAX 表示停止
+void TimeWheel::Arm_(int64_t due) {
+    armed_ = due;
+    struct itimerspec spec = {};
+    if(due != INT64_MAX) {
+        spec.it_value.tv_sec = due / 1000;
+        spec.it_value.tv_nsec = due % 1000 * 1000000;
+    }
+    timerfd_settime(timerFd_, TFD_TIMER_ABSTIME, &spec, nullptr);
+}
+// 处理期间的 Link_ 不设置 timerfd，处理完后按最早的槽统一设置
+void TimeWheel::Expire() {
+    uint64_t count;
+    while(read(timerFd_, &count, sizeof(count)) > 0) {}
+    armed_ = INT64_MIN;
+    Tick_(ClockMS_());
+    Arm_(NextDue_());
+}
@@ -0,0 +1,66 @@
+#ifndef TIME_WHEEL_H
+#define TIME_WHEEL_H
+
+#include <functional>
+#include <stdint.h>
+#include <assert.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+#include "cachedclock.h"
+
+// 定时器节点，嵌入在使用者 (连接槽位) 中，由 TimeWheel 串入各个槽的双向链表
+struct TimerNode {
+    TimerNode* prev = nullptr;  // 为 nullptr 表示不在时间轮中
+    TimerNode* next = nullptr;
+    int64_t expires = 0;        // 超时时刻 (毫秒)，延长时只改写该值，所在的槽到期时再重新放置
+    int id = -1;                // 超时回调的参数
+};
+
+// 分层时间轮：第 0 层 256 个槽，每槽 1 毫秒；其上 3 层各 64 个槽，每层的一个槽为下一层转一圈
+// 添加、延长、取消都是 O(1)；上层的槽到期时将其中的节点重新放入下层 (cascade)
+// 每个时间轮有自己的 timerfd，设置为最早需要处理的槽的时刻，由所属的事件循环注册到 epoll，可读时调用 Expire
+// 不是线程安全的，调用者加锁
+class TimeWheel {
+public:
+    typedef std::function<void(int id)> TimeoutCallBack;
+
+    explicit TimeWheel(const TimeoutCallBack& cb);
+    ~TimeWheel();
+
+    // node 已在时间轮中时等同于 Adjust
+    void Add(TimerNode* node, int id, int timeout);
+    // 超时时间可能延长也可能缩短；节点已超时移除 (连接已关闭) 时忽略
+    void Adjust(TimerNode* node, int timeout);
+    void Cancel(TimerNode* node);
+    // timerfd 可读时调用：处理到当前时刻为止到期的槽，对超时的节点调用回调 (此时节点已移除)，再设置下一次的时刻
+    void Expire();
+    int Fd() const { return timerFd_; }
+    size_t Size() const { return size_; }
+
+private:
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 3;  // 第 0 层之上的层数
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int64_t MAX_TIMEOUT = (int64_t(1) << (ROOT_BITS + LEVELS * LEVEL_BITS)) - 1;
+
+    TimerNode* Slot_(int level, int64_t time);
+    void Link_(TimerNode* node);
+    static void Unlink_(TimerNode* node);
+    void Cascade_(int level);
+    void Tick_(int64_t now);
+    int64_t NextDue_() const;
+    void Arm_(int64_t due);
+    static int64_t ClockMS_();
+
+    TimeoutCallBack cb_;
+    int64_t current_;  // 下一个要处理的时刻，第 0 层中该时刻及之后的 ROOT_SIZE 毫秒各占一个槽
+    size_t size_;
+    int timerFd_;
+    int64_t armed_;    // timerfd 设置的时刻，INT64_MAX 表示未设置
+    TimerNode root_[ROOT_SIZE];             // 各槽为带哨兵的循环链表
+    TimerNode levels_[LEVELS][LEVEL_SIZE];
+};
+
+#endif //TIME_WHEEL_H
@@ -0,0 +1,182 @@
+// 事件分发时查找连接并读取热数据的开销：原来的 unordered_map<int, HttpConn> (请求、响应与热数据混在一起)，
+// 与现在按 fd 分页的连接表 + 热/冷数据分离的 HttpConn 对比
+// 每个事件与 WebServer::Start / DealRead_ 相同：按 fd 找到连接，读取 fd_、wantWrite_、h2_、requests_ 等热数据
+// 用法：connbench [连接数] [事件数]
+// 例子：./bin/Exe/connbench 100000 20000000
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include "../http/httpconn.h"
+
+using namespace std;
+
+namespace {
+
+// 拆分之前 HttpConn 的数据成员 (顺序与类型相同)，只保留分发时读取的访问函数
+class OldConn {
+public:
+    OldConn() : fd_(-1), isClose_(true), requests_(0), deadline_(0), headerDone_(false),
+        stallStart_(0), stallSent_(0), stallQueued_(0), iovIdx_(0),
+        iov_(ArenaAllocator<struct iovec>(&arena_)), headIovs_(0), wantWrite_(false),
+#ifdef WITH_TLS
+        ssl_(nullptr), handshaked_(false), ktlsSend_(false),
+#endif
+        request_(&arena_), response_(&arena_) {}
+
+    int GetFd() const __attribute__((noinline)) { return fd_; }  // 与 HttpConn::GetFd 一样不内联
+    bool WantWrite() const { return wantWrite_; }
+    bool IsHttp2() const { return h2_ != nullptr; }
+    int Requests() const { return requests_; }
+
+private:
+    Arena arena_;
+
+    int fd_;
+    struct sockaddr_in addr_;
+
+    bool isClose_;
+    int requests_;
+    int64_t deadline_;
+    bool headerDone_;
+    int64_t stallStart_;
+    uint64_t stallSent_;
+    int stallQueued_;
+
+    size_t iovIdx_;
+    HttpResponse::Iovecs iov_;
+    size_t headIovs_;
+    bool wantWrite_;
+
+#ifdef WITH_TLS
+    SSL* ssl_;
+    bool handshaked_;
+    bool ktlsSend_;
+    HttpResponse::FileSegs fileSegs_;
+#endif
+
+    Buffer readBuff_;
+    ChainBuffer writeBuff_;
+
+    HttpRequest request_;
+    HttpResponse response_;
+    std::unique_ptr<Http2Session> h2_;
+    std::shared_ptr<ProxyConn> proxy_;
+    std::shared_ptr<FcgiRequest> fcgi_;
+    std::shared_ptr<ResponseStream> stream_;
+};
+
+// 与 WebServer::Conn_ 相同：每页 256 个连接，第一次用到时分配，地址不再变化
+template<class T>
+class ConnTable {
+public:
+    static const int PAGE = 256;
+
+    explicit ConnTable(int maxFd) : pages_((maxFd + PAGE - 1) / PAGE) {}
+    ~ConnTable() {
+        for(T* page : pages_) {
+            if(!page) { continue; }
+            for(int i = 0; i < PAGE; i++) {
+                page[i].~T();
+            }
+            free(page);
+        }
+    }
+
+    T* Get(int fd) {
+        T*& page = pages_[fd / PAGE];
+        if(!page) {
+            page = static_cast<T*>(aligned_alloc(alignof(T) < 64 ? 64 : alignof(T), sizeof(T) * PAGE));
+            for(int i = 0; i < PAGE; i++) {
+                new(page + i) T();
+            }
+        }
+        return page + fd % PAGE;
+    }
+
+private:
+    vector<T*> pages_;
+};
+
+// 读取的热数据合并为一个值，防止被优化掉
+inline uint64_t Touch(OldConn* conn) {
+    return conn->GetFd() + conn->WantWrite() + conn->IsHttp2() + conn->Requests();
+}
+
+inline uint64_t Touch(HttpConn* conn) {
+    return conn->GetFd() + conn->WantWrite() + conn->IsHttp2() + conn->Requests();
+}
+
+int64_t NowNS() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// 事件的 fd 预先随机生成，查找方式由 get 决定
+template<class Get>
+double Run(const vector<int>& fds, int events, Get get, uint64_t* sum) {
+    int64_t start = NowNS();
+    size_t n = fds.size();
+    for(int i = 0; i < events; i++) {
+        *sum += Touch(get(fds[i % n]));
+    }
+    return static_cast<double>(NowNS() - start) / events;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int conns = argc > 1 ? atoi(argv[1]) : 100000;
+    int events = argc > 2 ? atoi(argv[2]) : 20000000;
+    if(conns <= 0 || events <= 0) {
+        fprintf(stderr, "usage: %s [conns] [events]\n", argv[0]);
+        return 1;
+    }
+    // 连接的 fd 从 3 开始连续分配，事件随机落在各连接上
+    mt19937 rng(1);
+    vector<int> fds(1 << 22);
+    for(int& fd : fds) {
+        fd = 3 + rng() % conns;
+    }
+    uint64_t sum = 0;
+
+    // 原来的用法：users_[fd]
+    double mapNs;
+    {
+        unordered_map<int, OldConn> users;
+        for(int fd = 3; fd < conns + 3; fd++) {
+            users[fd];
+        }
+        Run(fds, events / 10, [&users](int fd) { return &users[fd]; }, &sum);  // 预热
+        mapNs = Run(fds, events, [&users](int fd) { return &users[fd]; }, &sum);
+    }
+    // 只换成连接表，连接仍为原来的布局
+    double tableOldNs;
+    {
+        ConnTable<OldConn> table(conns + 3);
+        for(int fd = 3; fd < conns + 3; fd++) {
+            table.Get(fd);
+        }
+        Run(fds, events / 10, [&table](int fd) { return table.Get(fd); }, &sum);
+        tableOldNs = Run(fds, events, [&table](int fd) { return table.Get(fd); }, &sum);
+    }
+    // 现在的布局：连接表 + 热数据 (冷数据在处理请求时才访问，这里不分配)
+    double tableNs;
+    {
+        ConnTable<HttpConn> table(conns + 3);
+        for(int fd = 3; fd < conns + 3; fd++) {
+            table.Get(fd);
+        }
+        Run(fds, events / 10, [&table](int fd) { return table.Get(fd); }, &sum);
+        tableNs = Run(fds, events, [&table](int fd) { return table.Get(fd); }, &sum);
+    }
+
+    printf("%d connections, %d events (checksum %llu)\n", conns, events, static_cast<unsigned long long>(sum));
+    printf("sizeof: old HttpConn %zu bytes, HttpConn %zu bytes\n", sizeof(OldConn), sizeof(HttpConn));
+    printf("unordered_map + old layout: %6.1f ns/event\n", mapNs);
+    printf("table + old layout        : %6.1f ns/event\n", tableOldNs);
+    printf("table + hot/cold layout   : %6.1f ns/event\n", tableNs);
+    return 0;
+}
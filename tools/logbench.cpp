@@ -0,0 +1,91 @@
+// 日志吞吐：多个线程同时写日志，统计每秒写入的行数与平均每行写入文件的字节数
+// 线程数从 1 开始每次翻倍直到最大线程数；每行与服务器中最常见的连接日志相同
+// make logbench 为文本日志，make logbench BINLOG=1 为二进制日志 (写入的是记录，用 logdecode 还原)
+// 用法：logbench [最大线程数] [每个线程的行数] [日志目录] [sync]，指定 sync 时同步写入 (不开启写线程)
+// 例子：./bin/Exe/logbench 8 1000000 ./bin/logbench
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include "../log/log.h"
+
+using namespace std;
+
+namespace {
+
+// 目录中所有日志文件的总大小
+uint64_t DirSize(const string& dir) {
+    uint64_t total = 0;
+    DIR* d = opendir(dir.c_str());
+    if(!d) { return 0; }
+    while(struct dirent* e = readdir(d)) {
+        struct stat st;
+        if(e->d_name[0] != '.' && stat((dir + "/" + e->d_name).c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+            total += st.st_size;
+        }
+    }
+    closedir(d);
+    return total;
+}
+
+// 等待写线程写完已有的内容：文件大小不再变化
+uint64_t WaitFlushed(const string& dir) {
+    Log::Instance()->flush();
+    uint64_t size = DirSize(dir);
+    while(true) {
+        this_thread::sleep_for(chrono::milliseconds(100));
+        uint64_t now = DirSize(dir);
+        if(now == size) { return size; }
+        size = now;
+    }
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int maxThreads = argc > 1 ? atoi(argv[1]) : 8;
+    long lines = argc > 2 ? atol(argv[2]) : 1000000;
+    string dir = argc > 3 ? argv[3] : "./bin/logbench";
+    bool async = !(argc > 4 && strcmp(argv[4], "sync") == 0);
+    if(maxThreads <= 0 || lines <= 0) {
+        fprintf(stderr, "usage: %s [max threads] [lines per thread] [dir] [sync]\n", argv[0]);
+        return 1;
+    }
+    Log::Instance()->init(1, dir.c_str(), ".log", async ? 1024 : 0);
+    if(!Log::Instance()->IsOpen()) {
+        fprintf(stderr, "open log in %s failed\n", dir.c_str());
+        return 1;
+    }
+#ifdef LOG_BINARY
+    const char* format = "binary";
+#else
+    const char* format = "text";
+#endif
+    printf("%s log, %s, %ld lines per thread, dir %s\n", format, async ? "async" : "sync", lines, dir.c_str());
+
+    for(int threads = 1; threads <= maxThreads; threads *= 2) {
+        uint64_t before = WaitFlushed(dir);
+        auto start = chrono::steady_clock::now();
+        vector<thread> workers;
+        for(int t = 0; t < threads; t++) {
+            workers.emplace_back([t, lines] {
+                for(long i = 0; i < lines; i++) {
+                    LOG_INFO("Client[%d](%s:%d) in, userCount:%ld", t, "127.0.0.1", 40000 + static_cast<int>(i & 0xffff), i);
+                }
+            });
+        }
+        for(auto& w : workers) {
+            w.join();
+        }
+        double sec = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        uint64_t bytes = WaitFlushed(dir) - before;
+        printf("threads %2d: %6.2f M lines/s, %.1f bytes/line\n", threads, threads * lines / sec / 1e6,
+            static_cast<double>(bytes) / (threads * lines));
+    }
+    return 0;
+}
@@ -0,0 +1,243 @@
+// 将二进制日志 (make BINLOG=1) 还原为与文本日志相同格式的文本
+// 用法：logdecode [日志文件...]，没有参数时读取标准输入
+// 例子：./bin/Exe/logdecode ./bin/log/2021_07_01.log
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include "../log/binlog.h"
+
+using namespace std;
+
+namespace {
+
+struct Arg {
+    uint8_t type;
+    uint64_t u;    // INT 为 zigzag 解码后的值
+    double d;
+    string s;
+};
+
+struct Format {
+    string format;
+    int level;
+};
+
+vector<Format> formats;
+
+const char* LevelTitle(int level) {
+    switch(level) {
+    case 0: return "[debug]: ";
+    case 2: return "[warn] : ";
+    case 3: return "[error]: ";
+    default: return "[info] : ";
+    }
+}
+
+template<class T>
+void Append(string* out, const string& spec, T v) {
+    char buf[512];
+    int n = snprintf(buf, sizeof(buf), spec.c_str(), v);
+    if(n < 0) { return; }
+    if(static_cast<size_t>(n) < sizeof(buf)) {
+        out->append(buf, n);
+        return;
+    }
+    vector<char> big(n + 1);
+    snprintf(big.data(), big.size(), spec.c_str(), v);
+    out->append(big.data(), n);
+}
+
+int64_t Signed(const Arg& arg, int bits) {
+    if(bits >= 64) { return static_cast<int64_t>(arg.u); }
+    uint64_t u = arg.u << (64 - bits);
+    return static_cast<int64_t>(u) >> (64 - bits);
+}
+
+uint64_t Unsigned(const Arg& arg, int bits) {
+    if(bits >= 64) { return arg.u; }
+    return arg.u & ((uint64_t(1) << bits) - 1);
+}
+
+// 按格式串逐个转换说明格式化，参数的静态类型与转换说明不符或缺少参数时输出 "?"
+string FormatMessage(const string& format, const vector<Arg>& args) {
+    string out;
+    size_t next = 0;
+    const char* p = format.c_str();
+    const char* last = p;
+    BinLog::Spec spec;
+    while(BinLog::NextSpec(p, &spec)) {
+        out.append(last, spec.begin);
+        last = p;
+        if(spec.conv == '%') {
+            out += '%';
+            continue;
+        }
+        // 重新拼出转换说明：'*' 换成对应的参数，长度修饰统一为 ll
+        string fmt;
+        const char* q = spec.begin;
+        const char* end = spec.begin + spec.len - 1;
+        bool ok = true;
+        for(; q < end && !strchr("hlLqjzt", *q); q++) {
+            if(*q != '*') {
+                fmt += *q;
+                continue;
+            }
+            if(next >= args.size() || (args[next].type != BinLog::INT && args[next].type != BinLog::UINT)) {
+                ok = false;
+                break;
+            }
+            fmt += to_string(static_cast<int>(args[next++].u));
+        }
+        if(!ok || next >= args.size()) {
+            out += '?';
+            continue;
+        }
+        const Arg& arg = args[next++];
+        bool isInt = arg.type == BinLog::INT || arg.type == BinLog::UINT;
+        switch(spec.conv) {
+        case 'd': case 'i':
+            if(!isInt) { out += '?'; break; }
+            Append(&out, fmt + "ll" + spec.conv, static_cast<long long>(Signed(arg, spec.bits)));
+            break;
+        case 'u': case 'x': case 'X': case 'o':
+            if(!isInt) { out += '?'; break; }
+            Append(&out, fmt + "ll" + spec.conv, static_cast<unsigned long long>(Unsigned(arg, spec.bits)));
+            break;
+        case 'c':
+            if(!isInt) { out += '?'; break; }
+            Append(&out, fmt + spec.conv, static_cast<int>(arg.u));
+            break;
+        case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+            if(arg.type != BinLog::DOUBLE) { out += '?'; break; }
+            Append(&out, fmt + spec.conv, arg.d);
+            break;
+        case 's':
+            if(arg.type != BinLog::STR) { out += '?'; break; }
+            Append(&out, fmt + spec.conv, arg.s.c_str());
+            break;
+        case 'p':
+            if(arg.type != BinLog::PTR && !isInt) { out += '?'; break; }
+            Append(&out, fmt + spec.conv, reinterpret_cast<void*>(static_cast<uintptr_t>(arg.u)));
+            break;
+        default:
+            out += '?';
+            break;
+        }
+    }
+    out.append(last);
+    return out;
+}
+
+// 解析一条记录，返回其后的位置；记录不完整 (文件末尾正在写入) 时返回 nullptr
+const char* DecodeRecord(const char* p, const char* end, FILE* out) {
+    uint64_t id, v;
+    char tag = *p++;
+    if(!(p = BinLog::GetVarint(p, end, &id))) { return nullptr; }
+    if(tag == BinLog::FORMAT) {
+        if(p >= end) { return nullptr; }
+        int level = static_cast<uint8_t>(*p++);
+        if(!(p = BinLog::GetVarint(p, end, &v)) || static_cast<uint64_t>(end - p) < v) { return nullptr; }
+        if(id >= static_cast<uint64_t>(BinLog::MAX_FORMATS)) { return p + v; }
+        if(formats.size() <= id) { formats.resize(id + 1); }
+        formats[id].format.assign(p, v);
+        formats[id].level = level;
+        return p + v;
+    }
+    int64_t usec;
+    if(end - p < static_cast<ptrdiff_t>(sizeof(usec) + 1)) { return nullptr; }
+    memcpy(&usec, p, sizeof(usec));
+    p += sizeof(usec);
+    int argc = static_cast<uint8_t>(*p++);
+    vector<Arg> args(argc);
+    for(Arg& arg : args) {
+        if(p >= end) { return nullptr; }
+        arg.type = static_cast<uint8_t>(*p++);
+        switch(arg.type) {
+        case BinLog::INT:
+            if(!(p = BinLog::GetVarint(p, end, &v))) { return nullptr; }
+            arg.u = (v >> 1) ^ (~(v & 1) + 1);
+            break;
+        case BinLog::UINT:
+        case BinLog::PTR:
+            if(!(p = BinLog::GetVarint(p, end, &arg.u))) { return nullptr; }
+            break;
+        case BinLog::DOUBLE:
+            if(end - p < static_cast<ptrdiff_t>(sizeof(arg.d))) { return nullptr; }
+            memcpy(&arg.d, p, sizeof(arg.d));
+            p += sizeof(arg.d);
+            break;
+        case BinLog::STR:
+            if(!(p = BinLog::GetVarint(p, end, &v)) || static_cast<uint64_t>(end - p) < v) { return nullptr; }
+            arg.s.assign(p, v);
+            p += v;
+            break;
+        default:
+            return nullptr;
+        }
+    }
+
+    time_t sec = usec / 1000000;
+    struct tm t;
+    localtime_r(&sec, &t);
+    char stamp[64];
+    strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", &t);
+    if(id < formats.size() && !formats[id].format.empty()) {
+        const Format& f = formats[id];
+        fprintf(out, "%s.%06ld %s%s\n", stamp, static_cast<long>(usec % 1000000), LevelTitle(f.level),
+            FormatMessage(f.format, args).c_str());
+    } else {
+        fprintf(out, "%s.%06ld [?]    : <unknown format %llu>\n", stamp, static_cast<long>(usec % 1000000),
+            static_cast<unsigned long long>(id));
+    }
+    return p;
+}
+
+// 文件头 (Magic) 可能出现在文件中间 (重启后追加写入)，之后的格式串编号重新定义
+bool Decode(FILE* in, const char* name, FILE* out) {
+    string data;
+    char buf[1 << 16];
+    size_t n;
+    while((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        data.append(buf, n);
+    }
+    const char* p = data.data();
+    const char* end = p + data.size();
+    while(p < end) {
+        if(static_cast<size_t>(end - p) >= BinLog::MAGIC_LEN && memcmp(p, BinLog::Magic(), BinLog::MAGIC_LEN) == 0) {
+            formats.clear();
+            p += BinLog::MAGIC_LEN;
+            continue;
+        }
+        const char* q = nullptr;
+        if(*p == BinLog::FORMAT || *p == BinLog::LINE) {
+            q = DecodeRecord(p, end, out);
+        }
+        if(!q) {
+            fprintf(stderr, "%s: bad record at offset %zu\n", name, static_cast<size_t>(p - data.data()));
+            return false;
+        }
+        p = q;
+    }
+    return true;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    if(argc < 2) {
+        return Decode(stdin, "stdin", stdout) ? 0 : 1;
+    }
+    int ret = 0;
+    for(int i = 1; i < argc; i++) {
+        FILE* in = fopen(argv[i], "rb");
+        if(!in) {
+            fprintf(stderr, "open %s failed\n", argv[i]);
+            ret = 1;
+            continue;
+        }
+        if(!Decode(in, argv[i], stdout)) { ret = 1; }
+        fclose(in);
+    }
+    return ret;
+}
@@ -0,0 +1,18 @@
+// 将静态资源目录打包为单个归档文件，服务器启动时只需映射一次
+// 用法：respack <资源目录> <归档文件>
+// 例子：./bin/Exe/respack ./resources ./bin/resources.bundle
+#include <stdio.h>
+#include "../http/bundle.h"
+
+int main(int argc, char* argv[]) {
+    if(argc != 3) {
+        fprintf(stderr, "usage: %s <srcDir> <bundle>\n", argv[0]);
+        return 1;
+    }
+    if(!Bundle::Pack(argv[1], argv[2])) {
+        fprintf(stderr, "pack %s into %s failed\n", argv[1], argv[2]);
+        return 1;
+    }
+    printf("packed %s into %s\n", argv[1], argv[2]);
+    return 0;
+}
@@ -0,0 +1,99 @@
+// 路由匹配的开销：注册几千条精确、带参数与前缀路由，按类别统计每次 Router::Match 的耗时
+// 同时检查每个请求路径匹配到预期的路由 (参数值与路径中的位置一致)
+// 用法：routebench [每类路由的条数] [匹配次数]
+// 例子：./bin/Exe/routebench 1000 10000000
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <string>
+#include "../http/router.h"
+
+using namespace std;
+
+namespace {
+
+struct Request {
+    string method;
+    string path;
+    string pattern;  // 预期匹配的路由，空串表示没有路由 (静态文件)
+    string param;    // 预期的第一个参数值
+};
+
+int64_t NowNS() {
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+double Bench(const vector<Request>& requests, int count, uint64_t* sum) {
+    mt19937 rng(1);
+    vector<uint32_t> order(1 << 16);
+    for(auto& i : order) {
+        i = rng() % requests.size();
+    }
+    RouteMatch match;
+    int64_t start = NowNS();
+    for(int i = 0; i < count; i++) {
+        const Request& req = requests[order[i & (order.size() - 1)]];
+        Router::Instance()->Match(req.method, req.path, &match);
+        *sum += reinterpret_cast<uintptr_t>(match.route) + match.count;
+    }
+    return static_cast<double>(NowNS() - start) / count;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int n = argc > 1 ? atoi(argv[1]) : 1000;
+    int count = argc > 2 ? atoi(argv[2]) : 10000000;
+    if(n <= 0 || count <= 0) {
+        fprintf(stderr, "usage: %s [routes per kind] [matches]\n", argv[0]);
+        return 1;
+    }
+    Router* router = Router::Instance();
+    auto handler = [](HttpRequest&, HttpResponse&, const RouteMatch&) {};
+    vector<Request> exact, param, prefix, miss;
+    // 路由分散在 64 个一级目录下，与按服务划分的 API 相似
+    for(int i = 0; i < n; i++) {
+        string svc = "/svc" + to_string(i % 64);
+        string e = svc + "/v1/resource" + to_string(i) + "/status";
+        string p = svc + "/users/:id/resource" + to_string(i) + "/items/:item";
+        string f = svc + "/assets" + to_string(i) + "/";
+        router->AddHandler(Router::GET, e, handler);
+        router->AddHandler(Router::GET | Router::POST, p, handler);
+        router->AddStatic(f + "*", "", Router::GET);
+        exact.push_back({ "GET", e, e, "" });
+        string id = to_string(100000 + i);
+        param.push_back({ "POST", svc + "/users/" + id + "/resource" + to_string(i) + "/items/42?x=1", p, id });
+        prefix.push_back({ "GET", f + "js/app" + to_string(i) + ".js", f + "*", "" });
+        miss.push_back({ "GET", "/images/photo" + to_string(i) + ".jpg", "", "" });
+    }
+    router->Compile();
+
+    // 检查匹配结果
+    int errors = 0;
+    for(const auto* list : { &exact, &param, &prefix, &miss }) {
+        for(const auto& req : *list) {
+            RouteMatch match;
+            router->Match(req.method, req.path, &match);
+            string got = match.route ? match.route->pattern : "";
+            bool ok = got == req.pattern && !match.badMethod;
+            if(ok && !req.param.empty()) {
+                ok = match.count > 0 && string(match.path + match.values[0].off, match.values[0].len) == req.param;
+            }
+            if(!ok && errors++ < 10) {
+                printf("  %s %s: matched \"%s\", expected \"%s\"\n", req.method.c_str(), req.path.c_str(),
+                    got.c_str(), req.pattern.c_str());
+            }
+        }
+    }
+
+    uint64_t sum = 0;
+    printf("%d routes (%d exact, %d param, %d prefix), %d matches per kind\n", 3 * n, n, n, n, count);
+    printf("exact : %6.1f ns/match\n", Bench(exact, count, &sum));
+    printf("param : %6.1f ns/match\n", Bench(param, count, &sum));
+    printf("prefix: %6.1f ns/match\n", Bench(prefix, count, &sum));
+    printf("miss  : %6.1f ns/match\n", Bench(miss, count, &sum));
+    printf("check: %d mismatches (checksum %llu)\n", errors, static_cast<unsigned long long>(sum));
+    return errors == 0 ? 0 : 1;
+}
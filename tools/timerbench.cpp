@@ -0,0 +1,373 @@
+// 时间轮 (TimeWheel) 与原来的最小堆定时器 (HeapTimer) 的对比
+// 1. 性能：conns 个连接各有一个定时器，随机执行 ops 次操作 (90% 延长超时，即每次收到数据；10% 关闭后重新建立)，
+//    之后让全部定时器在 1 秒内陆续到期，统计处理到期的耗时
+// 2. 一致性：两者同时运行相同的随机操作序列 (添加、延长、缩短、取消)，比较超时的连接、到期时刻与先后顺序
+// 用法：timerbench [conns] [ops]
+// 例子：./bin/Exe/timerbench 100000 5000000
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <poll.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include <unordered_map>
+#include <map>
+#include <algorithm>
+#include "../timer/timewheel.h"
+
+using namespace std;
+
+namespace {
+
+// 原 timer/heaptimer.{h,cpp} 的副本 (去掉日志依赖，修正 siftup_ 中 size_t 永远 >= 0 的越界)
+// 原实现没有取消操作 (关闭连接时定时器留在堆中)，这里补充 cancel 以便与 TimeWheel::Cancel 对比
+// adjust 只下滤，只能延长 (服务器中每次都延长为相同的超时)；缩短超时要用 add
+typedef std::function<void()> TimeoutCallBack;
+typedef std::chrono::high_resolution_clock Clock;
+typedef std::chrono::milliseconds MS;
+typedef Clock::time_point TimeStamp;
+
+struct HeapNode {
+    int id;
+    TimeStamp expires;
+    TimeoutCallBack cb;
+    bool operator<(const HeapNode& t) {
+        return expires < t.expires;
+    }
+};
+
+class HeapTimer {
+public:
+    HeapTimer() { heap_.reserve(64); }
+
+    void adjust(int id, int timeout) {
+        heap_[ref_[id]].expires = Clock::now() + MS(timeout);
+        siftdown_(ref_[id], heap_.size());
+    }
+
+    void add(int id, int timeout, const TimeoutCallBack& cb) {
+        size_t i;
+        if(ref_.count(id) == 0) {
+            i = heap_.size();
+            ref_[id] = i;
+            heap_.push_back({id, Clock::now() + MS(timeout), cb});
+            siftup_(i);
+        } else {
+            i = ref_[id];
+            heap_[i].expires = Clock::now() + MS(timeout);
+            heap_[i].cb = cb;
+            if(!siftdown_(i, heap_.size())) {
+                siftup_(i);
+            }
+        }
+    }
+
+    TimeoutCallBack callback(int id) {
+        return heap_[ref_[id]].cb;
+    }
+
+    void cancel(int id) {
+        auto it = ref_.find(id);
+        if(it != ref_.end()) { del_(it->second); }
+    }
+
+    void tick() {
+        while(!heap_.empty()) {
+            HeapNode node = heap_.front();
+            if(std::chrono::duration_cast<MS>(node.expires - Clock::now()).count() > 0) {
+                break;
+            }
+            node.cb();
+            del_(0);
+        }
+    }
+
+    size_t size() const { return heap_.size(); }
+
+private:
+    void del_(size_t index) {
+        size_t i = index;
+        size_t n = heap_.size() - 1;
+        if(i < n) {
+            SwapNode_(i, n);
+            if(!siftdown_(i, n)) {
+                siftup_(i);
+            }
+        }
+        ref_.erase(heap_.back().id);
+        heap_.pop_back();
+    }
+
+    void siftup_(size_t i) {
+        while(i > 0) {
+            size_t j = (i - 1) / 2;
+            if(heap_[j] < heap_[i]) { break; }
+            SwapNode_(i, j);
+            i = j;
+        }
+    }
+
+    bool siftdown_(size_t index, size_t n) {
+        size_t i = index;
+        size_t j = i * 2 + 1;
+        while(j < n) {
+            if(j + 1 < n && heap_[j + 1] < heap_[j]) j++;
+            if(heap_[i] < heap_[j]) break;
+            SwapNode_(i, j);
+            i = j;
+            j = i * 2 + 1;
+        }
+        return i > index;
+    }
+
+    void SwapNode_(size_t i, size_t j) {
+        std::swap(heap_[i], heap_[j]);
+        ref_[heap_[i].id] = i;
+        ref_[heap_[j].id] = j;
+    }
+
+    std::vector<HeapNode> heap_;
+    std::unordered_map<int, size_t> ref_;
+};
+
+int64_t NowUS() {
+    return chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int64_t NowMS() {
+    return NowUS() / 1000;
+}
+
+// 等到 fd 可读或超过 timeout 毫秒
+bool WaitFd(int fd, int timeout) {
+    struct pollfd pfd = { fd, POLLIN, 0 };
+    return poll(&pfd, 1, timeout) > 0;
+}
+
+struct Result {
+    double opNs;      // 每次添加 / 延长 / 取消的平均耗时
+    double expireMs;  // 处理全部到期的总耗时 (不含等待)
+    size_t fired;
+};
+
+// 与服务器中的用法相同：连接槽位中嵌入 TimerNode，回调参数为 fd
+Result BenchWheel(int conns, const vector<pair<int, bool>>& ops, int timeout) {
+    size_t fired = 0;
+    vector<TimerNode> nodes(conns);
+    TimeWheel wheel([&fired](int) { fired++; });
+    for(int i = 0; i < conns; i++) {
+        wheel.Add(&nodes[i], i, timeout);
+    }
+    int64_t start = NowUS();
+    for(const auto& op : ops) {
+        if(op.second) {
+            wheel.Cancel(&nodes[op.first]);
+            wheel.Add(&nodes[op.first], op.first, timeout);
+        } else {
+            wheel.Adjust(&nodes[op.first], timeout);
+        }
+    }
+    double opNs = (NowUS() - start) * 1000.0 / ops.size();
+
+    // 全部定时器在 1 秒内均匀到期
+    for(int i = 0; i < conns; i++) {
+        wheel.Adjust(&nodes[i], 1 + static_cast<int>(int64_t(i) * 1000 / conns));
+    }
+    int64_t busy = 0;
+    while(wheel.Size() > 0) {
+        WaitFd(wheel.Fd(), 100);
+        int64_t t = NowUS();
+        wheel.Expire();
+        busy += NowUS() - t;
+    }
+    return { opNs, busy / 1000.0, fired };
+}
+
+// 与原服务器中的用法相同：回调为 std::bind 生成的 std::function，每次添加时复制
+Result BenchHeap(int conns, const vector<pair<int, bool>>& ops, int timeout) {
+    size_t fired = 0;
+    HeapTimer heap;
+    auto cb = [&fired](int) { fired++; };
+    for(int i = 0; i < conns; i++) {
+        heap.add(i, timeout, std::bind(cb, i));
+    }
+    int64_t start = NowUS();
+    for(const auto& op : ops) {
+        if(op.second) {
+            heap.cancel(op.first);
+            heap.add(op.first, timeout, std::bind(cb, op.first));
+        } else {
+            heap.adjust(op.first, timeout);
+        }
+    }
+    double opNs = (NowUS() - start) * 1000.0 / ops.size();
+
+    for(int i = 0; i < conns; i++) {
+        heap.add(i, 1 + static_cast<int>(int64_t(i) * 1000 / conns), heap.callback(i));
+    }
+    int64_t busy = 0;
+    while(heap.size() > 0) {
+        usleep(1000);  // 原服务器以 epoll_wait 的超时驱动，粒度为 1 毫秒
+        int64_t t = NowUS();
+        heap.tick();
+        busy += NowUS() - t;
+    }
+    return { opNs, busy / 1000.0, fired };
+}
+
+// 随机操作序列：在 span 毫秒内的随机时刻执行，超时时间 1 ~ maxTimeout 毫秒
+struct Op {
+    int64_t at;    // 距开始的毫秒数
+    int id;
+    int kind;      // 0 添加 / 重新添加，1 调整，2 取消
+    int timeout;
+};
+
+// 一次到期：连接、预期的到期时刻、实际回调的时刻
+struct Fired {
+    int id;
+    int64_t expected;
+    int64_t at;
+};
+
+// 比较两者的到期记录：到期的 (连接, 预期时刻) 相同，同一次到期两边回调的时刻相差不超过 tolerance，
+// 各自的到期顺序与预期一致 (预期时刻相差 tolerance 以内的不计)；maxLate 为实际与预期的最大偏差
+bool Compare(const vector<Fired>& wheel, const vector<Fired>& heap, int tolerance, int64_t* maxLate) {
+    bool ok = true;
+    int reported = 0;  // 只打印前几个不一致的
+    map<pair<int, int64_t>, int64_t> heapAt;
+    for(const auto& f : heap) {
+        heapAt[{ f.id, f.expected }] = f.at;
+    }
+    for(const auto& f : wheel) {
+        auto it = heapAt.find({ f.id, f.expected });
+        int64_t diff = it == heapAt.end() ? INT64_MAX : f.at - it->second;
+        if(diff < -tolerance || diff > tolerance) {
+            if(reported++ < 10) {
+                if(it == heapAt.end()) {
+                    printf("  id %d expected at %lld: fired only by wheel\n", f.id, (long long)f.expected);
+                } else {
+                    printf("  id %d: wheel fired %lld ms after heap\n", f.id, (long long)diff);
+                }
+            }
+            ok = false;
+        }
+        if(it != heapAt.end()) { heapAt.erase(it); }
+    }
+    for(const auto& kv : heapAt) {
+        if(reported++ < 10) {
+            printf("  id %d expected at %lld: fired only by heap\n", kv.first.first, (long long)kv.first.second);
+        }
+        ok = false;
+    }
+    const vector<Fired>* lists[] = { &wheel, &heap };
+    for(const auto* list : lists) {
+        int64_t latest = INT64_MIN;
+        int inversions = 0;
+        for(const auto& f : *list) {
+            *maxLate = max(*maxLate, abs(f.at - f.expected));
+            if(f.expected + tolerance < latest) { inversions++; }
+            latest = max(latest, f.expected);
+        }
+        if(inversions > 0) {
+            printf("  %s: %d out-of-order expirations\n", list == &wheel ? "wheel" : "heap", inversions);
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 两者同时执行相同的随机操作序列，时钟精度不同，同一连接两边到期的时刻可能相差几毫秒：
+// 只有一边到期时跳过对该连接的操作，等另一边也到期
+bool Check(int conns, int count, int span, int maxTimeout, int tolerance, unsigned seed) {
+    mt19937 rng(seed);
+    vector<Op> ops(count);
+    for(auto& op : ops) {
+        op.at = rng() % span;
+        op.id = rng() % conns;
+        int r = rng() % 10;
+        op.kind = r < 5 ? 0 : (r < 9 ? 1 : 2);
+        op.timeout = 1 + rng() % maxTimeout;
+    }
+    sort(ops.begin(), ops.end(), [](const Op& a, const Op& b) { return a.at < b.at; });
+
+    vector<TimerNode> nodes(conns);
+    vector<int64_t> expected(conns, -1);
+    vector<bool> wheelPending(conns, false), heapPending(conns, false);
+    vector<Fired> wheelFired, heapFired;
+    TimeWheel wheel([&](int id) {
+        wheelFired.push_back({ id, expected[id], NowMS() });
+        wheelPending[id] = false;
+    });
+    HeapTimer heap;
+
+    int64_t start = NowMS();
+    size_t next = 0;
+    while(next < ops.size() || wheel.Size() > 0 || heap.size() > 0) {
+        int64_t now = NowMS();
+        for(; next < ops.size() && ops[next].at <= now - start; next++) {
+            const Op& op = ops[next];
+            int id = op.id;
+            if(wheelPending[id] != heapPending[id]) { continue; }
+            if(op.kind == 2) {
+                wheel.Cancel(&nodes[id]);
+                heap.cancel(id);
+                wheelPending[id] = heapPending[id] = false;
+                continue;
+            }
+            if(op.kind == 1 && !wheelPending[id]) { continue; }
+            if(op.kind == 1) {
+                wheel.Adjust(&nodes[id], op.timeout);
+                heap.add(id, op.timeout, heap.callback(id));  // 可能缩短
+            } else {
+                wheel.Add(&nodes[id], id, op.timeout);
+                heap.add(id, op.timeout, [&, id] {
+                    heapFired.push_back({ id, expected[id], NowMS() });
+                    heapPending[id] = false;
+                });
+            }
+            expected[id] = now + op.timeout;
+            wheelPending[id] = heapPending[id] = true;
+        }
+        if(WaitFd(wheel.Fd(), 0)) { wheel.Expire(); }
+        heap.tick();
+        usleep(200);
+    }
+
+    int64_t maxLate = 0;
+    bool ok = Compare(wheelFired, heapFired, tolerance, &maxLate);
+    printf("check seed %u: %zu / %zu timers fired, max delay %lld ms (tolerance %d): %s\n", seed,
+        wheelFired.size(), heapFired.size(), (long long)maxLate, tolerance, ok ? "OK" : "MISMATCH");
+    return ok;
+}
+
+}  // namespace
+
+int main(int argc, char* argv[]) {
+    int conns = argc > 1 ? atoi(argv[1]) : 100000;
+    int count = argc > 2 ? atoi(argv[2]) : 5000000;
+    if(conns <= 0 || count <= 0) {
+        fprintf(stderr, "usage: %s [conns] [ops]\n", argv[0]);
+        return 1;
+    }
+    mt19937 rng(1);
+    vector<pair<int, bool>> ops(count);
+    for(auto& op : ops) {
+        op.first = rng() % conns;
+        op.second = rng() % 10 == 0;
+    }
+    const int timeout = 60000;
+    Result heap = BenchHeap(conns, ops, timeout);
+    Result wheel = BenchWheel(conns, ops, timeout);
+    printf("%d timers, %d ops (90%% adjust, 10%% cancel + add)\n", conns, count);
+    printf("heap : %7.1f ns/op, expire %8.2f ms busy, %zu fired\n", heap.opNs, heap.expireMs, heap.fired);
+    printf("wheel: %7.1f ns/op, expire %8.2f ms busy, %zu fired\n", wheel.opNs, wheel.expireMs, wheel.fired);
+
+    // 时间轮按粗粒度时钟计算到期时刻，可能提前一个时钟中断周期 (最多 4 毫秒)，再加上本循环的调度延迟
+    bool ok = true;
+    for(unsigned seed = 1; seed <= 3; seed++) {
+        ok = Check(2000, 20000, 1000, 1500, 20, seed) && ok;
+    }
+    return ok && heap.fired == wheel.fired ? 0 : 1;
+}